@@ -0,0 +1,361 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ACTIVITY_LOG_INDEX_H
+#define ACTIVITY_LOG_INDEX_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of activity_log.txt with a sidecar index (<log>.idx).
+// logActivity() writes ctime() output, which ends in a newline, so each entry
+// spans two lines:
+//
+//   [Sun Oct 19 12:50:00 2025
+//   ] User: alice, Action: Logged in
+//
+// The log is memory-mapped; the index stores one fixed-size record per entry
+// and is extended with only the bytes appended since the last refresh().
+class ActivityLogIndex {
+public:
+    struct Entry {
+        uint64_t offset;      // '[' of the entry
+        int64_t timestamp;    // local time parsed from the ctime line
+        uint32_t user_hash;   // FNV-1a of the user name, to filter without touching the log
+        uint32_t length;      // bytes, including both newlines
+    };
+
+    explicit ActivityLogIndex(const std::string& log_path) : log_path(log_path), index_path(log_path + ".idx") {}
+    ~ActivityLogIndex() { unmap(); }
+
+    ActivityLogIndex(const ActivityLogIndex&) = delete;
+    ActivityLogIndex& operator=(const ActivityLogIndex&) = delete;
+
+    // Maps the current file and indexes anything new. Returns the number of
+    // entries added, or -1 if the log cannot be read.
+    long refresh() {
+        if (!map()) {
+            return -1;
+        }
+        if (entries.empty() && indexed_bytes == 0) {
+            loadIndex();
+        }
+        // A shrunk or replaced log (rotation, truncation) invalidates the index.
+        if (indexed_bytes > size || headHash(indexed_bytes) != head_hash) {
+            entries.clear();
+            indexed_bytes = 0;
+            persisted_entries = 0;
+        }
+        size_t before = entries.size();
+        scan();
+        if (entries.size() != before || persisted_entries == 0) {
+            saveIndex();
+        }
+        return static_cast<long>(entries.size() - before);
+    }
+
+    size_t entryCount() const { return entries.size(); }
+    uint64_t fileSize() const { return size; }
+    const Entry& entry(size_t i) const { return entries[i]; }
+
+    // First entry at or after `t`. Entries are appended in time order, so
+    // this is a binary search over the index.
+    size_t lowerBound(int64_t t) const {
+        return std::lower_bound(entries.begin(), entries.end(), t,
+                                [](const Entry& e, int64_t value) { return e.timestamp < value; }) - entries.begin();
+    }
+
+    // The entry as one line: "Sun Oct 19 12:50:00 2025  User: alice, Action: Logged in".
+    std::string format(size_t i) const {
+        const Entry& e = entries[i];
+        const char* text = data + e.offset;
+        const char* end = text + e.length;
+        const char* newline = static_cast<const char*>(std::memchr(text, '\n', e.length));
+        std::string line(text + 1, newline);
+        const char* rest = newline + 2;   // skip "\n]"
+        while (end > rest && (end[-1] == '\n' || end[-1] == '\r')) end--;
+        line += " ";
+        line.append(rest, end);
+        return line;
+    }
+
+    std::string user(size_t i) const {
+        const Entry& e = entries[i];
+        const char* start;
+        size_t length;
+        return userField(data + e.offset, data + e.offset + e.length, start, length) ? std::string(start, length) : "";
+    }
+
+    bool matchesUser(size_t i, const std::string& name) const {
+        return entries[i].user_hash == fnv1a(name.data(), name.size()) && user(i) == name;
+    }
+
+    static uint32_t fnv1a(const char* text, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ static_cast<uint8_t>(text[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    // "Www Mmm dd hh:mm:ss yyyy" as written by ctime(); -1 if malformed.
+    // mktime() consults the time zone on every call, so the start of the
+    // current hour is cached: consecutive entries mostly share it.
+    int64_t parseCtime(const char* text, size_t length) {
+        static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        if (length < 24) {
+            return -1;
+        }
+        // sscanf() would strlen() the rest of the mapped file; parse a terminated copy.
+        char field[25];
+        std::memcpy(field, text, 24);
+        field[24] = '\0';
+        field[7] = '\0';
+        std::tm tm{};
+        const char* month = std::strstr(months, field + 4);
+        if (!month || (month - months) % 3 != 0) {
+            return -1;
+        }
+        tm.tm_mon = static_cast<int>((month - months) / 3);
+        if (std::sscanf(field + 8, "%d %d:%d:%d %d", &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &tm.tm_year) != 5) {
+            return -1;
+        }
+        int64_t hour_key = ((static_cast<int64_t>(tm.tm_year) * 12 + tm.tm_mon) * 32 + tm.tm_mday) * 24 + tm.tm_hour;
+        int64_t offset = tm.tm_min * 60 + tm.tm_sec;
+        if (hour_key != cached_hour_key) {
+            tm.tm_year -= 1900;
+            tm.tm_min = 0;
+            tm.tm_sec = 0;
+            tm.tm_isdst = -1;
+            cached_hour_start = static_cast<int64_t>(std::mktime(&tm));
+            cached_hour_key = hour_key;
+        }
+        return cached_hour_start + offset;
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint64_t indexed_bytes;
+        uint64_t entry_count;
+        uint64_t head_hash;
+    };
+
+    static constexpr const char* kMagic = "CLOGIDX1";
+    static constexpr size_t kHeadBytes = 4096;
+
+    static bool userField(const char* text, const char* end, const char*& start, size_t& length) {
+        static const char user_tag[] = "] User: ";
+        static const char action_tag[] = ", Action: ";
+        const char* newline = static_cast<const char*>(std::memchr(text, '\n', end - text));
+        if (!newline || static_cast<size_t>(end - newline - 1) < sizeof(user_tag) - 1 ||
+            std::memcmp(newline + 1, user_tag, sizeof(user_tag) - 1) != 0) {
+            return false;
+        }
+        start = newline + sizeof(user_tag);
+        const char* action = std::search(start, end, action_tag, action_tag + sizeof(action_tag) - 1);
+        length = action - start;
+        return true;
+    }
+
+    // FNV-1a of the first 4 KB, to notice the log being replaced under the index.
+    uint64_t headHash(uint64_t limit) const {
+        uint64_t hash = 1469598103934665603ull;
+        uint64_t n = std::min<uint64_t>({limit, size, kHeadBytes});
+        for (uint64_t i = 0; i < n; i++) {
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Indexes complete entries from indexed_bytes on. A partly written entry
+    // at the end is left for the next refresh().
+    void scan() {
+        uint64_t pos = indexed_bytes;
+        while (pos < size) {
+            const char* start = data + pos;
+            const char* end = data + size;
+            const char* first = static_cast<const char*>(std::memchr(start, '\n', end - start));
+            if (!first) break;
+            if (*start != '[') {
+                pos = first + 1 - data;   // not an entry (stray line); skip it
+                continue;
+            }
+            const char* second = static_cast<const char*>(std::memchr(first + 1, '\n', end - first - 1));
+            if (!second) break;
+            Entry e;
+            e.offset = pos;
+            e.length = static_cast<uint32_t>(second + 1 - start);
+            e.timestamp = parseCtime(start + 1, first - start - 1);
+            if (e.timestamp < 0 && !entries.empty()) {
+                e.timestamp = entries.back().timestamp;
+            }
+            const char* user_start;
+            size_t user_length = 0;
+            e.user_hash = userField(start, second + 1, user_start, user_length) ? fnv1a(user_start, user_length) : 0;
+            entries.push_back(e);
+            pos = second + 1 - data;
+        }
+        indexed_bytes = pos;
+        head_hash = headHash(indexed_bytes);
+    }
+
+    // A truncated or corrupt index is ignored, and refresh() rescans the log.
+    void loadIndex() {
+        std::ifstream in(index_path, std::ios::binary | std::ios::ate);
+        std::streamoff file_size = in.tellg();
+        Header header;
+        if (file_size < static_cast<std::streamoff>(sizeof(Header)) || !in.seekg(0) ||
+            !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, kMagic, sizeof(header.magic)) != 0) {
+            return;
+        }
+        // Records past entry_count are allowed (a crash before the header
+        // rewrite); fewer are not.
+        if (header.entry_count > (static_cast<uint64_t>(file_size) - sizeof(Header)) / sizeof(Entry)) {
+            return;
+        }
+        std::vector<Entry> loaded(header.entry_count);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size() * sizeof(Entry))) {
+            return;
+        }
+        // format() and user() read every entry straight from the mapping.
+        for (const Entry& e : loaded) {
+            if (e.length == 0 || e.offset > header.indexed_bytes || e.length > header.indexed_bytes - e.offset) {
+                return;
+            }
+        }
+        entries = std::move(loaded);
+        indexed_bytes = header.indexed_bytes;
+        head_hash = header.head_hash;
+        persisted_entries = entries.size();
+    }
+
+    // Appends the new records and then rewrites the header, so a crash in
+    // between leaves a header that still describes a valid prefix.
+    void saveIndex() {
+        std::fstream out(index_path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!out.is_open() || persisted_entries == 0) {
+            out.close();
+            out.open(index_path, std::ios::binary | std::ios::out | std::ios::trunc);
+            persisted_entries = 0;
+            if (!out.is_open()) {
+                std::cerr << "Cannot write log index " << index_path << std::endl;
+                return;
+            }
+        }
+        Header header;
+        std::memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.indexed_bytes = indexed_bytes;
+        header.entry_count = entries.size();
+        header.head_hash = head_hash;
+        out.seekp(sizeof(Header) + persisted_entries * sizeof(Entry));
+        out.write(reinterpret_cast<const char*>(entries.data() + persisted_entries),
+                  (entries.size() - persisted_entries) * sizeof(Entry));
+        out.flush();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        persisted_entries = entries.size();
+    }
+
+    bool map() {
+#ifndef _WIN32
+        int fd = open(log_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Cannot open " << log_path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        uint64_t new_size = static_cast<uint64_t>(st.st_size);
+        if (data && new_size == size) {
+            close(fd);
+            return true;
+        }
+        unmap();
+        size = new_size;
+        if (size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped == MAP_FAILED) {
+                std::cerr << "Cannot map " << log_path << ": " << strerror(errno) << std::endl;
+                close(fd);
+                size = 0;
+                return false;
+            }
+            data = static_cast<const char*>(mapped);
+        }
+        close(fd);
+        return true;
+#else
+        // No mmap here: read the file instead.
+        std::ifstream in(log_path, std::ios::binary);
+        if (!in.is_open()) {
+            std::cerr << "Cannot open " << log_path << std::endl;
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#endif
+    }
+
+    void unmap() {
+#ifndef _WIN32
+        if (data && size > 0) {
+            munmap(const_cast<char*>(data), size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    std::string log_path;
+    std::string index_path;
+    const char* data = nullptr;
+    uint64_t size = 0;
+#ifdef _WIN32
+    std::string buffer;
+#endif
+    std::vector<Entry> entries;
+    uint64_t indexed_bytes = 0;
+    uint64_t head_hash = 0;
+    size_t persisted_entries = 0;
+    int64_t cached_hour_key = -1;
+    int64_t cached_hour_start = 0;
+};
+
+#endif
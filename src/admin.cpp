@@ -20,7 +20,22 @@
 #include <iostream>
 #include <fstream>
 #include <cerrno>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include "sha256.h"
+#include "sqltrace.h"
+#include "activity_log_index.h"
+#include "order_events.h"
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
 
@@ -159,43 +174,446 @@ bool resetTotpSecret(sqlite3* db, const std::string& username) {
     return success;
 }
 
-void viewActivityLogFile() {
-    const std::string log_path = "/Users/rudra/Library/Mobile Documents/com~apple~CloudDocs/RUDRA FILES/SEM-2/Hackathon/activity_log.txt";
-    std::ifstream log_file(log_path);
-    if (!log_file.good()) {
-        std::cerr << "File does not exist or is inaccessible: " << log_path << " (errno: " << strerror(errno) << ")\n";
+// Parses "YYYY-MM-DD" or "YYYY-MM-DD HH:MM" as local time; -1 if malformed.
+int64_t parseLocalTime(const std::string& text) {
+    std::tm tm{};
+    int fields = std::sscanf(text.c_str(), "%d-%d-%d %d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min);
+    if (fields != 3 && fields != 5) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&tm));
+}
+
+// Prints new entries as they are appended until Enter is pressed. Uses
+// inotify where available and polls once a second elsewhere.
+void followActivityLog(ActivityLogIndex& log, const std::string& log_path, const std::string& user_filter) {
+    std::cout << "Following " << log_path << " (press Enter to stop)..." << std::endl;
+    size_t shown = log.entryCount();
+#ifdef __linux__
+    int watch_fd = inotify_init1(IN_NONBLOCK);
+    if (watch_fd >= 0 && inotify_add_watch(watch_fd, log_path.c_str(), IN_MODIFY) < 0) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+#else
+    int watch_fd = -1;
+#endif
+    while (true) {
+        pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {watch_fd, POLLIN, 0}};
+        int ready = poll(fds, watch_fd >= 0 ? 2 : 1, watch_fd >= 0 ? -1 : 1000);
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            std::string discard;
+            std::getline(std::cin, discard);
+            break;
+        }
+        if (watch_fd >= 0 && (fds[1].revents & POLLIN)) {
+            char events[4096];
+            while (read(watch_fd, events, sizeof(events)) > 0) {
+            }
+        }
+        if (log.refresh() < 0) {
+            break;
+        }
+        for (; shown < log.entryCount(); shown++) {
+            if (user_filter.empty() || log.matchesUser(shown, user_filter)) {
+                std::cout << log.format(shown) << "\n";
+            }
+        }
+        std::cout.flush();
+    }
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
+}
+
+// Pages through the activity log through its sidecar index; only the shown
+// entries are read from the mapped file.
+void viewActivityLogFile(const std::string& log_path) {
+    ActivityLogIndex log(log_path);
+    if (log.refresh() < 0) {
         return;
     }
-    if (log_file.is_open()) {
-        std::cout << "\nActivity Log (" << log_path << "):\n";
-        std::cout << "-------------\n";
-        std::string line;
-        bool has_logs = false;
-        while (std::getline(log_file, line)) {
-            has_logs = true;
-            std::cout << line << "\n";
-        }
-        if (!has_logs) {
-            std::cout << "No logs found in " << log_path << "\n";
-        } else {
-            std::cout << "Successfully read logs from " << log_path << "\n";
+    const size_t page_size = 20;
+    size_t position = log.entryCount() > page_size ? log.entryCount() - page_size : 0;   // newest page first
+    int64_t range_end = -1;
+    std::string user_filter;
+
+    while (true) {
+        size_t end = range_end < 0 ? log.entryCount() : log.lowerBound(range_end);
+        std::cout << "\nActivity Log (" << log_path << ", " << log.entryCount() << " entries, "
+                  << log.fileSize() / (1024 * 1024) << " MB)";
+        if (!user_filter.empty()) std::cout << " user=" << user_filter;
+        std::cout << "\n-------------\n";
+        // Collect one page of matching entries starting at `position`.
+        size_t shown = 0, next = position;
+        for (; next < end && shown < page_size; next++) {
+            if (user_filter.empty() || log.matchesUser(next, user_filter)) {
+                std::cout << log.format(next) << "\n";
+                shown++;
+            }
+        }
+        if (shown == 0) {
+            std::cout << "No logs found.\n";
+        }
+
+        std::cout << "[n]ext, [p]rev, [t] FROM [TO] (YYYY-MM-DD[ HH:MM]), [u] USER (blank clears), [f]ollow, [q]uit: ";
+        std::string command;
+        if (!std::getline(std::cin, command) || command == "q") {
+            break;
+        }
+        if (command == "n") {
+            if (next < end) position = next;
+        } else if (command == "p") {
+            // Step back over page_size matching entries.
+            size_t matched = 0;
+            while (position > 0 && matched < page_size) {
+                position--;
+                if (user_filter.empty() || log.matchesUser(position, user_filter)) matched++;
+            }
+        } else if (command.rfind("t ", 0) == 0) {
+            std::string args = command.substr(2);
+            // The optional TO starts at the second date, i.e. the next "YYYY-".
+            size_t split = args.find(' ', 0);
+            while (split != std::string::npos && !(split + 5 < args.size() && args[split + 5] == '-')) {
+                split = args.find(' ', split + 1);
+            }
+            int64_t from = parseLocalTime(args.substr(0, split));
+            int64_t to = split == std::string::npos ? -1 : parseLocalTime(args.substr(split + 1));
+            if (from < 0) {
+                std::cout << "Invalid time. Use YYYY-MM-DD or YYYY-MM-DD HH:MM.\n";
+                continue;
+            }
+            position = log.lowerBound(from);
+            range_end = to;
+        } else if (command == "t") {
+            range_end = -1;
+            position = 0;
+        } else if (command == "u" || command.rfind("u ", 0) == 0) {
+            user_filter = command.size() > 2 ? command.substr(2) : "";
+        } else if (command == "f") {
+            followActivityLog(log, log_path, user_filter);
+            position = log.entryCount() > page_size ? log.entryCount() - page_size : 0;
+            range_end = -1;
+        } else if (log.refresh() < 0) {
+            break;
         }
-        log_file.close();
-    } else {
-        std::cerr << "Failed to open " << log_path << " for reading: " << strerror(errno) << "\n";
     }
 }
 
-int main() {
+// Splits one CSV line; fields may be double-quoted, with "" for a literal quote.
+std::vector<std::string> parseCsvLine(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                fields.back() += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+std::string csvField(const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) {
+        return value;
+    }
+    std::string quoted = "\"";
+    for (char c : value) {
+        quoted += c;
+        if (c == '"') quoted += '"';
+    }
+    return quoted + "\"";
+}
+
+struct ProvisionedUser {
+    int line = 0;
+    std::string username;
+    std::string password;          // plaintext, only when generated here
+    bool generated_password = false;
+    std::string role;
+    std::string password_hash;
+    std::string totp_secret;
+};
+
+// Imports username,password,role rows. An empty password gets a generated
+// one. Hashing and secret generation run on `threads` workers; all inserts go
+// in one transaction, committed only after the secrets file (mode 0600, never
+// overwritten) has been written. Any bad row aborts the whole import.
+bool importUsers(sqlite3* db, const std::string& csv_path, const std::string& secrets_path, unsigned threads) {
+    std::ifstream csv(csv_path);
+    if (!csv.is_open()) {
+        std::cerr << "Failed to open " << csv_path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<ProvisionedUser> users;
+    std::set<std::string> seen;
+    std::string line;
+    int line_number = 0;
+    bool valid = true;
+    while (std::getline(csv, line)) {
+        line_number++;
+        std::vector<std::string> fields = parseCsvLine(line);
+        if (fields.size() == 1 && fields[0].empty()) {
+            continue;
+        }
+        if (line_number == 1 && fields[0] == "username") {
+            continue;   // header
+        }
+        if (fields.size() != 3) {
+            std::cerr << csv_path << ":" << line_number << ": expected username,password,role" << std::endl;
+            valid = false;
+            continue;
+        }
+        ProvisionedUser user;
+        user.line = line_number;
+        user.username = fields[0];
+        user.password = fields[1];
+        user.role = fields[2];
+        if (user.username.empty()) {
+            std::cerr << csv_path << ":" << line_number << ": empty username" << std::endl;
+            valid = false;
+        } else if (!seen.insert(user.username).second) {
+            std::cerr << csv_path << ":" << line_number << ": duplicate username " << user.username << std::endl;
+            valid = false;
+        }
+        if (user.role != "admin" && user.role != "manager" && user.role != "biller") {
+            std::cerr << csv_path << ":" << line_number << ": invalid role '" << user.role << "'" << std::endl;
+            valid = false;
+        }
+        users.push_back(std::move(user));
+    }
+    if (!valid) {
+        std::cerr << "Import aborted; no users were added." << std::endl;
+        return false;
+    }
+    if (users.empty()) {
+        std::cerr << "No users found in " << csv_path << std::endl;
+        return false;
+    }
+
+    // CPU-bound work in parallel: each worker claims the next unprocessed row.
+    std::atomic<size_t> next{0};
+    std::atomic<bool> secrets_failed{false};
+    std::vector<std::thread> workers;
+    threads = std::max(1u, std::min<unsigned>(threads, users.size()));
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&users, &next, &secrets_failed] {
+            for (size_t i = next++; i < users.size(); i = next++) {
+                ProvisionedUser& user = users[i];
+                if (user.password.empty()) {
+                    user.password = generate_base32_secret();
+                    user.generated_password = true;
+                }
+                user.password_hash = sha256(user.password);
+                user.totp_secret = generate_base32_secret();
+                if (user.password.empty() || user.totp_secret.empty()) {
+                    secrets_failed = true;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (secrets_failed) {
+        std::cerr << "Import aborted; no users were added." << std::endl;
+        return false;
+    }
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cerr << "Cannot start transaction: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO users (username, password, role, totp_secret) VALUES (?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    for (const auto& user : users) {
+        sqlite3_bind_text(stmt, 1, user.username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, user.password_hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, user.role.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, user.totp_secret.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << csv_path << ":" << user.line << ": cannot add " << user.username << ": " << sqlite3_errmsg(db) << std::endl;
+            valid = false;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (!valid) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        std::cerr << "Import aborted; no users were added." << std::endl;
+        return false;
+    }
+
+    // Secrets go to disk before COMMIT, so a committed user always has a delivered secret.
+    int fd = open(secrets_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    FILE* secrets = fd >= 0 ? fdopen(fd, "w") : nullptr;
+    if (!secrets) {
+        std::cerr << "Cannot create secrets file " << secrets_path << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    std::fprintf(secrets, "username,role,password,totp_secret\n");
+    for (const auto& user : users) {
+        std::fprintf(secrets, "%s,%s,%s,%s\n", csvField(user.username).c_str(), user.role.c_str(),
+                     user.generated_password ? user.password.c_str() : "", user.totp_secret.c_str());
+    }
+    bool written = std::fflush(secrets) == 0 && fsync(fd) == 0;
+    written = std::fclose(secrets) == 0 && written;
+    if (!written || sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cerr << "Import failed: " << (written ? sqlite3_errmsg(db) : strerror(errno)) << std::endl;
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        std::remove(secrets_path.c_str());
+        return false;
+    }
+    std::cout << "Imported " << users.size() << " users; secrets written to " << secrets_path << std::endl;
+    return true;
+}
+
+// Writes username,role for every user. Password hashes and TOTP secrets are not exported.
+bool exportUsers(sqlite3* db, const std::string& csv_path) {
+    std::ofstream csv(csv_path, std::ios::trunc);
+    if (!csv.is_open()) {
+        std::cerr << "Failed to open " << csv_path << " for writing: " << strerror(errno) << std::endl;
+        return false;
+    }
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT username, role FROM users ORDER BY username;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    csv << "username,role\n";
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* role = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        csv << csvField(username ? username : "") << "," << csvField(role ? role : "") << "\n";
+        count++;
+    }
+    sqlite3_finalize(stmt);
+    std::cout << "Exported " << count << " users to " << csv_path << std::endl;
+    return static_cast<bool>(csv);
+}
+
+// Checks (and with repair, rewrites) the orders projection from order_events.
+bool replayOrderLog(sqlite3* db, bool repair, bool full) {
+    initOrderEvents(db);
+    if (!full) {
+        snapshotOrders(db);
+    }
+    OrderReplayReport report = replayOrders(db, repair, !full);
+    std::cout << "Replayed " << report.orders << " orders (" << report.snapshots_used << " from snapshots, "
+              << report.events << " events folded) in " << report.seconds << " s\n"
+              << report.mismatched << " differ from the log";
+    if (report.first_mismatch >= 0) std::cout << " (first: order " << report.first_mismatch << ")";
+    std::cout << ", " << report.repaired << " repaired, " << report.without_events << " without events" << std::endl;
+    return report.mismatched == report.repaired;
+}
+
+bool printOrderTimeline(sqlite3* db, long long order_id) {
+    initOrderEvents(db);
+    std::vector<OrderEvent> timeline = orderTimeline(db, order_id);
+    if (timeline.empty()) {
+        std::cout << "No events for order " << order_id << std::endl;
+        return false;
+    }
+    OrderState state;
+    for (const auto& event : timeline) {
+        applyOrderEvent(state, event);
+        std::time_t at = static_cast<std::time_t>(event.created_at);
+        char when[32];
+        std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&at));
+        std::cout << when << "  " << orderEventName(event.type);
+        if (event.type == OrderEventType::ITEM_ADDED) std::cout << "  " << event.quantity << " x item " << event.item_id << " @ " << event.amount;
+        if (event.bill_id) std::cout << "  bill " << event.bill_id;
+        if (event.type == OrderEventType::CREATED || event.bill_id) std::cout << "  Rs " << event.amount;
+        if (event.type == OrderEventType::RUSH) std::cout << (event.quantity ? "  on" : "  off");
+        if (!event.user_id.empty()) std::cout << "  by " << event.user_id;
+        std::cout << "  -> " << state.status << (state.rush ? ", rush" : "") << (state.refunded ? ", refunded" : "") << "\n";
+    }
+    std::cout.flush();
+    return true;
+}
+
+void printUsage() {
+    std::cerr << "Usage: AdminPanel [--db PATH] [--log PATH] [--threads N] [import-users USERS.csv [--secrets-out FILE] | export-users OUT.csv |\n"
+                 "                  replay-orders [--repair] [--full] | order-timeline ORDER_ID]\n"
+                 "With no command, starts the interactive menu." << std::endl;
+}
+
+int main(int argc, char** argv) {
     sqlite3* db;
-    const char* db_path = "/Users/rudra/Library/Mobile Documents/com~apple~CloudDocs/RUDRA FILES/SEM-2/Hackathon/users.db";
+    std::string db_path = "/Users/rudra/Library/Mobile Documents/com~apple~CloudDocs/RUDRA FILES/SEM-2/Hackathon/users.db";
+    std::string log_path = "/Users/rudra/Library/Mobile Documents/com~apple~CloudDocs/RUDRA FILES/SEM-2/Hackathon/activity_log.txt";
+    std::string command, command_path, secrets_path = "provisioning_secrets.csv";
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool repair = false, full_replay = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--db" && i + 1 < argc) {
+            db_path = argv[++i];
+        } else if (arg == "--log" && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--secrets-out" && i + 1 < argc) {
+            secrets_path = argv[++i];
+        } else if ((arg == "import-users" || arg == "export-users" || arg == "order-timeline") && command.empty() && i + 1 < argc) {
+            command = arg;
+            command_path = argv[++i];
+        } else if (arg == "replay-orders" && command.empty()) {
+            command = arg;
+        } else if (arg == "--repair") {
+            repair = true;
+        } else if (arg == "--full") {
+            full_replay = true;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+
     std::cerr << "Opening database at " << db_path << std::endl;
-    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+    if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
         std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
         return -1;
     }
+    SqlTrace::instance().install(db);
     initDatabase(db);
 
+    if (!command.empty()) {
+        bool ok = command == "import-users"   ? importUsers(db, command_path, secrets_path, threads)
+                : command == "export-users"   ? exportUsers(db, command_path)
+                : command == "replay-orders"  ? replayOrderLog(db, repair, full_replay)
+                                              : printOrderTimeline(db, std::atoll(command_path.c_str()));
+        SqlTrace::instance().dump(std::cerr);
+        sqlite3_close(db);
+        return ok ? 0 : 1;
+    }
+
     std::string choice;
     while (true) {
         std::cout << "\nAdmin Panel Menu:\n";
@@ -235,7 +653,7 @@ int main() {
             std::getline(std::cin, username);
             resetTotpSecret(db, username);
         } else if (choice == "5") {
-            viewActivityLogFile();
+            viewActivityLogFile(log_path);
         } else if (choice == "6") {
             std::cout << "Exiting Admin Panel.\n";
             break;
@@ -244,6 +662,7 @@ int main() {
         }
     }
 
+    SqlTrace::instance().dump(std::cerr);
     sqlite3_close(db);
     return 0;
 }
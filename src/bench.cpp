@@ -0,0 +1,605 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// canteen_bench: benchmarks the data layer of main.cpp against a generated
+// database and prints latency percentiles and throughput as JSON.
+//
+//   canteen_bench [--db PATH] [--items N] [--customers N] [--users N]
+//                 [--orders N] [--iterations N] [--view-iterations N]
+//                 [--seed N] [--sql-trace] [--verbose]
+
+#define CANTEEN_HEADLESS
+#include "main.cpp"
+#include "datagen.h"
+
+#include <chrono>
+#include <random>
+#include <map>
+#include <cstdio>
+
+struct BenchConfig {
+    std::string db_path;
+    int items = 50;
+    int customers = 500;
+    int users = 50;
+    int orders = 10000;
+    int iterations = 1000;
+    int view_iterations = 20;
+    unsigned int seed = 42;
+    bool sql_trace = false;
+    bool verbose = false;
+};
+
+struct BenchResult {
+    std::string name;
+    std::vector<double> latencies_us;
+    double wall_seconds = 0.0;
+    std::map<std::string, double> extra;
+};
+
+using BenchClock = std::chrono::steady_clock;
+
+double elapsedMicros(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::micro>(BenchClock::now() - start).count();
+}
+
+template <typename F>
+BenchResult runBenchmark(const std::string& name, int iterations, F fn) {
+    BenchResult result;
+    result.name = name;
+    result.latencies_us.reserve(iterations);
+    auto wall_start = BenchClock::now();
+    for (int i = 0; i < iterations; i++) {
+        auto start = BenchClock::now();
+        fn(i);
+        result.latencies_us.push_back(elapsedMicros(start));
+    }
+    result.wall_seconds = elapsedMicros(wall_start) / 1e6;
+    return result;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+std::string customerId(int index) {
+    return datasetCustomerId(index);
+}
+
+bool execSql(sqlite3* db, const char* sql) {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "SQL error: " << (errMsg ? errMsg : "unknown") << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+// Fills a fresh database through the dataset generator, then gives the
+// benchmark effectively unlimited stock, wallet balance and points so no
+// iteration fails on business rules.
+void generateBenchData(sqlite3* db, const BenchConfig& config) {
+    DatasetOptions options;
+    options.seed = config.seed;
+    options.items = config.items;
+    options.customers = config.customers;
+    options.orders = config.orders;
+    options.days = std::max(1, std::min(365, config.orders / 50));
+    DatasetStats stats;
+    generateDataset(db, options, stats);
+    sealHashChain(db, kBillsChain);
+    sealHashChain(db, kActivityLogChain);
+
+    execSql(db, "BEGIN;");
+    execSql(db, "UPDATE inventory SET quantity = 1000000000;");
+    execSql(db, "UPDATE wallets SET balance = 1000000000;");
+    execSql(db, "INSERT OR REPLACE INTO loyalty_points (user_id, points) SELECT user_id, 1000000 FROM wallets;");
+    execSql(db, "DELETE FROM loyalty_lots;");
+    backfillLoyaltyLots(db);
+
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO users (username, password, role, totp_secret) VALUES (?, ?, 'biller', '');", -1, &stmt, nullptr);
+    std::string password_hash = sha256("bench");
+    for (int i = 0; i < config.users; i++) {
+        // Staff usernames double as customer IDs so viewUserDetails has orders to join.
+        std::string id = customerId(i);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, password_hash.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    execSql(db, "INSERT INTO discounts (discount_id, name, type, value, start_time, end_time, combo_items) VALUES "
+                "(1, 'Bench 10% Off', 'percentage', 10, 0, 2147483647, ''), "
+                "(2, 'Bench Combo', 'combo', 25, 0, 2147483647, '1,2');");
+    // Every item uses its own ingredient plus two shared by the whole menu,
+    // so createOrder pays for the ingredient pass.
+    execSql(db, "INSERT INTO ingredients (name, unit, quantity) SELECT 'Ingredient ' || item_id, 'g', 1e12 FROM menu_items;");
+    execSql(db, "INSERT INTO ingredients (name, unit, quantity) VALUES ('Flour', 'g', 1e12), ('Oil', 'ml', 1e12);");
+    execSql(db, "INSERT INTO recipe_items (item_id, ingredient_id, quantity) "
+                "SELECT mi.item_id, g.ingredient_id, 50 FROM menu_items mi JOIN ingredients g ON g.name = 'Ingredient ' || mi.item_id;");
+    execSql(db, "INSERT INTO recipe_items (item_id, ingredient_id, quantity) "
+                "SELECT mi.item_id, g.ingredient_id, 20 FROM menu_items mi JOIN ingredients g ON g.name IN ('Flour', 'Oil');");
+    execSql(db, "COMMIT;");
+    stockReservations().load(db);
+    recipeBook().load(db);
+}
+
+void printJson(const BenchConfig& config, const std::vector<BenchResult>& results) {
+    std::printf("{\n  \"config\": {\"db\": \"%s\", \"items\": %d, \"customers\": %d, \"users\": %d, "
+                "\"orders\": %d, \"iterations\": %d, \"view_iterations\": %d, \"seed\": %u},\n",
+                config.db_path.c_str(), config.items, config.customers, config.users,
+                config.orders, config.iterations, config.view_iterations, config.seed);
+    std::printf("  \"results\": [\n");
+    for (size_t r = 0; r < results.size(); r++) {
+        std::vector<double> sorted = results[r].latencies_us;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double v : sorted) sum += v;
+        double mean = sorted.empty() ? 0.0 : sum / sorted.size();
+        double ops = results[r].wall_seconds > 0 ? sorted.size() / results[r].wall_seconds : 0.0;
+        std::printf("    {\"name\": \"%s\", \"iterations\": %zu, \"ops_per_sec\": %.2f, "
+                    "\"latency_us\": {\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f, \"mean\": %.2f}",
+                    results[r].name.c_str(), sorted.size(), ops,
+                    percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99),
+                    sorted.empty() ? 0.0 : sorted.back(), mean);
+        for (const auto& extra : results[r].extra) {
+            std::printf(", \"%s\": %.2f", extra.first.c_str(), extra.second);
+        }
+        std::printf("}%s\n", r + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+bool parseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&](int& target) {
+            if (i + 1 >= argc) return false;
+            target = std::stoi(argv[++i]);
+            return true;
+        };
+        bool ok = true;
+        if (arg == "--db" && i + 1 < argc) {
+            config.db_path = argv[++i];
+        } else if (arg == "--items") {
+            ok = next(config.items);
+        } else if (arg == "--customers") {
+            ok = next(config.customers);
+        } else if (arg == "--users") {
+            ok = next(config.users);
+        } else if (arg == "--orders") {
+            ok = next(config.orders);
+        } else if (arg == "--iterations") {
+            ok = next(config.iterations);
+        } else if (arg == "--view-iterations") {
+            ok = next(config.view_iterations);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            config.seed = static_cast<unsigned int>(std::stoul(argv[++i]));
+        } else if (arg == "--sql-trace") {
+            config.sql_trace = true;
+        } else if (arg == "--verbose") {
+            config.verbose = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Usage: canteen_bench [--db PATH] [--items N] [--customers N] [--users N] [--orders N] "
+                         "[--iterations N] [--view-iterations N] [--seed N] [--sql-trace] [--verbose]" << std::endl;
+            return false;
+        }
+    }
+    config.items = std::max(config.items, 2);
+    config.customers = std::max(config.customers, 1);
+    config.users = std::min(std::max(config.users, 0), config.customers);
+    config.iterations = std::max(config.iterations, 1);
+    config.view_iterations = std::max(config.view_iterations, 1);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    config.db_path = (std::filesystem::temp_directory_path() / "canteen_bench.db").string();
+    if (!parseArgs(argc, argv, config)) {
+        return 1;
+    }
+
+    // The data layer logs every call to stderr; keep that out of the timings.
+    std::streambuf* saved_cerr = std::cerr.rdbuf();
+    if (!config.verbose) {
+        std::cerr.rdbuf(nullptr);
+    }
+
+    for (const char* suffix : {"", "-wal", "-shm"}) {
+        std::remove((config.db_path + suffix).c_str());
+    }
+    sqlite3* db;
+    if (sqlite3_open(config.db_path.c_str(), &db) != SQLITE_OK) {
+        std::cerr.rdbuf(saved_cerr);
+        std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+        return 1;
+    }
+    if (config.sql_trace) {
+        SqlTrace::instance().install(db);
+    }
+    initDatabase(db);
+    execSql(db, "PRAGMA journal_mode=WAL;");
+    sqlite3_busy_timeout(db, 5000);
+    generateBenchData(db, config);
+
+    std::mt19937 rng(config.seed + 1);
+    std::uniform_int_distribution<int> item_dist(1, config.items);
+    std::uniform_int_distribution<int> customer_dist(0, config.customers - 1);
+    std::uniform_int_distribution<int> lines_dist(1, 4);
+    auto randomCart = [&]() {
+        std::vector<OrderItem> cart;
+        int lines = lines_dist(rng);
+        for (int l = 0; l < lines; l++) {
+            int item_id = item_dist(rng);
+            mergeOrderItem(cart, {item_id, "", 1 + l % 2, datasetItemPrice(item_id)});
+        }
+        return cart;
+    };
+
+    std::vector<BenchResult> results;
+    std::vector<int> created_orders;
+    std::vector<std::string> created_customers;
+
+    // Eight terminals grabbing the last units of one item, one at a time.
+    const int contended_stock = 100000;
+    const int contended_item = StockReservations::kMaxItemId - 1;
+    std::atomic<long long> granted{0};
+    stockReservations().sync(contended_item, contended_stock);
+    BenchResult contended = runBenchmark("reserveStock_contended", 1, [&](int) {
+        std::vector<std::thread> terminals;
+        for (int t = 0; t < 8; t++) {
+            terminals.emplace_back([&] {
+                while (stockReservations().reserve(contended_item, 1)) granted.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        for (auto& terminal : terminals) terminal.join();
+    });
+    contended.extra["reservations_per_sec"] = contended.wall_seconds > 0 ? granted.load() / contended.wall_seconds : 0.0;
+    contended.extra["oversold"] = static_cast<double>(granted.load() - contended_stock);
+    results.push_back(contended);
+
+    // The generated orders are plain rows; give them their event log, as the
+    // app does on first start with an existing database.
+    BenchResult backfill = runBenchmark("backfillOrderEvents", 1, [&](int) { backfillOrderEvents(db); });
+    sqlite3_stmt* count_stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM order_events;", -1, &count_stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(count_stmt) == SQLITE_ROW) backfill.extra["events"] = sqlite3_column_double(count_stmt, 0);
+        sqlite3_finalize(count_stmt);
+    }
+    results.push_back(backfill);
+
+    // Fits every item over the generated history; createOrder below then
+    // pays for the per-order observe().
+    BenchResult training = runBenchmark("trainDemandForecast", 1, [&](int) { demandForecaster().train(db); });
+    training.extra["items"] = static_cast<double>(demandForecaster().itemCount());
+    training.extra["days"] = std::max(1, std::min(365, config.orders / 50));
+    results.push_back(training);
+
+    results.push_back(runBenchmark("createOrder", config.iterations, [&](int) {
+        std::string customer = customerId(customer_dist(rng));
+        int order_id = createOrder(db, customer, randomCart());
+        if (order_id != -1) {
+            created_orders.push_back(order_id);
+            created_customers.push_back(customer);
+        }
+    }));
+
+    std::string error_message;
+    results.push_back(runBenchmark("generateBill", static_cast<int>(created_orders.size()), [&](int i) {
+        const char* method = i % 2 == 0 ? "wallet" : "Cash";
+        int discount_id = i % 3 == 0 ? 1 : 0;
+        generateBill(db, created_orders[i], method, discount_id, i % 5 == 0 ? 10 : 0, "bench", error_message);
+        if (i + 1 == static_cast<int>(created_orders.size())) {
+            flushLoyaltyAccruals(db);   // the last partial batch belongs to this scenario too
+        }
+    }));
+
+    // Reprints: bills from the generateBill scenario decode their snapshot;
+    // generated history has none and goes back to order_items and the menu.
+    std::vector<int> snapshot_bills, legacy_bills;
+    sqlite3_stmt* reprint_stmt;
+    if (sqlite3_prepare_v2(db, "SELECT bill_id, snapshot IS NOT NULL FROM bills ORDER BY bill_id DESC;", -1, &reprint_stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(reprint_stmt) == SQLITE_ROW) {
+            auto& ids = sqlite3_column_int(reprint_stmt, 1) ? snapshot_bills : legacy_bills;
+            if (ids.size() < 1000) ids.push_back(sqlite3_column_int(reprint_stmt, 0));
+        }
+        sqlite3_finalize(reprint_stmt);
+    }
+    BillSnapshot reprint;
+    for (bool snapshots : {false, true}) {
+        const std::vector<int>& ids = snapshots ? snapshot_bills : legacy_bills;
+        if (ids.empty()) continue;
+        results.push_back(runBenchmark(snapshots ? "loadBillSnapshot_snapshot" : "loadBillSnapshot_legacy", config.iterations,
+                                       [&](int i) { loadBillSnapshot(db, ids[i % ids.size()], reprint); }));
+    }
+
+    // Receipt bytes for a reprinted bill, as generateBill queues them.
+    size_t receipt_bytes = 0;
+    BenchResult receipt = runBenchmark("renderReceipt", config.iterations, [&](int) {
+        receipt_bytes = renderReceipt(reprint).size();
+    });
+    receipt.extra["bytes"] = static_cast<double>(receipt_bytes);
+    results.push_back(receipt);
+
+    // One redraw of a 200-row table's "Created" column, as the UI did it
+    // before (a std::string per row) and through the render cache.
+    const int table_rows = 200;
+    int table_start = static_cast<int>(std::time(nullptr)) - 86400;
+    size_t timestamp_chars = 0;
+    results.push_back(runBenchmark("formatTimestamp_table", config.view_iterations * 20, [&](int) {
+        for (int row = 0; row < table_rows; row++) timestamp_chars += formatTimestamp(table_start + row * 97).size();
+    }));
+    results.push_back(runBenchmark("formatTimestampCached_table", config.view_iterations * 20, [&](int) {
+        for (int row = 0; row < table_rows; row++) timestamp_chars += strlen(formatTimestampCached(table_start + row * 97));
+    }));
+
+    std::vector<OrderItem> combo_cart = {{1, "", 1, 30.0f}, {2, "", 1, 40.0f}};
+    results.push_back(runBenchmark("applyDiscount", config.iterations, [&](int i) {
+        applyDiscount(db, i % 2 == 0 ? 1 : 2, 500.0f, combo_cart);
+    }));
+
+    results.push_back(runBenchmark("logActivity", config.iterations, [&](int i) {
+        logActivity(db, "bench", "Benchmark action " + std::to_string(i));
+    }));
+
+    // Shift-change logins: every verification checks all seven windows, matched or not.
+    std::vector<std::string> totp_secrets, totp_codes;
+    int64_t totp_step = totp_time_step();
+    for (int i = 0; i < 64; i++) {
+        totp_secrets.push_back(generate_base32_secret());
+        totp_codes.push_back(std::to_string(1000000 + generate_totp(totp_secrets.back(), totp_step)).substr(1));
+    }
+    BenchResult totp = runBenchmark("verifyTotp", config.iterations, [&](int i) {
+        size_t user = i % totp_secrets.size();
+        verify_totp(totp_secrets[user], i % 2 == 0 ? "000000" : totp_codes[user]);
+    });
+    totp.extra["verifications_per_sec"] = totp.wall_seconds > 0 ? totp.latencies_us.size() / totp.wall_seconds : 0.0;
+    results.push_back(totp);
+
+    results.push_back(runBenchmark("getWalletBalance", config.iterations, [&](int i) {
+        getWalletBalance(db, customerId(i % config.customers));
+    }));
+
+    // One-transaction credit of every wallet from a file.
+    std::string credit_path = config.db_path + ".credits.csv";
+    {
+        std::ofstream credits(credit_path, std::ios::trunc);
+        credits << "user_id,amount,note\n";
+        for (int i = 0; i < config.customers; i++) credits << customerId(i) << ",25,bench grant\n";
+    }
+    std::string credit_error;
+    BenchResult bulk = runBenchmark("bulkCreditWallets", 1, [&](int) {
+        bulkCreditWallets(db, credit_path, "bench", credit_error);
+    });
+    bulk.extra["wallets"] = config.customers;
+    bulk.extra["credits_per_sec"] = bulk.wall_seconds > 0 ? config.customers / bulk.wall_seconds : 0.0;
+    results.push_back(bulk);
+    std::remove(credit_path.c_str());
+
+    // A year of per-batch lots (one per customer per day), ten days of which
+    // have expired: each sweep call must touch only those.
+    execSql(db, "BEGIN;");
+    execSql(db, "WITH RECURSIVE day(d) AS (SELECT 0 UNION ALL SELECT d + 1 FROM day WHERE d < 364) "
+                "INSERT INTO loyalty_lots (user_id, points, remaining, earned_at, expires_at) "
+                "SELECT w.user_id, 1, 1, strftime('%s', 'now') - 86400 * (d + 180), strftime('%s', 'now') - 86400 * (d - 355) "
+                "FROM wallets w, day;");
+    execSql(db, "COMMIT;");
+    long long expired_lots = 0;
+    long long sweep_now = std::time(nullptr);
+    BenchResult expiry = runBenchmark("expireLoyaltyLots", 1, [&](int) {
+        int expired;
+        while ((expired = expireLoyaltyLots(db, sweep_now)) > 0) expired_lots += expired;
+    });
+    expiry.extra["lots_total"] = 365.0 * config.customers;
+    expiry.extra["lots_expired"] = static_cast<double>(expired_lots);
+    expiry.extra["lots_per_sec"] = expiry.wall_seconds > 0 ? expired_lots / expiry.wall_seconds : 0.0;
+    results.push_back(expiry);
+
+    // Lunch rush on the kitchen display: eight terminals posting 100 tickets
+    // each, then what one UI frame pays to drain them and lay out every
+    // station, then clearing them as they are billed.
+    KitchenQueue kitchen;
+    const char* stations[] = {"Grill", "Tandoor", "Fryer", "Drinks"};
+    for (int item = 1; item <= config.items; item++) {
+        KitchenEvent menu_item;
+        menu_item.type = KitchenEvent::MENU_ITEM;
+        menu_item.item_id = item;
+        menu_item.name = "Item " + std::to_string(item);
+        menu_item.station = stations[item % 4];
+        kitchen.post(std::move(menu_item));
+    }
+    const int kitchen_terminals = 8, kitchen_tickets = 100;
+    BenchResult kitchen_post = runBenchmark("kitchenQueue_post", 1, [&](int) {
+        std::vector<std::thread> terminals;
+        for (int t = 0; t < kitchen_terminals; t++) {
+            terminals.emplace_back([&, t] {
+                for (int i = 0; i < kitchen_tickets; i++) {
+                    KitchenEvent ticket;
+                    ticket.ticket.order_id = t * kitchen_tickets + i + 1;
+                    ticket.ticket.created_at = 1700000000 + i;
+                    ticket.ticket.rush = i % 25 == 0;
+                    for (int l = 0; l < 3; l++) {
+                        KitchenLine line;
+                        line.item_id = 1 + (i + l) % config.items;
+                        line.quantity = 1 + l;
+                        ticket.ticket.lines.push_back(line);
+                    }
+                    kitchen.post(std::move(ticket));
+                }
+            });
+        }
+        for (auto& terminal : terminals) terminal.join();
+    });
+    kitchen_post.extra["tickets"] = kitchen_terminals * kitchen_tickets;
+    results.push_back(kitchen_post);
+    BenchResult kitchen_frame = runBenchmark("kitchenQueue_frame", config.view_iterations, [&](int i) {
+        kitchen.drain();
+        if (i > 0) {
+            KitchenEvent rush;   // one change per frame after the first
+            rush.type = KitchenEvent::RUSH;
+            rush.ticket.order_id = i;
+            rush.ticket.rush = true;
+            kitchen.post(std::move(rush));
+            kitchen.drain();
+        }
+        for (const auto& station : kitchen.stationNames()) kitchen.queue(station);
+    });
+    kitchen_frame.extra["pending"] = static_cast<double>(kitchen.pending());
+    results.push_back(kitchen_frame);
+    results.push_back(runBenchmark("kitchenQueue_remove", kitchen_terminals * kitchen_tickets, [&](int i) {
+        KitchenEvent done;
+        done.type = KitchenEvent::REMOVE;
+        done.ticket.order_id = i + 1;
+        kitchen.post(std::move(done));
+        kitchen.drain();
+    }));
+
+    // Oil running out and coming back: each change re-checks only the items
+    // in Oil's column (here the whole menu, the worst case).
+    int oil_id = 0;
+    sqlite3_stmt* oil_stmt;
+    if (sqlite3_prepare_v2(db, "SELECT ingredient_id FROM ingredients WHERE name = 'Oil';", -1, &oil_stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(oil_stmt) == SQLITE_ROW) oil_id = sqlite3_column_int(oil_stmt, 0);
+        sqlite3_finalize(oil_stmt);
+    }
+    long long availability_changes = 0;
+    BenchResult availability = runBenchmark("ingredientAvailability", config.iterations, [&](int i) {
+        availability_changes += recipeBook().setStock(oil_id, i % 2 == 0 ? 0.0 : 1e12).size();
+    });
+    availability.extra["items_per_update"] = static_cast<double>(recipeBook().dependents(oil_id).size());
+    availability.extra["availability_changes"] = static_cast<double>(availability_changes);
+    results.push_back(availability);
+
+    // An event called off: every bill from the generateBill scenario refunded
+    // at once, then checked by the replay below.
+    std::vector<int> refund_ids;
+    sqlite3_stmt* refund_stmt;
+    if (!created_orders.empty() &&
+        sqlite3_prepare_v2(db, "SELECT bill_id FROM bills WHERE order_id >= ? AND refunded = 0;", -1, &refund_stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(refund_stmt, 1, created_orders.front());
+        while (sqlite3_step(refund_stmt) == SQLITE_ROW) refund_ids.push_back(sqlite3_column_int(refund_stmt, 0));
+        sqlite3_finalize(refund_stmt);
+    }
+    std::vector<RefundResult> refunds;
+    BenchResult bulk_refund = runBenchmark("bulkRefundBills", 1, [&](int) { refunds = bulkRefundBills(db, refund_ids, "bench"); });
+    long long refunded_bills = std::count_if(refunds.begin(), refunds.end(), [](const RefundResult& r) { return r.refunded; });
+    bulk_refund.extra["bills"] = static_cast<double>(refunded_bills);
+    bulk_refund.extra["bills_per_sec"] = bulk_refund.wall_seconds > 0 ? refunded_bills / bulk_refund.wall_seconds : 0.0;
+    results.push_back(bulk_refund);
+
+    // Checking the orders projection against the log: from snapshots plus the
+    // events since, and from the whole log.
+    for (bool use_snapshots : {true, false}) {
+        OrderReplayReport replay;
+        BenchResult result = runBenchmark(use_snapshots ? "replayOrders_snapshots" : "replayOrders_full", 1,
+                                          [&](int) { replay = replayOrders(db, false, use_snapshots); });
+        result.extra["orders"] = static_cast<double>(replay.orders);
+        result.extra["events_folded"] = static_cast<double>(replay.events);
+        result.extra["mismatched"] = static_cast<double>(replay.mismatched);
+        results.push_back(result);
+    }
+
+    results.push_back(runBenchmark("viewOrders", config.view_iterations, [&](int) { viewOrders(db); }));
+    results.push_back(runBenchmark("viewBills", config.view_iterations, [&](int) { viewBills(db); }));
+    results.push_back(runBenchmark("getTopItems", config.view_iterations, [&](int) { getTopItems(db); }));
+    results.push_back(runBenchmark("getSalesData", config.view_iterations, [&](int) { getSalesData(db); }));
+    results.push_back(runBenchmark("viewUserDetails", config.view_iterations, [&](int) { viewUserDetails(db); }));
+
+    // Scripted rapid entry: parse a keyed-in line, merge it into a cart and create the order.
+    const char* scripts[] = {"2*3 5 1*7", "18 18 4*2", "1 2 3 4", "3*9", "6 2*6 11"};
+    std::vector<MenuItem> menu = viewMenuItems(db, true);
+    std::unordered_map<int, const MenuItem*> menu_by_code;
+    for (const auto& item : menu) menu_by_code[item.id] = &item;
+    BenchResult rapid = runBenchmark("rapidEntryOrder", config.iterations, [&](int i) {
+        std::vector<RapidEntryLine> lines;
+        std::vector<OrderItem> cart;
+        std::string parse_error;
+        parseRapidEntry(scripts[i % 5], lines, parse_error);
+        for (const auto& line : lines) {
+            auto it = menu_by_code.find(line.item_code);
+            if (it != menu_by_code.end()) {
+                mergeOrderItem(cart, {it->second->id, it->second->name, line.quantity, it->second->price});
+            }
+        }
+        createOrder(db, customerId(customer_dist(rng)), cart);
+    });
+    rapid.extra["orders_per_minute"] = rapid.wall_seconds > 0 ? rapid.latencies_us.size() * 60.0 / rapid.wall_seconds : 0.0;
+    results.push_back(rapid);
+
+    // Burst of wallet top-ups: one autocommit per call versus the group-commit writer queue.
+    BenchResult direct = runBenchmark("topUpWallet_direct", config.iterations, [&](int i) {
+        topUpWallet(db, customerId(i % config.customers), 1.0f);
+    });
+    results.push_back(direct);
+    {
+        WriteQueue writer(config.db_path);
+        if (config.sql_trace) {
+            writer.submit([](sqlite3* wdb) { SqlTrace::instance().install(wdb); });
+        }
+        std::vector<std::future<void>> pending;
+        pending.reserve(config.iterations);
+        std::vector<BenchClock::time_point> submitted(config.iterations);
+        BenchResult queued;
+        queued.name = "topUpWallet_queued";
+        auto wall_start = BenchClock::now();
+        for (int i = 0; i < config.iterations; i++) {
+            submitted[i] = BenchClock::now();
+            std::string customer = customerId(i % config.customers);
+            pending.push_back(writer.submit([customer](sqlite3* wdb) { topUpWallet(wdb, customer, 1.0f); }));
+        }
+        for (int i = 0; i < config.iterations; i++) {
+            pending[i].get();
+            queued.latencies_us.push_back(elapsedMicros(submitted[i]));
+        }
+        queued.wall_seconds = elapsedMicros(wall_start) / 1e6;
+        double direct_rate = direct.wall_seconds > 0 ? direct.latencies_us.size() / direct.wall_seconds : 0.0;
+        double queued_rate = queued.wall_seconds > 0 ? queued.latencies_us.size() / queued.wall_seconds : 0.0;
+        queued.extra["speedup_vs_direct"] = direct_rate > 0 ? queued_rate / direct_rate : 0.0;
+        results.push_back(queued);
+    }
+
+    // Full audit-chain verification, once per SHA-256 engine the CPU supports.
+    for (Sha256Engine engine : {Sha256Engine::Scalar, Sha256Engine::Avx2, Sha256Engine::ShaNi}) {
+        if (!setSha256Engine(engine)) continue;
+        HashChainReport bills_report, log_report;
+        BenchResult verify = runBenchmark(std::string("verifyHashChains_") + sha256EngineName(engine), 1, [&](int) {
+            bills_report = verifyHashChain(db, kBillsChain);
+            log_report = verifyHashChain(db, kActivityLogChain);
+        });
+        long long rows = bills_report.rows + log_report.rows;
+        verify.extra["rows"] = static_cast<double>(rows);
+        verify.extra["rows_per_sec"] = verify.wall_seconds > 0 ? rows / verify.wall_seconds : 0.0;
+        verify.extra["intact"] = bills_report.ok() && log_report.ok() ? 1.0 : 0.0;
+        results.push_back(verify);
+    }
+    setSha256Engine(sha256_detail::detectEngine());
+
+    sqlite3_close(db);
+    std::cerr.rdbuf(saved_cerr);
+    SqlTrace::instance().dump(std::cerr);
+    printJson(config, results);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BILL_SNAPSHOT_H
+#define BILL_SNAPSHOT_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A finished bill as it was printed, stored once in bills.snapshot and never
+// changed, so reprints and exports show the names and prices of the sale
+// even after the menu changes, and need no joins.
+//
+// Encoding: 'B', version, then unsigned LEB128 varints; signed values and
+// amounts (in paise) are zigzag-encoded, strings are a length and the bytes.
+struct BillSnapshotLine {
+    int item_id = 0;
+    std::string name;
+    int quantity = 0;
+    double price = 0.0;
+};
+
+struct BillSnapshot {
+    long long bill_id = 0;
+    long long order_id = 0;
+    long long created_at = 0;
+    std::string customer;          // empty for guests
+    std::string biller;
+    std::string payment_method;
+    std::vector<BillSnapshotLine> lines;
+    double subtotal = 0.0;         // lines at their order prices
+    int discount_id = 0;
+    double discount = 0.0;         // subtotal taken off by the discount
+    int loyalty_points = 0;        // redeemed
+    double loyalty_discount = 0.0;
+    double tax = 0.0;
+    double total = 0.0;
+};
+
+const unsigned char kBillSnapshotVersion = 1;
+
+namespace bill_snapshot_detail {
+
+inline void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+inline void putSigned(std::string& out, long long value) {
+    putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+inline void putAmount(std::string& out, double amount) { putSigned(out, std::llround(amount * 100)); }
+
+inline void putString(std::string& out, const std::string& text) {
+    putVarint(out, text.size());
+    out += text;
+}
+
+// Bounds-checked reads; any short read leaves ok false.
+struct Reader {
+    const unsigned char* at;
+    const unsigned char* end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && ok; shift += 7) {
+            if (at == end) break;
+            unsigned char byte = *at++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+    long long signedValue() {
+        uint64_t value = varint();
+        return static_cast<long long>((value >> 1) ^ (~(value & 1) + 1));
+    }
+    double amount() { return signedValue() / 100.0; }
+    std::string string() {
+        uint64_t size = varint();
+        if (!ok || size > static_cast<uint64_t>(end - at)) {
+            ok = false;
+            return std::string();
+        }
+        std::string text(reinterpret_cast<const char*>(at), size);
+        at += size;
+        return text;
+    }
+};
+
+}  // namespace bill_snapshot_detail
+
+// bill_id is the row's own key and is not stored.
+std::string encodeBillSnapshot(const BillSnapshot& bill) {
+    using namespace bill_snapshot_detail;
+    std::string out;
+    out.reserve(64 + bill.lines.size() * 24);
+    out += 'B';
+    out += static_cast<char>(kBillSnapshotVersion);
+    putSigned(out, bill.order_id);
+    putSigned(out, bill.created_at);
+    putString(out, bill.customer);
+    putString(out, bill.biller);
+    putString(out, bill.payment_method);
+    putAmount(out, bill.subtotal);
+    putSigned(out, bill.discount_id);
+    putAmount(out, bill.discount);
+    putSigned(out, bill.loyalty_points);
+    putAmount(out, bill.loyalty_discount);
+    putAmount(out, bill.tax);
+    putAmount(out, bill.total);
+    putVarint(out, bill.lines.size());
+    for (const auto& line : bill.lines) {
+        putSigned(out, line.item_id);
+        putSigned(out, line.quantity);
+        putAmount(out, line.price);
+        putString(out, line.name);
+    }
+    return out;
+}
+
+// False for anything that is not a complete snapshot of a known version.
+bool decodeBillSnapshot(const void* data, size_t size, BillSnapshot& bill) {
+    using namespace bill_snapshot_detail;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    if (!bytes || size < 2 || bytes[0] != 'B' || bytes[1] != kBillSnapshotVersion) {
+        return false;
+    }
+    Reader in{bytes + 2, bytes + size};
+    bill.order_id = in.signedValue();
+    bill.created_at = in.signedValue();
+    bill.customer = in.string();
+    bill.biller = in.string();
+    bill.payment_method = in.string();
+    bill.subtotal = in.amount();
+    bill.discount_id = static_cast<int>(in.signedValue());
+    bill.discount = in.amount();
+    bill.loyalty_points = static_cast<int>(in.signedValue());
+    bill.loyalty_discount = in.amount();
+    bill.tax = in.amount();
+    bill.total = in.amount();
+    uint64_t count = in.varint();
+    // Each line takes at least four bytes, which bounds a corrupt count.
+    if (!in.ok || count > static_cast<uint64_t>(in.end - in.at) / 4) {
+        return false;
+    }
+    bill.lines.resize(count);
+    for (auto& line : bill.lines) {
+        line.item_id = static_cast<int>(in.signedValue());
+        line.quantity = static_cast<int>(in.signedValue());
+        line.price = in.amount();
+        line.name = in.string();
+    }
+    return in.ok && in.at == in.end;
+}
+
+#endif
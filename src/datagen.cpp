@@ -0,0 +1,110 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// canteen_datagen: writes a synthetic canteen database for load testing.
+//
+//   canteen_datagen --out PATH|:memory: [--seed N] [--scale X] [--orders N]
+//                   [--customers N] [--items N] [--days N] [--force]
+//
+// The same seed and options always produce the same rows. :memory: only
+// measures generation speed; the database is discarded on exit.
+
+#define CANTEEN_HEADLESS
+#include "main.cpp"
+#include "datagen.h"
+
+#include <cstdio>
+
+int main(int argc, char** argv) {
+    std::string out_path;
+    double scale = 1.0;
+    uint64_t seed = 42;
+    int orders = -1, customers = -1, items = -1, days = -1;
+    bool force = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--out" && has_value) {
+            out_path = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--scale" && has_value) {
+            scale = std::stod(argv[++i]);
+        } else if (arg == "--orders" && has_value) {
+            orders = std::stoi(argv[++i]);
+        } else if (arg == "--customers" && has_value) {
+            customers = std::stoi(argv[++i]);
+        } else if (arg == "--items" && has_value) {
+            items = std::stoi(argv[++i]);
+        } else if (arg == "--days" && has_value) {
+            days = std::stoi(argv[++i]);
+        } else if (arg == "--force") {
+            force = true;
+        } else {
+            out_path.clear();
+            break;
+        }
+    }
+    if (out_path.empty()) {
+        std::cerr << "Usage: canteen_datagen --out PATH|:memory: [--seed N] [--scale X] [--orders N] "
+                     "[--customers N] [--items N] [--days N] [--force]" << std::endl;
+        return 1;
+    }
+
+    DatasetOptions options = DatasetOptions::forScale(scale);
+    options.seed = seed;
+    if (orders >= 0) options.orders = orders;
+    if (customers > 0) options.customers = customers;
+    if (items > 0) options.items = items;
+    if (days > 0) options.days = days;
+
+    if (out_path != ":memory:" && std::filesystem::exists(out_path)) {
+        if (!force) {
+            std::cerr << "Refusing to overwrite " << out_path << " (use --force)" << std::endl;
+            return 1;
+        }
+        for (const char* suffix : {"", "-wal", "-shm", "-journal"}) {
+            std::remove((out_path + suffix).c_str());
+        }
+    }
+
+    sqlite3* db;
+    if (sqlite3_open(out_path.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+        return 1;
+    }
+    initDatabase(db);
+    DatasetStats stats;
+    bool ok = generateDataset(db, options, stats);
+    if (ok) {
+        backfillLoyaltyLots(db);
+        backfillOrderEvents(db);
+        sealHashChain(db, kBillsChain);
+        sealHashChain(db, kActivityLogChain);
+    }
+    sqlite3_close(db);
+
+    std::printf("{\"out\": \"%s\", \"seed\": %llu, \"menu_items\": %lld, \"orders\": %lld, \"order_items\": %lld, "
+                "\"bills\": %lld, \"loyalty_transactions\": %lld, \"activity_log\": %lld, \"seconds\": %.2f}\n",
+                out_path.c_str(), static_cast<unsigned long long>(seed),
+                static_cast<long long>(stats.menu_items), static_cast<long long>(stats.orders),
+                static_cast<long long>(stats.order_items), static_cast<long long>(stats.bills),
+                static_cast<long long>(stats.loyalty_transactions), static_cast<long long>(stats.activity_log),
+                stats.seconds);
+    return ok ? 0 : 1;
+}
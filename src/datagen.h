@@ -0,0 +1,473 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include "sha256.h"
+
+// Synthetic dataset generator. Output depends only on the options (seed,
+// counts and end date), never on the platform's <random> implementation or the
+// current time, so a seed reproduces the same database everywhere.
+struct DatasetOptions {
+    uint64_t seed = 42;
+    int items = 40;
+    int customers = 2000;
+    int staff = 20;
+    int days = 365;
+    int orders = 100000;
+    int64_t end_time = 1748736000;    // 2025-06-01 00:00:00 UTC
+    int utc_offset_minutes = 330;     // canteen local time (IST)
+    float guest_share = 0.25f;
+    float cancel_rate = 0.045f;       // of all orders
+    float refund_rate = 0.015f;       // of all orders: billed, then canceled and refunded
+    float redeem_rate = 0.05f;        // of registered bills, when enough points
+    int inventory_quantity = 500;
+    int rows_per_transaction = 500000;
+
+    // Scale 1 is roughly a year of a busy canteen: 100k orders, ~800k rows.
+    static DatasetOptions forScale(double scale) {
+        DatasetOptions options;
+        scale = std::max(scale, 0.001);
+        options.orders = static_cast<int>(100000 * scale);
+        options.customers = std::max(10, static_cast<int>(2000 * std::sqrt(scale)));
+        options.staff = std::max(3, static_cast<int>(20 * std::sqrt(scale)));
+        return options;
+    }
+};
+
+struct DatasetStats {
+    int64_t menu_items = 0;
+    int64_t orders = 0;
+    int64_t order_items = 0;
+    int64_t bills = 0;
+    int64_t loyalty_transactions = 0;
+    int64_t activity_log = 0;
+    double seconds = 0.0;
+};
+
+// xoshiro256** seeded through splitmix64.
+class DatasetRng {
+public:
+    explicit DatasetRng(uint64_t seed) {
+        for (auto& word : s) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    int range(int lo, int hi) { return lo + static_cast<int>(uniform() * (hi - lo + 1)); }
+    bool chance(double p) { return uniform() < p; }
+
+    double normal(double mean, double stddev) {
+        double u1 = std::max(uniform(), 1e-12);
+        double u2 = uniform();
+        return mean + stddev * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+
+private:
+    uint64_t s[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// Zipfian ranks 0..n-1 sampled by binary search over a precomputed CDF.
+class ZipfTable {
+public:
+    ZipfTable(int n, double exponent) : cdf(std::max(n, 1)) {
+        double sum = 0.0;
+        for (size_t k = 0; k < cdf.size(); k++) {
+            sum += 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+            cdf[k] = sum;
+        }
+        for (auto& c : cdf) c /= sum;
+    }
+
+    int sample(DatasetRng& rng) const {
+        double u = rng.uniform();
+        return static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+std::string datasetCustomerId(int index) {
+    return std::to_string(9000000000LL + index);
+}
+
+float datasetItemPrice(int item_id) {
+    static const float prices[] = {150, 80, 60, 50, 90, 100, 140, 40, 70, 120, 200, 50, 110, 65, 85, 130, 160, 20, 30, 60};
+    return prices[(item_id - 1) % 20] + 5.0f * ((item_id - 1) / 20);
+}
+
+// Seconds after local midnight for one arrival: breakfast, a dominant lunch
+// peak and an evening snack bump, clamped to opening hours (08:00-21:00).
+int datasetArrivalSecond(DatasetRng& rng) {
+    double pick = rng.uniform();
+    double minutes = pick < 0.18 ? rng.normal(9 * 60 + 15, 35)
+                   : pick < 0.78 ? rng.normal(13 * 60 + 10, 45)
+                   : rng.normal(17 * 60 + 40, 55);
+    minutes = std::min(std::max(minutes, 8.0 * 60), 21.0 * 60 - 1);
+    return static_cast<int>(minutes * 60) + rng.range(0, 59);
+}
+
+class DatasetWriter {
+public:
+    DatasetWriter(sqlite3* db, int rows_per_transaction) : db(db), rows_per_transaction(rows_per_transaction) {}
+
+    ~DatasetWriter() {
+        for (sqlite3_stmt* stmt : statements) sqlite3_finalize(stmt);
+    }
+
+    sqlite3_stmt* prepare(const char* sql) {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (datagen): " << sqlite3_errmsg(db) << std::endl;
+            return nullptr;
+        }
+        statements.push_back(stmt);
+        return stmt;
+    }
+
+    bool step(sqlite3_stmt* stmt) {
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        if (!ok) {
+            std::cerr << "SQL insert error (datagen): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        if (++rows_in_transaction >= rows_per_transaction) {
+            exec("COMMIT; BEGIN;");
+            rows_in_transaction = 0;
+        }
+        return ok;
+    }
+
+    bool exec(const char* sql) {
+        char* errMsg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::cerr << "SQL error (datagen): " << (errMsg ? errMsg : "unknown") << std::endl;
+            sqlite3_free(errMsg);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    sqlite3* db;
+    int rows_per_transaction;
+    int rows_in_transaction = 0;
+    std::vector<sqlite3_stmt*> statements;
+};
+
+void bindOptionalText(sqlite3_stmt* stmt, int index, const std::string& value) {
+    if (value.empty()) {
+        sqlite3_bind_null(stmt, index);
+    } else {
+        sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_TRANSIENT);
+    }
+}
+
+// Appends a generated dataset to a database whose schema already exists
+// (see initDatabase). Rows are bulk-loaded with prepared statements in large
+// transactions.
+bool generateDataset(sqlite3* db, const DatasetOptions& options, DatasetStats& stats) {
+    static const char* base_names[] = {
+        "Paneer Tikka", "Veggie Burger", "Masala Dosa", "Aloo Paratha", "Chole Bhature",
+        "Veg Pulao", "Palak Paneer", "Idli Sambhar", "Pav Bhaji", "Veg Manchurian",
+        "Cheese Pizza", "Veg Sandwich", "Dal Makhani", "Uttapam", "Rajma Chawal",
+        "Veg Hakka Noodles", "Malai Kofta", "Samosa", "Dhokla", "Veg Spring Roll",
+        "Masala Chai", "Filter Coffee", "Lassi", "Cold Coffee", "Vada Pav",
+        "Poha", "Upma", "Medu Vada", "Paneer Roll", "Veg Biryani",
+        "Kadhi Chawal", "Thali", "Gulab Jamun", "Jalebi", "Fresh Lime Soda",
+        "French Fries", "Pasta Arrabiata", "Maggi", "Bread Omelette", "Fruit Bowl"};
+    const int base_name_count = sizeof(base_names) / sizeof(base_names[0]);
+
+    auto started = std::chrono::steady_clock::now();
+    DatasetRng rng(options.seed);
+    DatasetWriter writer(db, std::max(options.rows_per_transaction, 1000));
+    writer.exec("PRAGMA synchronous=OFF;");
+    writer.exec("PRAGMA journal_mode=MEMORY;");
+    writer.exec("PRAGMA cache_size=-262144;");
+    if (!writer.exec("BEGIN;")) {
+        return false;
+    }
+
+    auto maxId = [&](const char* sql) {
+        sqlite3_stmt* stmt;
+        sqlite3_int64 value = 0;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        return value;
+    };
+    sqlite3_int64 next_item_id = maxId("SELECT COALESCE(MAX(item_id), 0) FROM menu_items;") + 1;
+    sqlite3_int64 next_order_id = maxId("SELECT COALESCE(MAX(order_id), 0) FROM orders;") + 1;
+    sqlite3_int64 next_bill_id = maxId("SELECT COALESCE(MAX(bill_id), 0) FROM bills;") + 1;
+
+    sqlite3_stmt* menu_stmt = writer.prepare("INSERT INTO menu_items (item_id, name, price, available) VALUES (?, ?, ?, 1);");
+    sqlite3_stmt* inv_stmt = writer.prepare("INSERT OR REPLACE INTO inventory (item_id, quantity, low_stock_threshold) VALUES (?, ?, ?);");
+    sqlite3_stmt* user_stmt = writer.prepare("INSERT OR IGNORE INTO users (username, password, role, totp_secret) VALUES (?, ?, ?, '');");
+    sqlite3_stmt* wallet_stmt = writer.prepare("INSERT OR REPLACE INTO wallets (user_id, balance) VALUES (?, ?);");
+    sqlite3_stmt* points_stmt = writer.prepare("INSERT OR REPLACE INTO loyalty_points (user_id, points) VALUES (?, ?);");
+    sqlite3_stmt* order_stmt = writer.prepare("INSERT INTO orders (order_id, user_id, status, total, created_at) VALUES (?, ?, ?, ?, ?);");
+    sqlite3_stmt* item_stmt = writer.prepare("INSERT INTO order_items (order_id, item_id, quantity, price) VALUES (?, ?, ?, ?);");
+    sqlite3_stmt* bill_stmt = writer.prepare("INSERT INTO bills (bill_id, order_id, tax, total, payment_method, created_at, refunded) VALUES (?, ?, ?, ?, ?, ?, ?);");
+    sqlite3_stmt* loyalty_stmt = writer.prepare("INSERT INTO loyalty_transactions (user_id, points, type, timestamp) VALUES (?, ?, ?, ?);");
+    sqlite3_stmt* log_stmt = writer.prepare("INSERT INTO activity_log (user_id, action, timestamp) VALUES (?, ?, ?);");
+    if (!menu_stmt || !inv_stmt || !user_stmt || !wallet_stmt || !points_stmt || !order_stmt ||
+        !item_stmt || !bill_stmt || !loyalty_stmt || !log_stmt) {
+        writer.exec("ROLLBACK;");
+        return false;
+    }
+
+    auto logRow = [&](const std::string& user_id, const std::string& action, int64_t timestamp) {
+        bindOptionalText(log_stmt, 1, user_id);
+        sqlite3_bind_text(log_stmt, 2, action.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(log_stmt, 3, timestamp);
+        writer.step(log_stmt);
+        stats.activity_log++;
+    };
+
+    // Menu and stock
+    std::vector<int> item_ids;
+    for (int i = 0; i < options.items; i++) {
+        int item_id = static_cast<int>(next_item_id + i);
+        std::string name = i < base_name_count ? base_names[i] : "Chef Special " + std::to_string(i - base_name_count + 1);
+        sqlite3_bind_int(menu_stmt, 1, item_id);
+        sqlite3_bind_text(menu_stmt, 2, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(menu_stmt, 3, datasetItemPrice(i + 1));
+        writer.step(menu_stmt);
+        sqlite3_bind_int(inv_stmt, 1, item_id);
+        sqlite3_bind_int(inv_stmt, 2, options.inventory_quantity);
+        sqlite3_bind_int(inv_stmt, 3, std::max(5, options.inventory_quantity / 10));
+        writer.step(inv_stmt);
+        item_ids.push_back(item_id);
+        stats.menu_items++;
+    }
+    // Popularity rank -> item: a seeded shuffle so the favourites differ per seed.
+    std::vector<int> popularity = item_ids;
+    for (size_t i = popularity.size(); i > 1; i--) {
+        std::swap(popularity[i - 1], popularity[rng.next() % i]);
+    }
+
+    // Staff and customers
+    std::vector<std::string> staff;
+    std::string staff_password = sha256("password");
+    for (int i = 0; i < options.staff; i++) {
+        std::string username = (i == 0 ? "admin" : i <= options.staff / 5 ? "manager" : "biller") + std::to_string(i + 1);
+        std::string role = i == 0 ? "admin" : i <= options.staff / 5 ? "manager" : "biller";
+        sqlite3_bind_text(user_stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(user_stmt, 2, staff_password.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(user_stmt, 3, role.c_str(), -1, SQLITE_TRANSIENT);
+        writer.step(user_stmt);
+        if (role == "biller") staff.push_back(username);
+    }
+    if (staff.empty()) staff.push_back("admin1");
+
+    std::vector<double> wallet_balance(options.customers);
+    std::vector<int> loyalty_balance(options.customers, 0);
+    for (int i = 0; i < options.customers; i++) {
+        wallet_balance[i] = 200.0 * rng.range(1, 25);
+    }
+
+    // Orders: walk the calendar so rows are inserted in time order.
+    ZipfTable item_zipf(options.items, 1.1);
+    ZipfTable customer_zipf(options.customers, 0.9);
+    const int64_t offset = options.utc_offset_minutes * 60;
+    const int64_t first_midnight = options.end_time - static_cast<int64_t>(options.days) * 86400;
+    const double mean_per_day = static_cast<double>(options.orders) / std::max(options.days, 1);
+    int64_t remaining = options.orders;
+    std::vector<int> arrivals;
+    std::vector<std::pair<int, int>> lines;
+
+    for (int day = 0; day < options.days && remaining > 0; day++) {
+        int64_t midnight = first_midnight + static_cast<int64_t>(day) * 86400 - offset;
+        int weekday = static_cast<int>(((first_midnight / 86400) + day + 4) % 7);   // 0 = Sunday
+        double factor = (weekday == 0 || weekday == 6) ? 0.6 : 1.1;
+        int count = day == options.days - 1 ? static_cast<int>(remaining)
+                  : static_cast<int>(std::max(0.0, std::round(rng.normal(mean_per_day * factor, std::sqrt(mean_per_day)))));
+        count = static_cast<int>(std::min<int64_t>(count, remaining));
+        remaining -= count;
+
+        arrivals.clear();
+        for (int i = 0; i < count; i++) arrivals.push_back(datasetArrivalSecond(rng));
+        std::sort(arrivals.begin(), arrivals.end());
+
+        const std::string& opener = staff[day % staff.size()];
+        logRow(opener, "User logged in", midnight + 8 * 3600 - 300);
+
+        for (int arrival : arrivals) {
+            int64_t created_at = midnight + arrival;
+            int customer = rng.chance(options.guest_share) ? -1 : customer_zipf.sample(rng);
+            std::string user_id = customer < 0 ? "" : datasetCustomerId(customer);
+            const std::string& biller = staff[rng.next() % staff.size()];
+
+            lines.clear();
+            int line_count = 1;
+            while (line_count < 6 && rng.chance(0.45)) line_count++;
+            float subtotal = 0.0f;
+            for (int l = 0; l < line_count; l++) {
+                int item_id = popularity[item_zipf.sample(rng)];
+                int quantity = rng.chance(0.75) ? 1 : rng.chance(0.8) ? 2 : 3;
+                bool merged = false;
+                for (auto& line : lines) {
+                    if (line.first == item_id) {
+                        line.second += quantity;
+                        merged = true;
+                    }
+                }
+                if (!merged) lines.push_back({item_id, quantity});
+                subtotal += quantity * datasetItemPrice(static_cast<int>(item_id - next_item_id + 1));
+            }
+
+            double fate = rng.uniform();
+            // Only the last trading hour of the final day is still open.
+            bool recent = day == options.days - 1 && arrival >= 20 * 3600;
+            std::string status = recent && fate < 0.5 ? "pending"
+                               : fate < options.cancel_rate - options.refund_rate ? "canceled"
+                               : fate < options.cancel_rate ? "refunded"
+                               : "completed";
+            sqlite3_int64 order_id = next_order_id++;
+            sqlite3_bind_int64(order_stmt, 1, order_id);
+            bindOptionalText(order_stmt, 2, user_id);
+            sqlite3_bind_text(order_stmt, 3, status == "refunded" ? "canceled" : status.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_double(order_stmt, 4, subtotal);
+            sqlite3_bind_int64(order_stmt, 5, created_at);
+            writer.step(order_stmt);
+            stats.orders++;
+            for (const auto& line : lines) {
+                sqlite3_bind_int64(item_stmt, 1, order_id);
+                sqlite3_bind_int(item_stmt, 2, line.first);
+                sqlite3_bind_int(item_stmt, 3, line.second);
+                sqlite3_bind_double(item_stmt, 4, datasetItemPrice(static_cast<int>(line.first - next_item_id + 1)));
+                writer.step(item_stmt);
+                stats.order_items++;
+            }
+            logRow(user_id, "Order created: order_id " + std::to_string(order_id), created_at);
+
+            if (status == "canceled") {
+                logRow("", "Order canceled: order_id " + std::to_string(order_id), created_at + rng.range(60, 900));
+                continue;
+            }
+            if (status == "pending") {
+                continue;
+            }
+
+            // Billed: completed, or billed and later canceled with a refund.
+            int64_t billed_at = created_at + rng.range(60, 600);
+            float total = subtotal;
+            if (customer >= 0 && loyalty_balance[customer] >= 50 && rng.chance(options.redeem_rate)) {
+                int redeem = std::min(loyalty_balance[customer], 10 * rng.range(1, 5));
+                loyalty_balance[customer] -= redeem;
+                total = std::max(0.0f, total - redeem / 10.0f);
+                sqlite3_bind_text(loyalty_stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int(loyalty_stmt, 2, -redeem);
+                sqlite3_bind_text(loyalty_stmt, 3, "redeemed", -1, SQLITE_STATIC);
+                sqlite3_bind_int64(loyalty_stmt, 4, billed_at);
+                writer.step(loyalty_stmt);
+                stats.loyalty_transactions++;
+            }
+            float tax = total * 0.08f;
+            total += tax;
+            const char* method = "Cash";
+            double method_pick = rng.uniform();
+            if (customer >= 0 && method_pick < 0.45 && wallet_balance[customer] >= total) {
+                method = "Wallet";
+                wallet_balance[customer] -= total;
+            } else if (method_pick > 0.65) {
+                method = "Card";
+            }
+            bool refunded = status == "refunded";
+            sqlite3_int64 bill_id = next_bill_id++;
+            sqlite3_bind_int64(bill_stmt, 1, bill_id);
+            sqlite3_bind_int64(bill_stmt, 2, order_id);
+            sqlite3_bind_double(bill_stmt, 3, tax);
+            sqlite3_bind_double(bill_stmt, 4, total);
+            sqlite3_bind_text(bill_stmt, 5, method, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(bill_stmt, 6, billed_at);
+            sqlite3_bind_int(bill_stmt, 7, refunded ? 1 : 0);
+            writer.step(bill_stmt);
+            stats.bills++;
+            logRow(biller, "Bill generated: order_id " + std::to_string(order_id), billed_at);
+
+            if (customer >= 0) {
+                int earned = static_cast<int>(total / 10.0f);
+                if (earned > 0) {
+                    loyalty_balance[customer] += earned;
+                    sqlite3_bind_text(loyalty_stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
+                    sqlite3_bind_int(loyalty_stmt, 2, earned);
+                    sqlite3_bind_text(loyalty_stmt, 3, "earned", -1, SQLITE_STATIC);
+                    sqlite3_bind_int64(loyalty_stmt, 4, billed_at);
+                    writer.step(loyalty_stmt);
+                    stats.loyalty_transactions++;
+                }
+            }
+            if (refunded) {
+                int64_t refunded_at = billed_at + rng.range(600, 7200);
+                if (std::string(method) == "Wallet") wallet_balance[customer] += total;
+                logRow("", "Order canceled: order_id " + std::to_string(order_id), refunded_at - 60);
+                logRow("admin1", "Refund processed for bill_id: " + std::to_string(bill_id), refunded_at);
+            }
+        }
+        logRow(opener, "User logged out", midnight + 21 * 3600 + 600);
+    }
+
+    for (int i = 0; i < options.customers; i++) {
+        std::string id = datasetCustomerId(i);
+        sqlite3_bind_text(wallet_stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(wallet_stmt, 2, wallet_balance[i]);
+        writer.step(wallet_stmt);
+        if (loyalty_balance[i] > 0) {
+            sqlite3_bind_text(points_stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(points_stmt, 2, loyalty_balance[i]);
+            writer.step(points_stmt);
+        }
+    }
+
+    bool committed = writer.exec("COMMIT;");
+    writer.exec("PRAGMA synchronous=FULL;");
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return committed;
+}
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ESCPOS_H
+#define ESCPOS_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Builds an ESC/POS byte stream for a thermal receipt printer in one string,
+// without temporary files. Text is printable ASCII; anything else prints as
+// '?', one per UTF-8 character, so columns stay aligned.
+class EscPosWriter {
+public:
+    enum Align { LEFT = 0, CENTER = 1, RIGHT = 2 };
+
+    // 48 columns is Font A on 80 mm paper.
+    explicit EscPosWriter(int columns = 48) : width(columns) {
+        out.reserve(1024);
+        out += "\x1b@";                                       // ESC @: reset
+    }
+
+    EscPosWriter& align(Align a) { return command('\x1b', 'a', static_cast<char>(a)); }
+    EscPosWriter& bold(bool on) { return command('\x1b', 'E', on ? 1 : 0); }
+    // GS !: double width and height.
+    EscPosWriter& large(bool on) { return command('\x1d', '!', on ? 0x11 : 0x00); }
+    EscPosWriter& feed(int lines) { return command('\x1b', 'd', static_cast<char>(lines)); }
+
+    EscPosWriter& line(const std::string& text = "") {
+        appendText(text, width);
+        out += '\n';
+        return *this;
+    }
+
+    EscPosWriter& rule(char c = '-') {
+        out.append(width, c);
+        out += '\n';
+        return *this;
+    }
+
+    // `left` cut short if needed so `right` ends at the last column.
+    EscPosWriter& columns(const std::string& left, const std::string& right) {
+        int room = width - static_cast<int>(right.size()) - 1;
+        int used = appendText(left, room > 0 ? room : 0);
+        int pad = width - used - static_cast<int>(right.size());
+        out.append(pad > 0 ? pad : 1, ' ');
+        appendText(right, width);
+        out += '\n';
+        return *this;
+    }
+
+    // GS V A: feed to the cutter and cut.
+    EscPosWriter& cut() { return command('\x1d', 'V', 'A', 3); }
+
+    const std::string& bytes() const { return out; }
+    int columnCount() const { return width; }
+
+    // "1234.50"; exact to the paisa, no locale.
+    static std::string amount(double value) {
+        long long paise = std::llround(value * 100);
+        std::string text = paise < 0 ? "-" : "";
+        paise = paise < 0 ? -paise : paise;
+        text += std::to_string(paise / 100);
+        text += '.';
+        text += static_cast<char>('0' + paise % 100 / 10);
+        text += static_cast<char>('0' + paise % 10);
+        return text;
+    }
+
+private:
+    template <typename... Bytes>
+    EscPosWriter& command(Bytes... bytes) {
+        for (char b : {static_cast<char>(bytes)...}) out += b;
+        return *this;
+    }
+
+    // Appends at most `limit` printed characters; returns how many.
+    int appendText(const std::string& text, int limit) {
+        int printed = 0;
+        for (size_t i = 0; i < text.size() && printed < limit; i++) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if ((c & 0xc0) == 0x80) continue;                 // UTF-8 continuation byte
+            out += c >= 0x20 && c < 0x7f ? static_cast<char>(c) : '?';
+            printed++;
+        }
+        return printed;
+    }
+
+    int width;
+    std::string out;
+};
+
+// Sends receipts to a printer device (e.g. /dev/usb/lp0) or appends them to
+// a spool file, on its own thread so billing never waits on the printer. A
+// failed write is retried with backoff, then the receipt is dropped with an
+// error on std::cerr.
+class PrinterQueue {
+public:
+    explicit PrinterQueue(const std::string& path, int attempts = 5,
+                          std::chrono::milliseconds first_retry = std::chrono::milliseconds(200))
+        : path(path), attempts(attempts), first_retry(first_retry), worker(&PrinterQueue::run, this) {}
+
+    // Prints what is queued, one try each once stopping, then returns.
+    ~PrinterQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        worker.join();
+    }
+
+    PrinterQueue(const PrinterQueue&) = delete;
+    PrinterQueue& operator=(const PrinterQueue&) = delete;
+
+    void submit(std::string bytes, std::string label) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({std::move(bytes), std::move(label)});
+        }
+        ready.notify_one();
+    }
+
+    size_t depth() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs.size();
+    }
+
+    const std::string& target() const { return path; }
+
+private:
+    struct Job {
+        std::string bytes;
+        std::string label;
+    };
+
+    // Fails only if nothing reached the printer: after a short write the
+    // paper already has part of the receipt, and a retry would repeat it.
+    bool write(const Job& job, std::string& error) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        size_t done = 0;
+        while (done < job.bytes.size()) {
+            ssize_t n = ::write(fd, job.bytes.data() + done, job.bytes.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += static_cast<size_t>(n);
+        }
+        if (done < job.bytes.size()) {
+            error = std::strerror(errno);
+            if (done > 0) {
+                std::cerr << "Receipt " << job.label << " cut short on " << path << ": " << error << std::endl;
+            }
+        }
+        ::close(fd);
+        return done > 0;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            auto delay = first_retry;
+            std::string error;
+            bool printed = false;
+            for (int attempt = 1; !printed; attempt++) {
+                lock.unlock();
+                printed = write(job, error);
+                lock.lock();
+                if (printed || attempt >= attempts || stopping) break;
+                // Woken early only to stop.
+                ready.wait_for(lock, delay, [this] { return stopping; });
+                delay *= 2;
+            }
+            if (!printed) {
+                std::cerr << "Receipt " << job.label << " not printed to " << path << ": " << error << std::endl;
+            }
+        }
+    }
+
+    std::string path;
+    int attempts;
+    std::chrono::milliseconds first_retry;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping = false;
+    std::thread worker;            // last: starts once the members above exist
+};
+
+#endif
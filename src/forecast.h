@@ -0,0 +1,292 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef FORECAST_H
+#define FORECAST_H
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Per-item hourly demand, forecast with additive seasonal exponential
+// smoothing (Holt-Winters without trend) over a weekly season of 168
+// day-of-week x hour slots:
+//
+//   level    L  = alpha * (y - S[slot]) + (1 - alpha) * L
+//   season   S[slot] = gamma * (y - L) + (1 - gamma) * S[slot]
+//   forecast y(h) = max(0, L + S[slot(h)])
+//
+// train() fits every item from order history in parallel; observe() then
+// folds each new order in, so the models never need recomputing.
+struct ItemForecast {
+    int item_id;
+    double next_day;     // expected units over the next 24 hours
+    double stddev;       // of that figure, from the one-step errors
+    int on_hand;
+    int reorder;         // units to order to cover next_day plus safety stock
+};
+
+class DemandForecaster {
+public:
+    static constexpr int kSeason = 168;
+    static constexpr double kSafetyZ = 1.65;   // ~95% service level
+
+    explicit DemandForecaster(double alpha = 0.1, double gamma = 0.2) : alpha(alpha), gamma(gamma) {
+        // Local time is taken as a fixed offset from UTC: a DST change moves
+        // the weekly pattern by an hour, which the smoothing absorbs.
+        std::time_t now = std::time(nullptr);
+        std::tm utc = *std::gmtime(&now);
+        utc.tm_isdst = -1;
+        utc_offset = static_cast<long long>(std::difftime(now, std::mktime(&utc)));
+    }
+
+    // Rebuilds every model from orders and order_items, the order history's
+    // per-item hourly series (canceled orders left out) split across
+    // `threads`. Orders observed while this runs are replayed on top if the
+    // history read did not include them.
+    bool train(sqlite3* db, unsigned threads = 0) {
+        threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            training = true;
+            backlog.clear();
+        }
+
+        // Reading up to a fixed order_id keeps the history consistent with the
+        // backlog cut-off without holding a read transaction open.
+        long long first = 0, last = 0, last_order = 0;
+        sqlite3_stmt* stmt;
+        const char* range_sql = "SELECT COALESCE(MIN(created_at), 0), COALESCE(MAX(created_at), 0), COALESCE(MAX(order_id), 0) FROM orders;";
+        if (sqlite3_prepare_v2(db, range_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (forecast): " << sqlite3_errmsg(db) << std::endl;
+            finishTraining({}, 0);
+            return false;
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            first = sqlite3_column_int64(stmt, 0);
+            last = sqlite3_column_int64(stmt, 1);
+            last_order = sqlite3_column_int64(stmt, 2);
+        }
+        sqlite3_finalize(stmt);
+        if (last_order == 0) {
+            finishTraining({}, 0);
+            return true;
+        }
+
+        // The series ends at the last order's hour; forecast() rolls the
+        // quiet hours since then forward.
+        long long start_hour = hourOf(first);
+        long long end_hour = hourOf(last);
+        size_t hours = static_cast<size_t>(end_hour - start_hour + 1);
+        std::vector<int> item_ids;
+        std::unordered_map<int, size_t> item_index;
+        std::vector<std::vector<float>> series;
+        const char* sql = "SELECT oi.item_id, o.created_at, oi.quantity FROM order_items oi "
+                          "JOIN orders o ON o.order_id = oi.order_id WHERE o.order_id <= ? AND o.status <> 'canceled';";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, last_order);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                int item_id = sqlite3_column_int(stmt, 0);
+                long long hour = hourOf(sqlite3_column_int64(stmt, 1));
+                if (hour < start_hour || hour > end_hour) continue;
+                auto inserted = item_index.emplace(item_id, series.size());
+                if (inserted.second) {
+                    item_ids.push_back(item_id);
+                    series.emplace_back(hours, 0.0f);
+                }
+                series[inserted.first->second][hour - start_hour] += static_cast<float>(sqlite3_column_int(stmt, 2));
+            }
+            sqlite3_finalize(stmt);
+        } else {
+            std::cerr << "SQL prepare error (forecast): " << sqlite3_errmsg(db) << std::endl;
+        }
+
+        std::vector<uint8_t> slots(hours);
+        for (size_t h = 0; h < hours; h++) {
+            slots[h] = static_cast<uint8_t>(slotOf(start_hour + static_cast<long long>(h)));
+        }
+        std::vector<Model> fitted(series.size());
+        std::vector<std::thread> workers;
+        size_t per_thread = (series.size() + threads - 1) / std::max<size_t>(threads, 1);
+        for (size_t begin = 0; begin < series.size(); begin += per_thread) {
+            size_t end = std::min(series.size(), begin + per_thread);
+            workers.emplace_back([&, begin, end] {
+                for (size_t i = begin; i < end; i++) {
+                    fit(series[i], slots, start_hour, fitted[i]);
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        std::unordered_map<int, Model> trained;
+        for (size_t i = 0; i < item_ids.size(); i++) {
+            trained.emplace(item_ids[i], fitted[i]);
+        }
+        finishTraining(std::move(trained), last_order);
+        return true;
+    }
+
+    // Folds in one order's lines (item_id -> quantity). O(lines), plus any
+    // whole hours an item has gone without sales since it was last touched.
+    void observe(long long order_id, long long created_at, const std::map<int, int>& lines) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (training) {
+            backlog.push_back({order_id, created_at, lines});
+        }
+        apply(created_at, lines);
+    }
+
+    // Next-day demand and reorder quantity for every modelled item, given
+    // the stock on hand per item.
+    std::vector<ItemForecast> forecast(long long now, const std::unordered_map<int, int>& on_hand) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<ItemForecast> result;
+        long long hour = hourOf(now);
+        for (const auto& entry : models) {
+            Model model = entry.second;   // rolled forward on a copy; observe() owns the real one
+            advance(model, hour);
+            double next_day = 0.0;
+            for (long long h = hour + 1; h <= hour + 24; h++) {
+                next_day += std::max(0.0, model.level + model.season[slotOf(h)]);
+            }
+            ItemForecast item;
+            item.item_id = entry.first;
+            item.next_day = next_day;
+            item.stddev = std::sqrt(24.0 * model.variance);
+            auto stock = on_hand.find(entry.first);
+            item.on_hand = stock != on_hand.end() ? stock->second : 0;
+            item.reorder = std::max(0, static_cast<int>(std::ceil(next_day + kSafetyZ * item.stddev)) - item.on_hand);
+            result.push_back(item);
+        }
+        std::sort(result.begin(), result.end(), [](const ItemForecast& a, const ItemForecast& b) {
+            return a.reorder != b.reorder ? a.reorder > b.reorder : a.item_id < b.item_id;
+        });
+        return result;
+    }
+
+    size_t itemCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return models.size();
+    }
+
+private:
+    struct Model {
+        long long hour = 0;        // the open bucket
+        double pending = 0.0;      // units sold so far in it
+        double level = 0.0;
+        double variance = 0.0;     // smoothed squared one-step error
+        std::array<float, kSeason> season{};
+    };
+
+    struct Observed {
+        long long order_id;
+        long long created_at;
+        std::map<int, int> lines;
+    };
+
+    long long hourOf(long long t) const { return (t + utc_offset) / 3600; }
+
+    // Day-of-week x hour of a local hour index; 1970-01-01 was a Thursday.
+    static int slotOf(long long hour) { return static_cast<int>((((hour / 24) + 4) % 7) * 24 + hour % 24); }
+
+    // Closes the open bucket with observation y.
+    void update(Model& model, double y, int slot) const {
+        double error = y - (model.level + model.season[slot]);
+        model.variance = 0.05 * error * error + 0.95 * model.variance;
+        double level = alpha * (y - model.season[slot]) + (1 - alpha) * model.level;
+        model.season[slot] = static_cast<float>(gamma * (y - level) + (1 - gamma) * model.season[slot]);
+        model.level = level;
+    }
+
+    // Closes buckets up to (not including) `hour`; hours without sales are zeros.
+    void advance(Model& model, long long hour) const {
+        if (hour <= model.hour) return;
+        update(model, model.pending, slotOf(model.hour));
+        model.pending = 0.0;
+        for (long long h = model.hour + 1; h < hour; h++) {
+            update(model, 0.0, slotOf(h));
+        }
+        model.hour = hour;
+    }
+
+    void apply(long long created_at, const std::map<int, int>& lines) {
+        long long hour = hourOf(created_at);
+        for (const auto& line : lines) {
+            auto inserted = models.emplace(line.first, Model());
+            Model& model = inserted.first->second;
+            if (inserted.second) model.hour = hour;
+            advance(model, hour);
+            if (hour >= model.hour) model.pending += line.second;   // late arrivals for a closed hour are dropped
+        }
+    }
+
+    // Seeds level and season from the first (up to) two weeks, then smooths
+    // through the whole series. The last hour stays open.
+    void fit(const std::vector<float>& y, const std::vector<uint8_t>& slots, long long start_hour, Model& model) const {
+        size_t n = y.size();
+        size_t warmup = std::min(n, static_cast<size_t>(2 * kSeason));
+        double sum = 0.0;
+        std::array<double, kSeason> slot_sum{};
+        std::array<int, kSeason> slot_count{};
+        for (size_t h = 0; h < warmup; h++) {
+            sum += y[h];
+            slot_sum[slots[h]] += y[h];
+            slot_count[slots[h]]++;
+        }
+        model.level = warmup ? sum / warmup : 0.0;
+        for (int s = 0; s < kSeason; s++) {
+            model.season[s] = slot_count[s] ? static_cast<float>(slot_sum[s] / slot_count[s] - model.level) : 0.0f;
+        }
+        for (size_t h = 0; h + 1 < n; h++) {
+            update(model, y[h], slots[h]);
+        }
+        model.hour = start_hour + static_cast<long long>(n) - 1;
+        model.pending = n ? y[n - 1] : 0.0;
+    }
+
+    void finishTraining(std::unordered_map<int, Model> trained, long long trained_through) {
+        std::lock_guard<std::mutex> lock(mutex);
+        training = false;
+        if (trained.empty() && trained_through == 0) {
+            backlog.clear();
+            return;
+        }
+        models.swap(trained);
+        for (const auto& order : backlog) {
+            if (order.order_id > trained_through) apply(order.created_at, order.lines);
+        }
+        backlog.clear();
+    }
+
+    double alpha;
+    double gamma;
+    long long utc_offset = 0;
+    std::mutex mutex;
+    std::unordered_map<int, Model> models;
+    bool training = false;
+    std::vector<Observed> backlog;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Scratch memory for one UI frame. Render code builds its temporary
+// containers on resource() and never frees them; reset() at the start of
+// the next frame rewinds the whole buffer at once. A frame that outgrows
+// the buffer spills to the heap, and the next reset() grows the buffer to
+// cover it, so a steady-state frame allocates nothing.
+class FrameArena : public std::pmr::memory_resource {
+public:
+    explicit FrameArena(size_t capacity = 256 * 1024) { rebuild(capacity); }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return this; }
+
+    void reset() {
+        if (used > capacity) {
+            size_t grown = capacity;
+            while (grown < used) grown *= 2;
+            rebuild(grown);
+        } else {
+            arena->release();
+        }
+        peak = std::max(peak, used);
+        used = 0;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return capacity; }
+    size_t peakBytes() const { return std::max(peak, used); }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        used += bytes + alignment - 1;   // worst-case padding, so growth always covers the frame
+        return arena->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    void rebuild(size_t bytes) {
+        arena.reset();
+        buffer.reset(new std::byte[bytes]);
+        capacity = bytes;
+        arena.emplace(buffer.get(), capacity, std::pmr::new_delete_resource());
+    }
+
+    std::unique_ptr<std::byte[]> buffer;
+    std::optional<std::pmr::monotonic_buffer_resource> arena;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t peak = 0;
+};
+
+// The UI thread's arena; only the UI thread may allocate from it.
+FrameArena& frameArena() {
+    static FrameArena arena;
+    return arena;
+}
+
+template <typename T>
+using FrameVector = std::pmr::vector<T>;
+using FrameString = std::pmr::string;
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef HASH_CHAIN_H
+#define HASH_CHAIN_H
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sha256.h"
+
+// Tamper-evident hash chains over append-only tables. Every row stores
+// prev_hash (the previous row's row_hash, zeros for the first row) and
+// row_hash = SHA-256(prev_hash || canonical encoding of its immutable
+// columns). Editing, deleting or reordering a row breaks the chain from that
+// point on.
+struct HashChainTable {
+    const char* table;
+    const char* id_column;
+    const char* content_columns;   // immutable columns only, id first
+};
+
+// bills.refunded changes after the fact, so it is not covered; refunds are
+// recorded in the activity_log chain instead.
+static const HashChainTable kBillsChain = {"bills", "bill_id", "bill_id, order_id, tax, total, payment_method, created_at"};
+static const HashChainTable kActivityLogChain = {"activity_log", "log_id", "log_id, user_id, action, timestamp"};
+
+struct HashChainReport {
+    std::string table;
+    long long rows = 0;
+    long long unsealed = 0;
+    long long broken_links = 0;
+    long long bad_hashes = 0;
+    long long first_bad_id = -1;
+    double seconds = 0.0;
+
+    bool ok() const { return unsealed == 0 && broken_links == 0 && bad_hashes == 0; }
+};
+
+// Canonical, type-tagged encoding of columns [first, first + count) of the current row.
+void encodeChainRow(std::string& out, sqlite3_stmt* stmt, int first, int count) {
+    char number[32];
+    for (int col = first; col < first + count; col++) {
+        switch (sqlite3_column_type(stmt, col)) {
+            case SQLITE_INTEGER:
+                out += 'i';
+                out += std::to_string(sqlite3_column_int64(stmt, col));
+                break;
+            case SQLITE_FLOAT:
+                std::snprintf(number, sizeof(number), "f%.17g", sqlite3_column_double(stmt, col));
+                out += number;
+                break;
+            case SQLITE_NULL:
+                out += 'n';
+                break;
+            default: {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+                int length = sqlite3_column_bytes(stmt, col);
+                out += 't';
+                out += std::to_string(length);
+                out += ':';
+                out.append(text ? text : "", length);
+                break;
+            }
+        }
+        out += '\x1f';
+    }
+}
+
+// Hashes every row after the last sealed one, in id order. Called right after
+// inserts, so normally it seals a single row; on first run it backfills.
+long long sealHashChain(sqlite3* db, const HashChainTable& chain) {
+    Sha256Digest prev{};
+    sqlite3_int64 tip_id = 0;
+    sqlite3_stmt* stmt;
+    std::string sql = std::string("SELECT ") + chain.id_column + ", row_hash FROM " + chain.table +
+                      " WHERE row_hash IS NOT NULL ORDER BY " + chain.id_column + " DESC LIMIT 1;";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (hash chain tip): " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        tip_id = sqlite3_column_int64(stmt, 0);
+        if (sqlite3_column_bytes(stmt, 1) == 32) {
+            std::memcpy(prev.data(), sqlite3_column_blob(stmt, 1), 32);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    sql = std::string("SELECT ") + chain.content_columns + " FROM " + chain.table + " WHERE " +
+          chain.id_column + " > ? ORDER BY " + chain.id_column + ";";
+    std::string update_sql = std::string("UPDATE ") + chain.table + " SET prev_hash = ?, row_hash = ? WHERE " +
+                             chain.id_column + " = ?;";
+    sqlite3_stmt* update;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, update_sql.c_str(), -1, &update, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (hash chain seal): " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+
+    bool own_transaction = sqlite3_get_autocommit(db) != 0;
+    if (own_transaction) {
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    }
+    long long sealed = 0;
+    std::string encoded;
+    sqlite3_bind_int64(stmt, 1, tip_id);
+    int columns = sqlite3_column_count(stmt);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        encoded.clear();
+        encodeChainRow(encoded, stmt, 0, columns);
+        SHA256Hasher hasher;
+        hasher.update(prev.data(), prev.size());
+        hasher.update(encoded);
+        Sha256Digest row_hash = hasher.digest();
+
+        sqlite3_bind_blob(update, 1, prev.data(), 32, SQLITE_STATIC);
+        sqlite3_bind_blob(update, 2, row_hash.data(), 32, SQLITE_STATIC);
+        sqlite3_bind_int64(update, 3, sqlite3_column_int64(stmt, 0));
+        if (sqlite3_step(update) != SQLITE_DONE) {
+            std::cerr << "SQL update error (hash chain): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_reset(update);
+        prev = row_hash;
+        sealed++;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(update);
+    if (own_transaction) {
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+    return sealed;
+}
+
+// Re-checks every link and every row hash. Rows are read in chunks; each
+// chunk's hashes are recomputed in parallel (threads x AVX2 lanes), since
+// with the stored prev_hash every row can be checked independently.
+HashChainReport verifyHashChain(sqlite3* db, const HashChainTable& chain, unsigned threads = 0) {
+    HashChainReport report;
+    report.table = chain.table;
+    auto started = std::chrono::steady_clock::now();
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::string sql = std::string("SELECT prev_hash, row_hash, ") + chain.content_columns + " FROM " +
+                      chain.table + " ORDER BY " + chain.id_column + ";";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (hash chain verify): " << sqlite3_errmsg(db) << std::endl;
+        report.bad_hashes = -1;
+        return report;
+    }
+    int content_columns = sqlite3_column_count(stmt) - 2;
+
+    const size_t chunk_rows = 65536;
+    std::string arena;
+    std::vector<size_t> offsets;
+    std::vector<Sha256Digest> stored;
+    std::vector<sqlite3_int64> ids;
+    std::vector<Sha256Digest> computed;
+    Sha256Digest expected_prev{};
+
+    auto flag = [&](long long& counter, sqlite3_int64 id) {
+        counter++;
+        if (report.first_bad_id < 0 || id < report.first_bad_id) report.first_bad_id = id;
+    };
+
+    auto checkChunk = [&]() {
+        size_t n = ids.size();
+        std::vector<Sha256Input> inputs(n);
+        for (size_t i = 0; i < n; i++) {
+            inputs[i] = {reinterpret_cast<const uint8_t*>(arena.data()) + offsets[i], offsets[i + 1] - offsets[i]};
+        }
+        computed.resize(n);
+        size_t per_thread = (n + threads - 1) / threads;
+        std::vector<std::thread> workers;
+        for (size_t begin = 0; begin < n; begin += per_thread) {
+            size_t count = std::min(per_thread, n - begin);
+            workers.emplace_back([&, begin, count] { sha256Batch(inputs.data() + begin, count, computed.data() + begin); });
+        }
+        for (auto& worker : workers) worker.join();
+        for (size_t i = 0; i < n; i++) {
+            if (computed[i] != stored[i]) flag(report.bad_hashes, ids[i]);
+        }
+        arena.clear();
+        offsets.assign(1, 0);
+        stored.clear();
+        ids.clear();
+    };
+
+    offsets.assign(1, 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        report.rows++;
+        sqlite3_int64 id = sqlite3_column_int64(stmt, 2);
+        if (sqlite3_column_bytes(stmt, 0) != 32 || sqlite3_column_bytes(stmt, 1) != 32) {
+            flag(report.unsealed, id);
+            continue;
+        }
+        if (std::memcmp(sqlite3_column_blob(stmt, 0), expected_prev.data(), 32) != 0) {
+            flag(report.broken_links, id);
+        }
+        Sha256Digest row_hash;
+        std::memcpy(row_hash.data(), sqlite3_column_blob(stmt, 1), 32);
+        expected_prev = row_hash;
+
+        arena.append(static_cast<const char*>(sqlite3_column_blob(stmt, 0)), 32);
+        encodeChainRow(arena, stmt, 2, content_columns);
+        offsets.push_back(arena.size());
+        stored.push_back(row_hash);
+        ids.push_back(id);
+        if (ids.size() == chunk_rows) checkChunk();
+    }
+    if (!ids.empty()) checkChunk();
+    sqlite3_finalize(stmt);
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef KITCHEN_QUEUE_H
+#define KITCHEN_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Unbounded multi-producer, single-consumer queue (Vyukov's linked list).
+// push() is one atomic exchange and never blocks; pop() must only be called
+// from the consumer thread.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        while (tail) {
+            Node* next = tail->next.load(std::memory_order_relaxed);
+            delete tail;
+            tail = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // False when empty, or when a producer is between its exchange and its
+    // link; the value shows up on a later call.
+    bool pop(T& value) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node*> head;   // last pushed
+    Node* tail;                // consumed stub; tail->next is the oldest
+};
+
+// Pending orders for the kitchen display. Writers describe what happened
+// with post() from any thread; the UI thread applies it with drain() before
+// drawing, so the display never reads SQLite per frame. Each station keeps
+// the tickets that have lines for it in cooking order (rush orders first,
+// then oldest first), so a change costs O(log n) and drawing just walks it.
+struct KitchenLine {
+    int item_id = 0;
+    int quantity = 0;
+    std::string station;         // filled in by drain()
+    std::string name;            // likewise, so drawing a ticket looks nothing up
+};
+
+struct KitchenTicket {
+    int order_id = 0;
+    long long created_at = 0;
+    bool rush = false;
+    std::vector<KitchenLine> lines;
+};
+
+struct KitchenEvent {
+    enum Type { ADD, REMOVE, RUSH, MENU_ITEM, CLEAR };
+    Type type = ADD;
+    KitchenTicket ticket;        // ADD; order_id and rush for REMOVE/RUSH
+    int item_id = 0;             // MENU_ITEM
+    std::string name;
+    std::string station;
+};
+
+class KitchenQueue {
+public:
+    static constexpr const char* kDefaultStation = "Main";
+
+    // Compares order_ids through the ticket table. A ticket's rush flag and
+    // created_at only change while it is out of its stations' sets.
+    struct Before {
+        const std::unordered_map<int, KitchenTicket>* tickets;
+        bool operator()(int a, int b) const {
+            const KitchenTicket& x = tickets->at(a);
+            const KitchenTicket& y = tickets->at(b);
+            if (x.rush != y.rush) return x.rush;
+            if (x.created_at != y.created_at) return x.created_at < y.created_at;
+            return a < b;
+        }
+    };
+    using StationQueue = std::set<int, Before>;
+
+    void post(KitchenEvent event) { events.push(std::move(event)); }
+
+    // Applies everything posted so far. Returns the number of events.
+    size_t drain() {
+        KitchenEvent event;
+        size_t applied = 0;
+        while (events.pop(event)) {
+            apply(event);
+            applied++;
+        }
+        return applied;
+    }
+
+    size_t pending() const { return tickets.size(); }
+
+    // Station names in display order, with tickets or not.
+    const std::vector<std::string>& stationNames() const { return names; }
+
+    // Order ids for a station, next to cook first.
+    const StationQueue& queue(const std::string& station) const {
+        static const StationQueue none(Before{nullptr});
+        auto it = stations.find(station);
+        return it != stations.end() ? it->second : none;
+    }
+
+    const KitchenTicket* ticket(int order_id) const {
+        auto it = tickets.find(order_id);
+        return it != tickets.end() ? &it->second : nullptr;
+    }
+
+    std::string itemName(int item_id) const {
+        auto it = items.find(item_id);
+        return it != items.end() ? it->second.first : "Item " + std::to_string(item_id);
+    }
+
+    std::string station(int item_id) const {
+        auto it = items.find(item_id);
+        return it != items.end() ? it->second.second : kDefaultStation;
+    }
+
+private:
+    StationQueue& stationQueue(const std::string& name) {
+        auto it = stations.find(name);
+        if (it == stations.end()) {
+            it = stations.emplace(name, StationQueue(Before{&tickets})).first;
+            names.insert(std::lower_bound(names.begin(), names.end(), name), name);
+        }
+        return it->second;
+    }
+
+    void apply(const KitchenEvent& event) {
+        switch (event.type) {
+            case KitchenEvent::ADD: {
+                remove(event.ticket.order_id);
+                KitchenTicket& ticket = tickets[event.ticket.order_id] = event.ticket;
+                for (auto& line : ticket.lines) {
+                    line.station = station(line.item_id);
+                    line.name = itemName(line.item_id);
+                    stationQueue(line.station).insert(ticket.order_id);
+                }
+                break;
+            }
+            case KitchenEvent::REMOVE:
+                remove(event.ticket.order_id);
+                break;
+            case KitchenEvent::RUSH: {
+                auto it = tickets.find(event.ticket.order_id);
+                if (it == tickets.end() || it->second.rush == event.ticket.rush) break;
+                for (const auto& line : it->second.lines) stations.at(line.station).erase(event.ticket.order_id);
+                it->second.rush = event.ticket.rush;
+                for (const auto& line : it->second.lines) stations.at(line.station).insert(event.ticket.order_id);
+                break;
+            }
+            case KitchenEvent::MENU_ITEM:
+                // Later tickets get the new name and station; queued lines stay put.
+                items[event.item_id] = {event.name, event.station.empty() ? kDefaultStation : event.station};
+                stationQueue(items[event.item_id].second);
+                break;
+            case KitchenEvent::CLEAR:
+                for (auto& station : stations) station.second.clear();
+                tickets.clear();
+                break;
+        }
+    }
+
+    void remove(int order_id) {
+        auto it = tickets.find(order_id);
+        if (it == tickets.end()) {
+            return;
+        }
+        for (const auto& line : it->second.lines) {
+            stations.at(line.station).erase(order_id);
+        }
+        tickets.erase(it);
+    }
+
+    MpscQueue<KitchenEvent> events;
+    // Consumer-side state, touched only by drain() and the readers above.
+    std::unordered_map<int, KitchenTicket> tickets;
+    std::map<std::string, StationQueue> stations;
+    std::vector<std::string> names;   // keys of stations, in map order
+    std::unordered_map<int, std::pair<std::string, std::string>> items;   // item_id -> (name, station)
+};
+
+#endif
@@ -15,13 +15,18 @@
  */
  
  
+// Building with CANTEEN_HEADLESS leaves out the ImGui front end and main(),
+// so tools such as canteen_bench can reuse the data layer.
+#ifndef CANTEEN_HEADLESS
 #define GL_SILENCE_DEPRECATION
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 #include <GLFW/glfw3.h>
+#endif
 #include <sqlite3.h>
 #include <string>
+#include <cstring>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -31,13 +36,35 @@
 #include <algorithm>
 #include <filesystem>
 #include <ctime>
+#include <unordered_map>
+#include <map>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <mutex>
+#include <functional>
+#include <tuple>
 #include "sha256.h"
+#include "write_queue.h"
+#include "profiler.h"
+#include "sqltrace.h"
+#include "metrics.h"
+#include "hash_chain.h"
+#include "reservations.h"
+#include "forecast.h"
+#include "recipes.h"
+#include "kitchen_queue.h"
+#include "order_events.h"
+#include "escpos.h"
+#include "bill_snapshot.h"
+#include "frame_arena.h"
 
 struct MenuItem {
     int id;
     std::string name;
     float price;
     bool available;
+    std::string station;       // kitchen station that prepares it
 };
 
 struct OrderItem {
@@ -66,11 +93,39 @@ struct Bill {
     bool refunded;
 };
 
+// One bill's outcome in bulkRefundBills().
+struct RefundResult {
+    int bill_id = 0;
+    int order_id = 0;
+    std::string user_id;
+    bool refunded = false;
+    std::string reason;        // why not, when refunded is false
+    float amount = 0;
+    bool wallet_credited = false;
+    int points_reversed = 0;
+};
+
+// Bills to refund by what they have in common; zero/empty fields match all.
+struct RefundFilter {
+    int from = 0;              // bills.created_at range, inclusive
+    int to = 0;
+    int item_id = 0;           // orders containing this item
+    std::string payment_method;
+};
+
 struct Wallet {
     std::string user_id;
     float balance;
 };
 
+struct WalletTransaction {
+    int txn_id;
+    float amount;              // credits positive, debits negative
+    std::string type;          // opening, topup, bill, refund, bulk_credit
+    std::string reference;
+    int created_at;
+};
+
 struct Discount {
     int discount_id;
     std::string name;
@@ -87,6 +142,22 @@ struct Inventory {
     int low_stock_threshold;
 };
 
+struct Ingredient {
+    int ingredient_id;
+    std::string name;
+    std::string unit;
+    double quantity;
+};
+
+struct RecipeLine {
+    int item_id;
+    std::string item_name;
+    int ingredient_id;
+    std::string ingredient_name;
+    double quantity;           // per portion, in the ingredient's unit
+    std::string unit;
+};
+
 struct LoyaltyPoints {
     std::string user_id;
     int points;
@@ -125,7 +196,241 @@ struct UserDetails {
     float wallet_balance;
 };
 
+struct RapidEntryLine {
+    int item_code;
+    int quantity;
+};
+
+struct PopularityRanking {
+    std::unordered_map<int, int> quantity_by_item;
+    std::vector<int> ranked_item_ids;
+    sqlite3_int64 last_order_item_id = 0;
+};
+
+struct BillingHandoff {
+    int order_id = -1;
+    std::string customer_id;
+};
+
+
+
+// Writer thread used by the UI; when null, mutations run inline on the caller's connection.
+static WriteQueue* write_queue = nullptr;
+
+// Receipt printer from CANTEEN_PRINTER; when null, bills are not printed.
+static PrinterQueue* printer_queue = nullptr;
+
+// Bumped whenever the UI's cached views may be stale: another connection
+// committed (seen through data_version), or something wrote on the UI's own
+// connection, which data_version does not report.
+static std::atomic<unsigned> view_generation{1};
+
+void invalidateViews() {
+    view_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Runs a mutation through the writer queue and waits for its group commit.
+template <typename F>
+void runWrite(sqlite3* db, F fn) {
+    if (!write_queue) {
+        fn(db);
+        invalidateViews();
+        return;
+    }
+    try {
+        write_queue->submit(std::move(fn)).get();
+    } catch (const std::exception& e) {
+        std::cerr << "Queued write failed: " << e.what() << std::endl;
+    }
+}
+
+template <typename F, typename R>
+R runWrite(sqlite3* db, F fn, R on_error) {
+    if (!write_queue) {
+        R result = fn(db);
+        invalidateViews();
+        return result;
+    }
+    try {
+        // A result equal to on_error (false, -1) rolls the command's writes back.
+        auto failed = [on_error](const R& result) {
+            if constexpr (std::is_arithmetic<R>::value) {
+                return result == on_error;
+            } else {
+                return false;
+            }
+        };
+        return write_queue->submit(std::move(fn), failed).get();
+    } catch (const std::exception& e) {
+        std::cerr << "Queued write failed: " << e.what() << std::endl;
+        return on_error;
+    }
+}
+
+// Operational metrics, served by the MetricsExporter started in main().
+struct CanteenMetrics {
+    MetricCounter& orders_created = MetricsRegistry::instance().counter("canteen_orders_created_total", "Orders created");
+    MetricCounter& bills_generated = MetricsRegistry::instance().counter("canteen_bills_generated_total", "Bills generated");
+    MetricCounter& refunds = MetricsRegistry::instance().counter("canteen_refunds_total", "Bills refunded");
+    MetricCounter& wallet_debits = MetricsRegistry::instance().counter("canteen_wallet_debits_total", "Bills paid from a wallet");
+    MetricHistogram& frame_seconds = MetricsRegistry::instance().histogram(
+        "canteen_frame_seconds", "UI frame time", MetricHistogram::exponentialBuckets(0.001, 2, 12));
+    MetricHistogram& sql_seconds = MetricsRegistry::instance().histogram(
+        "canteen_sql_statement_seconds", "SQL statement latency", MetricHistogram::exponentialBuckets(0.00001, 4, 10));
+    MetricHistogram& backup_seconds = MetricsRegistry::instance().histogram(
+        "canteen_backup_seconds", "Database backup duration", MetricHistogram::exponentialBuckets(0.01, 4, 8));
+
+    CanteenMetrics() {
+        // Sampled on scrape; main() stops the exporter before clearing write_queue.
+        MetricsRegistry::instance().gauge("canteen_write_queue_depth", "Writes (including activity log entries) waiting for the writer thread",
+                                          [] { return write_queue ? static_cast<double>(write_queue->depth()) : 0.0; });
+    }
+};
+
+CanteenMetrics& metrics() {
+    static CanteenMetrics instance;
+    return instance;
+}
+
+// Counts a write's activity once it commits, so rolled-back work is not exported.
+void countAfterCommit(MetricCounter& counter, uint64_t n = 1) {
+    WriteQueue::afterCommit([&counter, n] { counter.inc(n); });
+}
+
+// Stock held by open carts; loaded in main() and kept in step with inventory.
+StockReservations& stockReservations() {
+    static StockReservations reservations;
+    return reservations;
+}
+
+// Resyncs an item's cart counter with the quantity an inventory write set,
+// once that write commits; if it rolls back the counter keeps the old one.
+void syncStockAfterCommit(int item_id, int quantity) {
+    WriteQueue::afterCommit([item_id, quantity] { stockReservations().sync(item_id, quantity); });
+}
 
+// Per-item demand models; trained in main() and updated by createOrder().
+DemandForecaster& demandForecaster() {
+    static DemandForecaster forecaster;
+    return forecaster;
+}
+
+// Recipes and ingredient stock; loaded in main() and kept in step with ingredients.
+RecipeBook& recipeBook() {
+    static RecipeBook book;
+    return book;
+}
+
+// Pending orders for the kitchen display; fed by the order writes, drained by the UI loop.
+KitchenQueue& kitchenQueue() {
+    static KitchenQueue queue;
+    return queue;
+}
+
+// Posts from an order or menu write once it commits, so the display never
+// shows a change that rolled back.
+void postKitchenEvent(KitchenEvent event) {
+    WriteQueue::afterCommit([event] { kitchenQueue().post(KitchenEvent(event)); });
+}
+
+bool addColumnIfMissing(sqlite3* db, const std::string& table, const std::string& column, const std::string& decl) {
+    sqlite3_stmt* stmt;
+    std::string sql = "PRAGMA table_info(" + table + ");";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (table_info): " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    bool exists = false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        if (name && column == name) {
+            exists = true;
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (exists) {
+        return true;
+    }
+    sql = "ALTER TABLE " + table + " ADD COLUMN " + column + " " + decl + ";";
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Migration error (" << table << "." << column << "): " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+// Loyalty points are held in lots, one per customer per earning batch.
+// loyalty_points.points stays the sum of a customer's open lots; lots are
+// consumed oldest first and expire loyalty_expiry_days after they were earned.
+const float kLoyaltyExpiryDays = 180.0f;
+
+// When points earned at `earned_at` expire; 0 if expiry is switched off
+// (loyalty_expiry_days <= 0).
+long long loyaltyExpiresAt(sqlite3* db, long long earned_at) {
+    sqlite3_stmt* stmt;
+    double days = kLoyaltyExpiryDays;
+    const char* sql = "SELECT value FROM settings WHERE key = 'loyalty_expiry_days';";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            days = sqlite3_column_double(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return days > 0 ? earned_at + static_cast<long long>(days * 86400) : 0;
+}
+
+bool insertLoyaltyLot(sqlite3* db, const std::string& user_id, int points, long long earned_at) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO loyalty_lots (user_id, points, remaining, earned_at, expires_at) VALUES (?, ?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (loyalty_lots): " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    long long expires_at = loyaltyExpiresAt(db, earned_at);
+    sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, points);
+    sqlite3_bind_int(stmt, 3, points);
+    sqlite3_bind_int64(stmt, 4, earned_at);
+    if (expires_at > 0) {
+        sqlite3_bind_int64(stmt, 5, expires_at);
+    } else {
+        sqlite3_bind_null(stmt, 5);
+    }
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        std::cerr << "SQL insert error (loyalty_lots): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// A positive balance with no open lot (an older database, or points written
+// directly) gets a single lot earned now.
+void backfillLoyaltyLots(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    long long now = std::time(nullptr);
+    long long expires_at = loyaltyExpiresAt(db, now);
+    const char* sql = "INSERT INTO loyalty_lots (user_id, points, remaining, earned_at, expires_at) "
+                      "SELECT lp.user_id, lp.points, lp.points, ?1, ?2 FROM loyalty_points lp WHERE lp.points > 0 "
+                      "AND NOT EXISTS (SELECT 1 FROM loyalty_lots l WHERE l.user_id = lp.user_id AND l.remaining > 0);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (loyalty_lots backfill): " << sqlite3_errmsg(db) << std::endl;
+        return;
+    }
+    sqlite3_bind_int64(stmt, 1, now);
+    if (expires_at > 0) {
+        sqlite3_bind_int64(stmt, 2, expires_at);
+    } else {
+        sqlite3_bind_null(stmt, 2);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "SQL insert error (loyalty_lots backfill): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+}
 
 void initDatabase(sqlite3* db) {
     const char* sql = R"(
@@ -172,6 +477,15 @@ void initDatabase(sqlite3* db) {
             balance REAL NOT NULL DEFAULT 0,
             FOREIGN KEY (user_id) REFERENCES users(username)
         );
+        CREATE TABLE IF NOT EXISTS wallet_transactions (
+            txn_id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id TEXT NOT NULL,
+            amount REAL NOT NULL,
+            type TEXT NOT NULL,
+            reference TEXT,
+            created_at INTEGER NOT NULL
+        );
+        CREATE INDEX IF NOT EXISTS idx_wallet_transactions_user ON wallet_transactions(user_id, txn_id);
         CREATE TABLE IF NOT EXISTS discounts (
             discount_id INTEGER PRIMARY KEY AUTOINCREMENT,
             name TEXT NOT NULL,
@@ -187,6 +501,20 @@ void initDatabase(sqlite3* db) {
             low_stock_threshold INTEGER NOT NULL DEFAULT 10,
             FOREIGN KEY (item_id) REFERENCES menu_items(item_id)
         );
+        CREATE TABLE IF NOT EXISTS ingredients (
+            ingredient_id INTEGER PRIMARY KEY AUTOINCREMENT,
+            name TEXT NOT NULL UNIQUE,
+            unit TEXT NOT NULL DEFAULT 'g',
+            quantity REAL NOT NULL DEFAULT 0
+        );
+        CREATE TABLE IF NOT EXISTS recipe_items (
+            item_id INTEGER NOT NULL,
+            ingredient_id INTEGER NOT NULL,
+            quantity REAL NOT NULL,
+            PRIMARY KEY (item_id, ingredient_id),
+            FOREIGN KEY (item_id) REFERENCES menu_items(item_id),
+            FOREIGN KEY (ingredient_id) REFERENCES ingredients(ingredient_id)
+        ) WITHOUT ROWID;
         CREATE TABLE IF NOT EXISTS loyalty_points (
             user_id TEXT PRIMARY KEY,
             points INTEGER NOT NULL DEFAULT 0,
@@ -200,6 +528,16 @@ void initDatabase(sqlite3* db) {
             timestamp INTEGER NOT NULL,
             FOREIGN KEY (user_id) REFERENCES loyalty_points(user_id)
         );
+        CREATE TABLE IF NOT EXISTS loyalty_lots (
+            lot_id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id TEXT NOT NULL,
+            points INTEGER NOT NULL,
+            remaining INTEGER NOT NULL,
+            earned_at INTEGER NOT NULL,
+            expires_at INTEGER
+        );
+        CREATE INDEX IF NOT EXISTS idx_loyalty_lots_open ON loyalty_lots(user_id, lot_id) WHERE remaining > 0;
+        CREATE INDEX IF NOT EXISTS idx_loyalty_lots_expiry ON loyalty_lots(expires_at) WHERE remaining > 0;
         CREATE TABLE IF NOT EXISTS activity_log (
             log_id INTEGER PRIMARY KEY AUTOINCREMENT,
             user_id TEXT,
@@ -216,12 +554,52 @@ void initDatabase(sqlite3* db) {
         std::cerr << "Database init error: " << errMsg << std::endl;
         sqlite3_free(errMsg);
     }
+
+    // Balances from before loyalty_lots existed become one lot per customer.
+    backfillLoyaltyLots(db);
+
+    // Set once a canceled order's stock has gone back to inventory.
+    addColumnIfMissing(db, "orders", "stock_released", "INTEGER NOT NULL DEFAULT 0");
+
+    // Kitchen display: which station cooks an item, and orders to cook first.
+    addColumnIfMissing(db, "menu_items", "station", "TEXT NOT NULL DEFAULT 'Main'");
+    addColumnIfMissing(db, "orders", "rush", "INTEGER NOT NULL DEFAULT 0");
+
+    // Loyalty points a bill earned, so a refund can take them back. NULL on
+    // bills from before the column.
+    addColumnIfMissing(db, "bills", "loyalty_earned", "INTEGER");
+
+    // The bill as printed, written once by generateBill (see bill_snapshot.h).
+    // NULL on older bills, which are reprinted from their order's rows.
+    addColumnIfMissing(db, "bills", "snapshot", "BLOB");
+    sqlite3_exec(db, "CREATE TRIGGER IF NOT EXISTS bills_snapshot_immutable BEFORE UPDATE OF snapshot ON bills "
+                     "WHEN OLD.snapshot IS NOT NULL BEGIN SELECT RAISE(ABORT, 'bill snapshots cannot change'); END;",
+                 nullptr, nullptr, nullptr);
+
+    // Order lifecycle log; orders without events get them from their rows.
+    initOrderEvents(db);
+
+    // wallets.balance is the snapshot of the ledger up to snapshot_txn_id.
+    addColumnIfMissing(db, "wallets", "snapshot_txn_id", "INTEGER NOT NULL DEFAULT 0");
+
+    // Hash-chain columns for databases created before the audit chain existed.
+    for (const HashChainTable* chain : {&kBillsChain, &kActivityLogChain}) {
+        addColumnIfMissing(db, chain->table, "prev_hash", "BLOB");
+        addColumnIfMissing(db, chain->table, "row_hash", "BLOB");
+        sealHashChain(db, *chain);
+    }
 }
 
 
 
 
 void logActivity(sqlite3* db, const std::string& user_id, const std::string& action) {
+    PROFILE_SCOPE("logActivity");
+    if (write_queue && !write_queue->ownsConnection(db)) {
+        // Nobody waits on a log line: hand it to the writer and return.
+        write_queue->submit([user_id, action](sqlite3* writer_db) { logActivity(writer_db, user_id, action); });
+        return;
+    }
     sqlite3_stmt* stmt;
     const char* sql = "INSERT INTO activity_log (user_id, action, timestamp) VALUES (?, ?, ?);";
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
@@ -235,6 +613,8 @@ void logActivity(sqlite3* db, const std::string& user_id, const std::string& act
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             std::cerr << "SQL insert error (activity_log): " << sqlite3_errmsg(db) << std::endl;
         } else {
+            sealHashChain(db, kActivityLogChain);
+            invalidateViews();
             std::cerr << "Logged to database: User: " << (user_id.empty() ? "None" : user_id) << ", Action: " << action << std::endl;
         }
         sqlite3_finalize(stmt);
@@ -256,6 +636,7 @@ void logActivity(sqlite3* db, const std::string& user_id, const std::string& act
 }
 
 std::vector<ActivityLog> viewActivityLog(sqlite3* db) {
+    PROFILE_SCOPE("viewActivityLog");
     std::vector<ActivityLog> logs;
     sqlite3_stmt* stmt;
     const char* sql = "SELECT log_id, user_id, action, timestamp FROM activity_log ORDER BY timestamp DESC;";
@@ -313,6 +694,29 @@ std::string formatTimestamp(int timestamp) {
     return std::string(buffer);
 }
 
+// formatTimestamp() for tables redrawn every frame: a direct-mapped cache,
+// so localtime/strftime run once per distinct time instead of once per row
+// per frame. The text stays valid until a colliding timestamp replaces it,
+// i.e. for the rest of the row that asked for it.
+const char* formatTimestampCached(int timestamp) {
+    struct Slot {
+        bool filled = false;
+        int timestamp = 0;
+        char text[20] = "";
+    };
+    static Slot slots[1024];
+    Slot& slot = slots[static_cast<unsigned>(timestamp) % 1024];
+    if (!slot.filled || slot.timestamp != timestamp) {
+        time_t time = timestamp;
+        struct tm local;
+        localtime_r(&time, &local);
+        strftime(slot.text, sizeof(slot.text), "%d-%m-%Y %H:%M:%S", &local);
+        slot.timestamp = timestamp;
+        slot.filled = true;
+    }
+    return slot.text;
+}
+
 // std::string getTimestampForFilename() {
 //     time_t now = std::time(nullptr);
 //     char buffer[20];
@@ -320,6 +724,7 @@ std::string formatTimestamp(int timestamp) {
 //     return std::string(buffer);
 // }
 
+#ifndef CANTEEN_HEADLESS
 void drawDoodle(ImDrawList* draw_list, ImVec2 center, float radius) {
     draw_list->AddCircle(center, radius, IM_COL32(200, 200, 200, 50), 12, 1.0f);
     for (int i = 0; i < 8; i++) {
@@ -329,23 +734,206 @@ void drawDoodle(ImDrawList* draw_list, ImVec2 center, float radius) {
         draw_list->AddLine(p1, p2, IM_COL32(200, 200, 200, 50), 1.0f);
     }
 }
+#endif
+
+// Low-stock alerts, raised by the writes that move stock (createOrder,
+// inventory edits, cancelOrder) when an item crosses its threshold, so
+// nothing has to scan inventory to find shortages. An item is logged and
+// toasted once per crossing; it stays listed until restocked above it.
+struct StockAlert {
+    int item_id;
+    std::string name;
+    int quantity;
+    int threshold;
+    std::chrono::steady_clock::time_point raised_at;
+
+    // Suggested order: enough to reach twice the threshold.
+    int restockQuantity() const { return std::max(1, 2 * threshold - quantity); }
+};
+
+class LowStockAlerts {
+public:
+    // False if the item was already low (same crossing; just updates it).
+    bool raise(int item_id, const std::string& name, int quantity, int threshold) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = active.find(item_id);
+        if (it != active.end()) {
+            it->second.quantity = quantity;
+            it->second.threshold = threshold;
+            return false;
+        }
+        active[item_id] = {item_id, name, quantity, threshold, std::chrono::steady_clock::now()};
+        return true;
+    }
+
+    void clear(int item_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        active.erase(item_id);
+    }
+
+    bool isLow(int item_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return active.count(item_id) > 0;
+    }
+
+    // Replaces the set with what inventory says. Items new to the set are
+    // toasted when `announce` is set (a crossing made by another terminal).
+    void reset(const std::vector<StockAlert>& low, bool announce) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<int, StockAlert> next;
+        for (const auto& alert : low) {
+            auto it = active.find(alert.item_id);
+            next[alert.item_id] = alert;
+            if (it != active.end() || !announce) {
+                next[alert.item_id].raised_at = it != active.end() ? it->second.raised_at : std::chrono::steady_clock::time_point();
+            }
+        }
+        active.swap(next);
+    }
+
+    size_t count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return active.size();
+    }
+
+    // The restock list: largest shortfall first.
+    std::vector<StockAlert> restockList() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<StockAlert> list;
+        for (const auto& entry : active) list.push_back(entry.second);
+        std::sort(list.begin(), list.end(), [](const StockAlert& a, const StockAlert& b) {
+            return a.restockQuantity() != b.restockQuantity() ? a.restockQuantity() > b.restockQuantity() : a.item_id < b.item_id;
+        });
+        return list;
+    }
+
+    // Alerts raised within the last `window`, newest first, for toasts.
+    std::vector<StockAlert> recent(std::chrono::steady_clock::duration window) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cutoff = std::chrono::steady_clock::now() - window;
+        std::vector<StockAlert> list;
+        for (const auto& entry : active) {
+            if (entry.second.raised_at > cutoff) list.push_back(entry.second);
+        }
+        std::sort(list.begin(), list.end(), [](const StockAlert& a, const StockAlert& b) { return a.raised_at > b.raised_at; });
+        return list;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<int, StockAlert> active;
+};
+
+LowStockAlerts& lowStockAlerts() {
+    static LowStockAlerts alerts;
+    return alerts;
+}
+
+// Records an item's new stock level after a write that changed it. The
+// alert is raised or cleared, and logged, only once that write commits.
+void noteStockLevel(sqlite3* db, int item_id, int quantity, int threshold) {
+    if (quantity > threshold) {
+        WriteQueue::afterCommit([item_id] { lowStockAlerts().clear(item_id); });
+        return;
+    }
+    std::string name = "Item " + std::to_string(item_id);
+    sqlite3_stmt* stmt;
+    if (!lowStockAlerts().isLow(item_id) &&
+        sqlite3_prepare_v2(db, "SELECT name FROM menu_items WHERE item_id = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, item_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    WriteQueue::afterCommit([db, item_id, name, quantity, threshold] {
+        if (!lowStockAlerts().raise(item_id, name, quantity, threshold)) {
+            return;
+        }
+        std::string action = "Low stock: " + name + " (" + std::to_string(quantity) + " left, threshold " +
+                             std::to_string(threshold) + ")";
+        if (write_queue) {
+            // Past the commit; the log line is a write of its own.
+            write_queue->submit([action](sqlite3* wdb) { logActivity(wdb, "", action); });
+        } else {
+            logActivity(db, "", action);
+        }
+    });
+}
+
+// Rebuilds the alert set from inventory: at startup, after a restore, and
+// when another connection has changed the database.
+void refreshLowStockAlerts(sqlite3* db, bool announce) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT i.item_id, COALESCE(mi.name, 'Item ' || i.item_id), i.quantity, i.low_stock_threshold "
+                      "FROM inventory i LEFT JOIN menu_items mi ON mi.item_id = i.item_id "
+                      "WHERE i.quantity <= i.low_stock_threshold;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (low stock): " << sqlite3_errmsg(db) << std::endl;
+        return;
+    }
+    std::vector<StockAlert> low;
+    auto now = std::chrono::steady_clock::now();
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        low.push_back({sqlite3_column_int(stmt, 0), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                       sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3), now});
+    }
+    sqlite3_finalize(stmt);
+    lowStockAlerts().reset(low, announce);
+}
+
+std::string csvField(const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) {
+        return value;
+    }
+    std::string quoted = "\"";
+    for (char c : value) {
+        quoted += c;
+        if (c == '"') quoted += '"';
+    }
+    return quoted + "\"";
+}
+
+bool writeRestockList(const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Cannot write restock list: " << path << std::endl;
+        return false;
+    }
+    out << "item_id,name,quantity,threshold,restock_quantity\n";
+    for (const auto& alert : lowStockAlerts().restockList()) {
+        out << alert.item_id << "," << csvField(alert.name) << "," << alert.quantity << "," << alert.threshold << ","
+            << alert.restockQuantity() << "\n";
+    }
+    return static_cast<bool>(out);
+}
 
-bool addMenuItem(sqlite3* db, const std::string& name, float price, bool available) {
+bool addMenuItem(sqlite3* db, const std::string& name, float price, bool available,
+                 const std::string& station = KitchenQueue::kDefaultStation) {
     sqlite3_stmt* menu_stmt = nullptr;
     sqlite3_stmt* inv_stmt = nullptr;
-    const char* sql = "INSERT INTO menu_items (name, price, available) VALUES (?, ?, ?);";
+    const char* sql = "INSERT INTO menu_items (name, price, available, station) VALUES (?, ?, ?, ?);";
     bool success = false;
 
     if (sqlite3_prepare_v2(db, sql, -1, &menu_stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_text(menu_stmt, 1, name.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_double(menu_stmt, 2, price);
         sqlite3_bind_int(menu_stmt, 3, available ? 1 : 0);
+        sqlite3_bind_text(menu_stmt, 4, station.c_str(), -1, SQLITE_STATIC);
         if (sqlite3_step(menu_stmt) == SQLITE_DONE) {
             int item_id = sqlite3_last_insert_rowid(db);
             const char* inv_sql = "INSERT OR REPLACE INTO inventory (item_id, quantity, low_stock_threshold) VALUES (?, 0, 10);";
             if (sqlite3_prepare_v2(db, inv_sql, -1, &inv_stmt, nullptr) == SQLITE_OK) {
                 sqlite3_bind_int(inv_stmt, 1, item_id);
                 if (sqlite3_step(inv_stmt) == SQLITE_DONE) {
+                    syncStockAfterCommit(item_id, 0);
+                    noteStockLevel(db, item_id, 0, 10);
+                    KitchenEvent event;
+                    event.type = KitchenEvent::MENU_ITEM;
+                    event.item_id = item_id;
+                    event.name = name;
+                    event.station = station;
+                    postKitchenEvent(std::move(event));
                     success = true;
                 } else {
                     std::cerr << "SQL insert error (inventory): " << sqlite3_errmsg(db) << std::endl;
@@ -365,16 +953,24 @@ bool addMenuItem(sqlite3* db, const std::string& name, float price, bool availab
     return success;
 }
 
-void editMenuItem(sqlite3* db, int item_id, const std::string& name, float price, bool available) {
+void editMenuItem(sqlite3* db, int item_id, const std::string& name, float price, bool available, const std::string& station) {
     sqlite3_stmt* stmt;
-    const char* sql = "UPDATE menu_items SET name = ?, price = ?, available = ? WHERE item_id = ?;";
+    const char* sql = "UPDATE menu_items SET name = ?, price = ?, available = ?, station = ? WHERE item_id = ?;";
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_double(stmt, 2, price);
         sqlite3_bind_int(stmt, 3, available ? 1 : 0);
-        sqlite3_bind_int(stmt, 4, item_id);
+        sqlite3_bind_text(stmt, 4, station.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 5, item_id);
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             std::cerr << "SQL update error: " << sqlite3_errmsg(db) << std::endl;
+        } else {
+            KitchenEvent event;
+            event.type = KitchenEvent::MENU_ITEM;
+            event.item_id = item_id;
+            event.name = name;
+            event.station = station;
+            postKitchenEvent(std::move(event));
         }
         sqlite3_finalize(stmt);
     }
@@ -398,15 +994,28 @@ void deleteMenuItem(sqlite3* db, int item_id) {
         }
         sqlite3_finalize(stmt);
     }
+    const char* recipe_sql = "DELETE FROM recipe_items WHERE item_id = ?;";
+    if (sqlite3_prepare_v2(db, recipe_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, item_id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "SQL delete error (recipe_items): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (recipeBook().hasRecipe(item_id)) {
+        recipeBook().load(db);
+    }
+    lowStockAlerts().clear(item_id);
 }
 
 std::vector<MenuItem> viewMenuItems(sqlite3* db, bool available_only = false) {
+    PROFILE_SCOPE("viewMenuItems");
     std::vector<MenuItem> items;
     sqlite3_stmt* stmt;
     std::string sql = available_only ?
-        "SELECT mi.item_id, mi.name, mi.price, mi.available FROM menu_items mi "
+        "SELECT mi.item_id, mi.name, mi.price, mi.available, mi.station FROM menu_items mi "
         "JOIN inventory i ON mi.item_id = i.item_id WHERE mi.available = 1 AND i.quantity > 0;" :
-        "SELECT item_id, name, price, available FROM menu_items;";
+        "SELECT item_id, name, price, available, station FROM menu_items;";
     if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             MenuItem item;
@@ -414,6 +1023,10 @@ std::vector<MenuItem> viewMenuItems(sqlite3* db, bool available_only = false) {
             item.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
             item.price = sqlite3_column_double(stmt, 2);
             item.available = sqlite3_column_int(stmt, 3) == 1;
+            item.station = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            if (available_only && !recipeBook().available(item.id)) {
+                continue;   // an ingredient has run short
+            }
             items.push_back(item);
         }
         sqlite3_finalize(stmt);
@@ -430,6 +1043,9 @@ void addInventory(sqlite3* db, int item_id, int quantity, int low_stock_threshol
         sqlite3_bind_int(stmt, 3, low_stock_threshold);
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             std::cerr << "SQL insert error (inventory): " << sqlite3_errmsg(db) << std::endl;
+        } else {
+            syncStockAfterCommit(item_id, quantity);
+            noteStockLevel(db, item_id, quantity, low_stock_threshold);
         }
         sqlite3_finalize(stmt);
     }
@@ -444,12 +1060,16 @@ void updateInventory(sqlite3* db, int item_id, int quantity, int low_stock_thres
         sqlite3_bind_int(stmt, 3, item_id);
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             std::cerr << "SQL update error (inventory): " << sqlite3_errmsg(db) << std::endl;
+        } else {
+            syncStockAfterCommit(item_id, quantity);
+            noteStockLevel(db, item_id, quantity, low_stock_threshold);
         }
         sqlite3_finalize(stmt);
     }
 }
 
 std::vector<Inventory> viewInventory(sqlite3* db) {
+    PROFILE_SCOPE("viewInventory");
     std::vector<Inventory> inventory;
     sqlite3_stmt* stmt;
     const char* sql = "SELECT item_id, quantity, low_stock_threshold FROM inventory;";
@@ -466,6 +1086,198 @@ std::vector<Inventory> viewInventory(sqlite3* db) {
     return inventory;
 }
 
+// Takes (consume) or returns ingredient stock for `amounts` (ingredient_id ->
+// quantity) with one statement for all of them, then moves the recipe book
+// to the new levels. Consuming fails if any ingredient had less than asked;
+// the short ones are logged and the caller rolls the update back.
+bool adjustIngredients(sqlite3* db, const std::map<int, double>& amounts, bool consume) {
+    if (amounts.empty()) {
+        return true;
+    }
+    std::string need = "WITH need(ingredient_id, amount) AS (VALUES ";
+    for (size_t i = 0; i < amounts.size(); i++) {
+        need += i == 0 ? "(?, ?)" : ", (?, ?)";
+    }
+    need += ") ";
+    auto bindNeed = [&](sqlite3_stmt* stmt) {
+        int index = 1;
+        for (const auto& entry : amounts) {
+            sqlite3_bind_int(stmt, index++, entry.first);
+            sqlite3_bind_double(stmt, index++, entry.second);
+        }
+    };
+
+    sqlite3_stmt* stmt;
+    std::string update_sql = need + "UPDATE ingredients SET quantity = quantity " + (consume ? "-" : "+") +
+                             " (SELECT amount FROM need WHERE need.ingredient_id = ingredients.ingredient_id) "
+                             "WHERE ingredient_id IN (SELECT ingredient_id FROM need);";
+    if (sqlite3_prepare_v2(db, update_sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (ingredients): " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    bindNeed(stmt);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        std::cerr << "SQL update error (ingredients): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+
+    // New levels; a negative one was short. Levels only reach the recipe book
+    // once the whole cart fits, since a shortfall is rolled back.
+    std::vector<std::pair<int, double>> levels;
+    std::string level_sql = "SELECT ingredient_id, name, quantity FROM ingredients WHERE ingredient_id IN (";
+    for (size_t i = 0; i < amounts.size(); i++) {
+        level_sql += i == 0 ? "?" : ", ?";
+    }
+    level_sql += ");";
+    if (ok && sqlite3_prepare_v2(db, level_sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        int index = 1;
+        for (const auto& entry : amounts) {
+            sqlite3_bind_int(stmt, index++, entry.first);
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int ingredient_id = sqlite3_column_int(stmt, 0);
+            double quantity = sqlite3_column_double(stmt, 2);
+            if (quantity < 0) {
+                std::cerr << "Insufficient ingredient: " << reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)) << std::endl;
+                recipeBook().setStock(ingredient_id, quantity + amounts.at(ingredient_id));
+                ok = false;
+            }
+            levels.emplace_back(ingredient_id, quantity);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (ok) {
+        for (const auto& level : levels) {
+            recipeBook().setStock(level.first, level.second);
+        }
+    }
+    return ok;
+}
+
+// Returns the new ingredient_id, or -1.
+int addIngredient(sqlite3* db, const std::string& name, const std::string& unit, double quantity) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO ingredients (name, unit, quantity) VALUES (?, ?, ?);";
+    int ingredient_id = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, unit.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, quantity);
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            ingredient_id = static_cast<int>(sqlite3_last_insert_rowid(db));
+        } else {
+            std::cerr << "SQL insert error (ingredients): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (ingredient_id != -1) {
+        recipeBook().load(db);
+    }
+    return ingredient_id;
+}
+
+void setIngredientStock(sqlite3* db, int ingredient_id, double quantity) {
+    sqlite3_stmt* stmt;
+    const char* sql = "UPDATE ingredients SET quantity = ? WHERE ingredient_id = ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, quantity);
+        sqlite3_bind_int(stmt, 2, ingredient_id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "SQL update error (ingredients): " << sqlite3_errmsg(db) << std::endl;
+        } else {
+            recipeBook().setStock(ingredient_id, quantity);
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+// Sets how much of an ingredient one portion of an item uses; 0 removes it
+// from the recipe.
+void setRecipeItem(sqlite3* db, int item_id, int ingredient_id, double quantity) {
+    sqlite3_stmt* stmt;
+    const char* sql = quantity > 0 ?
+        "INSERT INTO recipe_items (item_id, ingredient_id, quantity) VALUES (?1, ?2, ?3) "
+        "ON CONFLICT(item_id, ingredient_id) DO UPDATE SET quantity = excluded.quantity;" :
+        "DELETE FROM recipe_items WHERE item_id = ?1 AND ingredient_id = ?2;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, item_id);
+        sqlite3_bind_int(stmt, 2, ingredient_id);
+        if (quantity > 0) {
+            sqlite3_bind_double(stmt, 3, quantity);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "SQL update error (recipe_items): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+    recipeBook().load(db);
+}
+
+std::vector<Ingredient> viewIngredients(sqlite3* db) {
+    std::vector<Ingredient> ingredients;
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT ingredient_id, name, unit, quantity FROM ingredients ORDER BY name;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ingredients.push_back({sqlite3_column_int(stmt, 0), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                                   reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)), sqlite3_column_double(stmt, 3)});
+        }
+        sqlite3_finalize(stmt);
+    }
+    return ingredients;
+}
+
+std::vector<RecipeLine> viewRecipeItems(sqlite3* db) {
+    std::vector<RecipeLine> lines;
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT r.item_id, COALESCE(mi.name, 'Item ' || r.item_id), r.ingredient_id, g.name, r.quantity, g.unit "
+                      "FROM recipe_items r JOIN ingredients g ON g.ingredient_id = r.ingredient_id "
+                      "LEFT JOIN menu_items mi ON mi.item_id = r.item_id ORDER BY r.item_id, g.name;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            lines.push_back({sqlite3_column_int(stmt, 0), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                             sqlite3_column_int(stmt, 2), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)),
+                             sqlite3_column_double(stmt, 4), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5))});
+        }
+        sqlite3_finalize(stmt);
+    }
+    return lines;
+}
+
+// Takes `points` from the customer's open lots, oldest first. Returns the
+// points actually taken, or -1 on error.
+int consumeLoyaltyLots(sqlite3* db, const std::string& user_id, int points) {
+    sqlite3_stmt* stmt;
+    sqlite3_stmt* update;
+    const char* sql = "SELECT lot_id, remaining FROM loyalty_lots WHERE user_id = ? AND remaining > 0 ORDER BY lot_id;";
+    const char* update_sql = "UPDATE loyalty_lots SET remaining = ? WHERE lot_id = ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, update_sql, -1, &update, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (loyalty_lots consume): " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+    int taken = 0;
+    while (taken < points && sqlite3_step(stmt) == SQLITE_ROW) {
+        int remaining = sqlite3_column_int(stmt, 1);
+        int take = std::min(remaining, points - taken);
+        sqlite3_bind_int(update, 1, remaining - take);
+        sqlite3_bind_int64(update, 2, sqlite3_column_int64(stmt, 0));
+        if (sqlite3_step(update) != SQLITE_DONE) {
+            std::cerr << "SQL update error (loyalty_lots): " << sqlite3_errmsg(db) << std::endl;
+            taken = -1;
+            break;
+        }
+        sqlite3_reset(update);
+        taken += take;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(update);
+    return taken;
+}
+
 void addLoyaltyPoints(sqlite3* db, const std::string& user_id, int points, const std::string& type) {
     sqlite3_stmt* stmt;
     const char* sql = "INSERT OR REPLACE INTO loyalty_points (user_id, points) VALUES (?, COALESCE((SELECT points FROM loyalty_points WHERE user_id = ?) + ?, ?));";
@@ -479,6 +1291,11 @@ void addLoyaltyPoints(sqlite3* db, const std::string& user_id, int points, const
         }
         sqlite3_finalize(stmt);
     }
+    if (points > 0) {
+        insertLoyaltyLot(db, user_id, points, std::time(nullptr));
+    } else {
+        consumeLoyaltyLots(db, user_id, -points);
+    }
 
     const char* trans_sql = "INSERT INTO loyalty_transactions (user_id, points, type, timestamp) VALUES (?, ?, ?, ?);";
     if (sqlite3_prepare_v2(db, trans_sql, -1, &stmt, nullptr) == SQLITE_OK) {
@@ -494,20 +1311,297 @@ void addLoyaltyPoints(sqlite3* db, const std::string& user_id, int points, const
     logActivity(db, user_id, "Loyalty points " + type + ": " + std::to_string(points));
 }
 
+// Loyalty points earned on bills are buffered and written in batches: one
+// UPSERT per customer plus one loyalty_transactions row per accrual. Each
+// accrual carries the number of the batch that will write it, and a flush
+// records its batch number in settings (loyalty_flushed_batch) in the same
+// transaction, so a reader adds exactly the accruals its snapshot lacks.
+const size_t kLoyaltyFlushAccruals = 64;
+const std::chrono::seconds kLoyaltyFlushAge(2);
+
+class LoyaltyAccrualBuffer {
+public:
+    struct Accrual {
+        std::string user_id;
+        int points;
+        long long timestamp;
+        long long batch;
+    };
+
+    // Returns true once the buffer is large or old enough to flush.
+    bool add(const std::string& user_id, int points, long long flushed_batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (next_batch <= flushed_batch) {
+            next_batch = flushed_batch + 1;   // first use since startup or restore
+        }
+        if (accruals.empty()) {
+            oldest = std::chrono::steady_clock::now();
+        }
+        accruals.push_back({user_id, points, static_cast<long long>(std::time(nullptr)), next_batch});
+        return accruals.size() >= kLoyaltyFlushAccruals;
+    }
+
+    // Points buffered for `user_id` that a snapshot at `flushed_batch` does not include.
+    int pending(const std::string& user_id, long long flushed_batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int points = 0;
+        for (const auto& accrual : accruals) {
+            if (accrual.batch > flushed_batch && accrual.user_id == user_id) points += accrual.points;
+        }
+        return points;
+    }
+
+    std::unordered_map<std::string, int> pendingByUser(long long flushed_batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string, int> points;
+        for (const auto& accrual : accruals) {
+            if (accrual.batch > flushed_batch) points[accrual.user_id] += accrual.points;
+        }
+        return points;
+    }
+
+    // Drops accruals already committed and hands back the rest, closing the
+    // current batch. Anything written by a rolled-back flush is still here
+    // and goes out again with the next one.
+    std::vector<Accrual> take(long long flushed_batch, long long& batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        accruals.erase(std::remove_if(accruals.begin(), accruals.end(),
+                                      [&](const Accrual& a) { return a.batch <= flushed_batch; }),
+                       accruals.end());
+        if (next_batch <= flushed_batch) {
+            next_batch = flushed_batch + 1;
+        }
+        batch = next_batch++;
+        oldest = std::chrono::steady_clock::now();
+        return accruals;
+    }
+
+    bool due() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !accruals.empty() && (accruals.size() >= kLoyaltyFlushAccruals ||
+                                     std::chrono::steady_clock::now() - oldest >= kLoyaltyFlushAge);
+    }
+
+    // After a restore the buffered accruals belong to bills that no longer exist.
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        accruals.clear();
+        next_batch = 0;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<Accrual> accruals;
+    long long next_batch = 0;
+    std::chrono::steady_clock::time_point oldest;
+};
+
+LoyaltyAccrualBuffer& loyaltyAccruals() {
+    static LoyaltyAccrualBuffer buffer;
+    return buffer;
+}
+
+long long loyaltyFlushedBatch(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    long long batch = 0;
+    const char* sql = "SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'loyalty_flushed_batch';";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            batch = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return batch;
+}
+
+// Writes everything buffered in the caller's transaction (or its own).
+// Returns the number of accruals written, or -1 on error.
+int flushLoyaltyAccruals(sqlite3* db) {
+    long long batch;
+    std::vector<LoyaltyAccrualBuffer::Accrual> accruals = loyaltyAccruals().take(loyaltyFlushedBatch(db), batch);
+    if (accruals.empty()) {
+        return 0;
+    }
+    // Per customer: points in this batch and when the earliest was earned,
+    // which dates the batch's lot.
+    std::unordered_map<std::string, std::pair<int, long long>> totals;
+    for (const auto& accrual : accruals) {
+        auto inserted = totals.emplace(accrual.user_id, std::make_pair(0, accrual.timestamp));
+        inserted.first->second.first += accrual.points;
+        inserted.first->second.second = std::min(inserted.first->second.second, accrual.timestamp);
+    }
+
+    // A savepoint, so a failed flush leaves nothing behind even inside the
+    // caller's transaction.
+    sqlite3_exec(db, "SAVEPOINT loyalty_flush;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* upsert = nullptr;
+    sqlite3_stmt* trans = nullptr;
+    sqlite3_stmt* mark = nullptr;
+    const char* upsert_sql = "INSERT INTO loyalty_points (user_id, points) VALUES (?, ?) "
+                             "ON CONFLICT(user_id) DO UPDATE SET points = points + excluded.points;";
+    const char* trans_sql = "INSERT INTO loyalty_transactions (user_id, points, type, timestamp) VALUES (?, ?, 'earned', ?);";
+    const char* mark_sql = "INSERT OR REPLACE INTO settings (key, value) VALUES ('loyalty_flushed_batch', ?);";
+    bool ok = sqlite3_prepare_v2(db, upsert_sql, -1, &upsert, nullptr) == SQLITE_OK &&
+              sqlite3_prepare_v2(db, trans_sql, -1, &trans, nullptr) == SQLITE_OK &&
+              sqlite3_prepare_v2(db, mark_sql, -1, &mark, nullptr) == SQLITE_OK;
+    for (auto it = totals.begin(); ok && it != totals.end(); ++it) {
+        sqlite3_bind_text(upsert, 1, it->first.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(upsert, 2, it->second.first);
+        ok = sqlite3_step(upsert) == SQLITE_DONE &&
+             insertLoyaltyLot(db, it->first, it->second.first, it->second.second);
+        sqlite3_reset(upsert);
+    }
+    for (size_t i = 0; ok && i < accruals.size(); i++) {
+        sqlite3_bind_text(trans, 1, accruals[i].user_id.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(trans, 2, accruals[i].points);
+        sqlite3_bind_int64(trans, 3, accruals[i].timestamp);
+        ok = sqlite3_step(trans) == SQLITE_DONE;
+        sqlite3_reset(trans);
+    }
+    if (ok) {
+        sqlite3_bind_int64(mark, 1, batch);
+        ok = sqlite3_step(mark) == SQLITE_DONE;
+    }
+    if (!ok) {
+        std::cerr << "SQL error (loyalty flush): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(upsert);
+    sqlite3_finalize(trans);
+    sqlite3_finalize(mark);
+    if (!ok) {
+        sqlite3_exec(db, "ROLLBACK TO loyalty_flush;", nullptr, nullptr, nullptr);
+    }
+    sqlite3_exec(db, "RELEASE loyalty_flush;", nullptr, nullptr, nullptr);
+    if (!ok) {
+        return -1;   // the accruals stay buffered until a flush commits them
+    }
+    logActivity(db, "", "Loyalty points earned: " + std::to_string(accruals.size()) + " accruals for " +
+                            std::to_string(totals.size()) + " customers");
+    return static_cast<int>(accruals.size());
+}
+
+// Queues points earned on a bill once the caller's write commits, so a
+// rolled-back bill earns nothing. A full batch is flushed inline, or by the
+// main loop when the writer queue is running.
+void accrueLoyaltyPoints(sqlite3* db, const std::string& user_id, int points) {
+    long long flushed_batch = loyaltyFlushedBatch(db);
+    WriteQueue::afterCommit([db, user_id, points, flushed_batch] {
+        if (loyaltyAccruals().add(user_id, points, flushed_batch) && !write_queue) {
+            flushLoyaltyAccruals(db);
+        }
+    });
+}
+
+// Stored points plus accruals not yet flushed. Both come from one statement,
+// so the batch marker matches the points it was read with.
+int getLoyaltyPoints(sqlite3* db, const std::string& user_id) {
+    PROFILE_SCOPE("getLoyaltyPoints");
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT COALESCE((SELECT points FROM loyalty_points WHERE user_id = ?), 0), "
+                      "COALESCE((SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'loyalty_flushed_batch'), 0);";
+    int points = 0;
+    long long flushed_batch = 0;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            points = sqlite3_column_int(stmt, 0);
+            flushed_batch = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return points + loyaltyAccruals().pending(user_id, flushed_batch);
+}
+
+const int kLoyaltyExpiryBatch = 5000;
+const std::chrono::seconds kLoyaltyExpirySweepInterval(60);
+
+// Expires lots whose deadline has passed, earliest first, at most `limit`
+// per call. idx_loyalty_lots_expiry covers open lots only, so a sweep reads
+// just the lots that crossed their deadline since the previous one. Returns
+// the number of lots expired, or -1 on error.
+int expireLoyaltyLots(sqlite3* db, long long now, int limit = kLoyaltyExpiryBatch) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT lot_id, user_id, remaining FROM loyalty_lots "
+                      "WHERE remaining > 0 AND expires_at <= ? ORDER BY expires_at LIMIT ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (loyalty expiry): " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, now);
+    sqlite3_bind_int(stmt, 2, limit);
+    std::vector<sqlite3_int64> lots;
+    std::unordered_map<std::string, int> expired;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        lots.push_back(sqlite3_column_int64(stmt, 0));
+        expired[reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1))] += sqlite3_column_int(stmt, 2);
+    }
+    sqlite3_finalize(stmt);
+    if (lots.empty()) {
+        return 0;
+    }
+
+    sqlite3_exec(db, "SAVEPOINT loyalty_expiry;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* close_lot = nullptr;
+    sqlite3_stmt* debit = nullptr;
+    sqlite3_stmt* trans = nullptr;
+    const char* close_sql = "UPDATE loyalty_lots SET remaining = 0 WHERE lot_id = ?;";
+    const char* debit_sql = "UPDATE loyalty_points SET points = points - ? WHERE user_id = ?;";
+    const char* trans_sql = "INSERT INTO loyalty_transactions (user_id, points, type, timestamp) VALUES (?, ?, 'expired', ?);";
+    bool ok = sqlite3_prepare_v2(db, close_sql, -1, &close_lot, nullptr) == SQLITE_OK &&
+              sqlite3_prepare_v2(db, debit_sql, -1, &debit, nullptr) == SQLITE_OK &&
+              sqlite3_prepare_v2(db, trans_sql, -1, &trans, nullptr) == SQLITE_OK;
+    for (size_t i = 0; ok && i < lots.size(); i++) {
+        sqlite3_bind_int64(close_lot, 1, lots[i]);
+        ok = sqlite3_step(close_lot) == SQLITE_DONE;
+        sqlite3_reset(close_lot);
+    }
+    long long total = 0;
+    for (auto it = expired.begin(); ok && it != expired.end(); ++it) {
+        sqlite3_bind_int(debit, 1, it->second);
+        sqlite3_bind_text(debit, 2, it->first.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(trans, 1, it->first.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(trans, 2, -it->second);
+        sqlite3_bind_int64(trans, 3, now);
+        ok = sqlite3_step(debit) == SQLITE_DONE && sqlite3_step(trans) == SQLITE_DONE;
+        sqlite3_reset(debit);
+        sqlite3_reset(trans);
+        total += it->second;
+    }
+    if (!ok) {
+        std::cerr << "SQL error (loyalty expiry): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(close_lot);
+    sqlite3_finalize(debit);
+    sqlite3_finalize(trans);
+    if (!ok) {
+        sqlite3_exec(db, "ROLLBACK TO loyalty_expiry;", nullptr, nullptr, nullptr);
+    }
+    sqlite3_exec(db, "RELEASE loyalty_expiry;", nullptr, nullptr, nullptr);
+    if (!ok) {
+        return -1;
+    }
+    logActivity(db, "", "Loyalty points expired: " + std::to_string(total) + " points from " +
+                            std::to_string(lots.size()) + " lots");
+    return static_cast<int>(lots.size());
+}
+
 bool redeemLoyaltyPoints(sqlite3* db, const std::string& user_id, int points, float& discount) {
     if (points < 10) return false;
+    if (getLoyaltyPoints(db, user_id) < points) return false;
+
+    // Buffered accruals are the newest points, so they only need writing out
+    // (as lots) when the stored lots cannot cover the redemption.
     sqlite3_stmt* stmt;
     const char* sql = "SELECT points FROM loyalty_points WHERE user_id = ?;";
-    int current_points = 0;
+    int stored_points = 0;
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
         if (sqlite3_step(stmt) == SQLITE_ROW) {
-            current_points = sqlite3_column_int(stmt, 0);
+            stored_points = sqlite3_column_int(stmt, 0);
         }
         sqlite3_finalize(stmt);
     }
-
-    if (current_points < points) return false;
+    if (stored_points < points && flushLoyaltyAccruals(db) < 0) return false;
 
     discount = points / 10.0f;
     addLoyaltyPoints(db, user_id, -points, "redeemed");
@@ -515,11 +1609,19 @@ bool redeemLoyaltyPoints(sqlite3* db, const std::string& user_id, int points, fl
 }
 
 std::vector<LoyaltyPoints> viewLoyaltyPoints(sqlite3* db) {
+    PROFILE_SCOPE("viewLoyaltyPoints");
     std::vector<LoyaltyPoints> points;
     sqlite3_stmt* stmt;
-    const char* sql = "SELECT user_id, points FROM loyalty_points;";
+    // The batch marker rides along (one row with a NULL user when the table
+    // is empty) so the pending accruals added below match this snapshot.
+    const char* sql = "SELECT lp.user_id, lp.points, m.batch FROM "
+                      "(SELECT COALESCE((SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'loyalty_flushed_batch'), 0) AS batch) m "
+                      "LEFT JOIN loyalty_points lp;";
+    long long flushed_batch = 0;
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
+            flushed_batch = sqlite3_column_int64(stmt, 2);
+            if (sqlite3_column_type(stmt, 0) == SQLITE_NULL) continue;
             LoyaltyPoints lp;
             lp.user_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
             lp.points = sqlite3_column_int(stmt, 1);
@@ -527,10 +1629,22 @@ std::vector<LoyaltyPoints> viewLoyaltyPoints(sqlite3* db) {
         }
         sqlite3_finalize(stmt);
     }
+    auto pending = loyaltyAccruals().pendingByUser(flushed_batch);
+    for (auto& lp : points) {
+        auto it = pending.find(lp.user_id);
+        if (it != pending.end()) {
+            lp.points += it->second;
+            pending.erase(it);
+        }
+    }
+    for (const auto& entry : pending) {
+        points.push_back({entry.first, entry.second});
+    }
     return points;
 }
 
 std::vector<LoyaltyTransaction> viewLoyaltyTransactions(sqlite3* db) {
+    PROFILE_SCOPE("viewLoyaltyTransactions");
     std::vector<LoyaltyTransaction> transactions;
     sqlite3_stmt* stmt;
     const char* sql = "SELECT transaction_id, user_id, points, type, timestamp FROM loyalty_transactions ORDER BY timestamp DESC;";
@@ -597,6 +1711,7 @@ void deleteDiscount(sqlite3* db, int discount_id) {
 }
 
 std::vector<Discount> viewDiscounts(sqlite3* db, bool active_only = false) {
+    PROFILE_SCOPE("viewDiscounts");
     std::vector<Discount> discounts;
     sqlite3_stmt* stmt;
     std::string sql = active_only ?
@@ -672,60 +1787,549 @@ float applyDiscount(sqlite3* db, int discount_id, float order_total, const std::
     return new_total;
 }
 
-bool processRefund(sqlite3* db, int bill_id, const std::string& admin_user_id) {
+// Wallet ledger. Every credit and debit is one row in wallet_transactions;
+// wallets.balance is a snapshot covering rows up to wallets.snapshot_txn_id,
+// so a balance is the snapshot plus the (short) tail of newer rows.
+#define WALLET_BALANCE_SQL \
+    "(w.balance + COALESCE((SELECT SUM(t.amount) FROM wallet_transactions t " \
+    "WHERE t.user_id = w.user_id AND t.txn_id > w.snapshot_txn_id), 0))"
+
+const long long kWalletSnapshotInterval = 256;
+
+// The UI offers "Wallet"; older callers pass "wallet".
+bool isWalletPayment(const std::string& payment_method) {
+    static const std::string wallet = "wallet";
+    return std::equal(payment_method.begin(), payment_method.end(), wallet.begin(), wallet.end(),
+                      [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+}
+
+// Last known balance per wallet and the newest ledger row it includes, so a
+// read only sums rows appended since. Filled from committed reads only.
+class WalletBalanceCache {
+public:
+    bool get(const std::string& user_id, double& balance, long long& through_txn_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(user_id);
+        if (it == entries.end()) return false;
+        balance = it->second.first;
+        through_txn_id = it->second.second;
+        return true;
+    }
+    void put(const std::string& user_id, double balance, long long through_txn_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[user_id] = {balance, through_txn_id};
+    }
+    void erase(const std::string& user_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.erase(user_id);
+    }
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::pair<double, long long>> entries;
+};
+
+WalletBalanceCache& walletCache() {
+    static WalletBalanceCache cache;
+    return cache;
+}
+
+// Folds ledger rows into the wallets snapshot, only for wallets that have
+// rows since the previous fold.
+void snapshotWallets(sqlite3* db) {
     sqlite3_stmt* stmt;
-    const char* sql = "SELECT b.order_id, b.total, b.payment_method, b.refunded, o.user_id, o.status "
-                     "FROM bills b JOIN orders o ON b.order_id = o.order_id WHERE b.bill_id = ?;";
+    long long from = 0, to = 0;
+    const char* range_sql = "SELECT COALESCE((SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'wallet_snapshot_txn_id'), 0), "
+                            "COALESCE((SELECT MAX(txn_id) FROM wallet_transactions), 0);";
+    if (sqlite3_prepare_v2(db, range_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            from = sqlite3_column_int64(stmt, 0);
+            to = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (to <= from) {
+        return;
+    }
+    const char* sql = "UPDATE wallets SET balance = balance + COALESCE((SELECT SUM(t.amount) FROM wallet_transactions t "
+                      "WHERE t.user_id = wallets.user_id AND t.txn_id > wallets.snapshot_txn_id AND t.txn_id <= ?1), 0), "
+                      "snapshot_txn_id = MAX(snapshot_txn_id, ?1) "
+                      "WHERE user_id IN (SELECT user_id FROM wallet_transactions WHERE txn_id > ?2 AND txn_id <= ?1);";
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "SQL prepare error: " << sqlite3_errmsg(db) << std::endl;
-        return false;
+        std::cerr << "SQL prepare error (wallet snapshot): " << sqlite3_errmsg(db) << std::endl;
+        return;
+    }
+    sqlite3_bind_int64(stmt, 1, to);
+    sqlite3_bind_int64(stmt, 2, from);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    if (!ok) {
+        std::cerr << "SQL update error (wallet snapshot): " << sqlite3_errmsg(db) << std::endl;
+        return;
+    }
+    const char* mark_sql = "INSERT OR REPLACE INTO settings (key, value) VALUES ('wallet_snapshot_txn_id', ?);";
+    if (sqlite3_prepare_v2(db, mark_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, to);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
     }
+}
 
-    sqlite3_bind_int(stmt, 1, bill_id);
+// Appends one ledger row for an existing wallet. With require_funds the row is
+// only written if the wallet covers it, checked in the same statement, so
+// there is no read-then-write window. Returns the txn_id, 0 if the wallet is
+// missing or short of funds, -1 on a database error.
+long long appendWalletTxn(sqlite3* db, const std::string& user_id, double amount, const char* type,
+                          const std::string& reference, bool require_funds = false) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO wallet_transactions (user_id, amount, type, reference, created_at) "
+                      "SELECT w.user_id, ?2, ?3, ?4, ?5 FROM wallets w "
+                      "WHERE w.user_id = ?1 AND (?6 = 0 OR " WALLET_BALANCE_SQL " + ?2 >= 0);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (wallet_transactions): " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 2, amount);
+    sqlite3_bind_text(stmt, 3, type, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, reference.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 5, std::time(nullptr));
+    sqlite3_bind_int(stmt, 6, require_funds ? 1 : 0);
+    long long txn_id = -1;
+    if (sqlite3_step(stmt) == SQLITE_DONE) {
+        txn_id = sqlite3_changes(db) > 0 ? sqlite3_last_insert_rowid(db) : 0;
+    } else {
+        std::cerr << "SQL insert error (wallet_transactions): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+    if (txn_id > 0 && txn_id % kWalletSnapshotInterval == 0) {
+        snapshotWallets(db);
+    }
+    return txn_id;
+}
+
+// Creates an empty wallet whose snapshot starts after every existing ledger
+// row, so rows left by a deleted wallet of the same id do not count.
+bool ensureWallet(sqlite3* db, const std::string& user_id) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT OR IGNORE INTO wallets (user_id, balance, snapshot_txn_id) "
+                      "VALUES (?, 0, (SELECT COALESCE(MAX(txn_id), 0) FROM wallet_transactions));";
     bool success = false;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        int order_id = sqlite3_column_int(stmt, 0);
-        float total = sqlite3_column_double(stmt, 1);
-        std::string payment_method = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        bool refunded = sqlite3_column_int(stmt, 3) == 1;
-        std::string user_id = sqlite3_column_text(stmt, 4) ? reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4)) : "";
-        std::string status = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+        success = sqlite3_step(stmt) == SQLITE_DONE;
+        if (!success) {
+            std::cerr << "SQL insert error (wallets): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+    return success;
+}
+
+std::vector<WalletTransaction> getWalletStatement(sqlite3* db, const std::string& user_id, int limit = 50) {
+    PROFILE_SCOPE("getWalletStatement");
+    std::vector<WalletTransaction> transactions;
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT txn_id, amount, type, COALESCE(reference, ''), created_at FROM wallet_transactions "
+                      "WHERE user_id = ? ORDER BY txn_id DESC LIMIT ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, limit);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            WalletTransaction txn;
+            txn.txn_id = sqlite3_column_int(stmt, 0);
+            txn.amount = sqlite3_column_double(stmt, 1);
+            txn.type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            txn.reference = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            txn.created_at = sqlite3_column_int(stmt, 4);
+            transactions.push_back(txn);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return transactions;
+}
+
+// Credits every "user_id,amount[,note]" line of a CSV file as one unit: all
+// rows are applied or none. Returns the number of credits, -1 on error.
+int bulkCreditWallets(sqlite3* db, const std::string& csv_path, const std::string& admin_user_id, std::string& error_message) {
+    std::ifstream csv(csv_path);
+    if (!csv.is_open()) {
+        error_message = "Cannot open " + csv_path;
+        return -1;
+    }
+    struct Credit {
+        std::string user_id;
+        double amount;
+        std::string note;
+    };
+    std::vector<Credit> credits;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(csv, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || (line_number == 1 && line.rfind("user_id", 0) == 0)) continue;
+        size_t comma = line.find(',');
+        size_t note_comma = comma == std::string::npos ? comma : line.find(',', comma + 1);
+        char* end = nullptr;
+        double amount = comma == std::string::npos ? 0 : std::strtod(line.c_str() + comma + 1, &end);
+        if (comma == std::string::npos || comma == 0 || end == line.c_str() + comma + 1 || !(amount > 0)) {
+            error_message = "Line " + std::to_string(line_number) + ": expected user_id,amount[,note] with a positive amount";
+            return -1;
+        }
+        credits.push_back({line.substr(0, comma), amount,
+                           note_comma == std::string::npos ? csv_path : line.substr(note_comma + 1)});
+    }
+
+    sqlite3_exec(db, "SAVEPOINT bulk_credit;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO wallet_transactions (user_id, amount, type, reference, created_at) "
+                      "SELECT user_id, ?, 'bulk_credit', ?, ? FROM wallets WHERE user_id = ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        error_message = "Database error: " + std::string(sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK TO bulk_credit; RELEASE bulk_credit;", nullptr, nullptr, nullptr);
+        return -1;
+    }
+    int now = std::time(nullptr);
+    for (const auto& credit : credits) {
+        sqlite3_bind_double(stmt, 1, credit.amount);
+        sqlite3_bind_text(stmt, 2, credit.note.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, now);
+        sqlite3_bind_text(stmt, 4, credit.user_id.c_str(), -1, SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        if (!ok || sqlite3_changes(db) == 0) {
+            error_message = ok ? "No wallet for " + credit.user_id : "Database error: " + std::string(sqlite3_errmsg(db));
+            sqlite3_finalize(stmt);
+            sqlite3_exec(db, "ROLLBACK TO bulk_credit; RELEASE bulk_credit;", nullptr, nullptr, nullptr);
+            return -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    snapshotWallets(db);
+    sqlite3_exec(db, "RELEASE bulk_credit;", nullptr, nullptr, nullptr);
+    logActivity(db, admin_user_id, "Bulk wallet credit: " + std::to_string(credits.size()) + " wallets from " + csv_path);
+    return static_cast<int>(credits.size());
+}
+
+// Refunds the bills staged in temp.refund_request, all or nothing. One query
+// checks every bill; the accepted ones go to temp.refund_bills, and orders,
+// refunds, wallet credits, restocking and loyalty reversal are then written
+// per set, not per bill. Runs inside the caller's savepoint.
+bool refundStagedBills(sqlite3* db, const std::string& admin_user_id, std::vector<RefundResult>& results) {
+    sqlite3_stmt* stmt;
+    sqlite3_stmt* accept = nullptr;
+    const char* check_sql = "SELECT r.bill_id, b.bill_id IS NOT NULL, b.refunded, b.order_id, o.status, COALESCE(o.user_id, ''), "
+                            "b.total, b.payment_method, COALESCE(b.loyalty_earned, CAST(b.total / "
+                            "COALESCE((SELECT CAST(value AS REAL) FROM settings WHERE key = 'loyalty_earn_rate'), 10) AS INTEGER), 0), "
+                            "o.stock_released, w.user_id IS NOT NULL "
+                            "FROM refund_request r LEFT JOIN bills b ON b.bill_id = r.bill_id "
+                            "LEFT JOIN orders o ON o.order_id = b.order_id "
+                            "LEFT JOIN wallets w ON w.user_id = o.user_id ORDER BY r.bill_id;";
+    const char* accept_sql = "INSERT INTO refund_bills (bill_id, order_id, user_id, total, wallet, points, open, restock) "
+                             "VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(db, check_sql, -1, &stmt, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, accept_sql, -1, &accept, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (bulk refund): " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    std::vector<int> points;       // earned, per result
+    size_t accepted = 0;
+    bool ok = true;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        RefundResult result;
+        int earned = 0;
+        result.bill_id = sqlite3_column_int(stmt, 0);
+        const unsigned char* status = sqlite3_column_text(stmt, 4);
+        if (!sqlite3_column_int(stmt, 1)) {
+            result.reason = "bill not found";
+        } else if (sqlite3_column_int(stmt, 2)) {
+            result.reason = "already refunded";
+        } else if (!status) {
+            result.reason = "order not found";
+        } else if (std::string(reinterpret_cast<const char*>(status)) == "pending") {
+            result.reason = "order still pending";
+        } else {
+            result.refunded = true;
+            result.order_id = sqlite3_column_int(stmt, 3);
+            result.user_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+            result.amount = sqlite3_column_double(stmt, 6);
+            const unsigned char* method = sqlite3_column_text(stmt, 7);
+            bool registered = !result.user_id.empty() && result.user_id != "guest";
+            result.wallet_credited = registered && method && isWalletPayment(reinterpret_cast<const char*>(method)) &&
+                                     sqlite3_column_int(stmt, 10);
+            // Bills from before loyalty_earned count what the current rate gives.
+            earned = registered ? sqlite3_column_int(stmt, 8) : 0;
+            sqlite3_bind_int(accept, 1, result.bill_id);
+            sqlite3_bind_int(accept, 2, result.order_id);
+            sqlite3_bind_text(accept, 3, result.user_id.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_double(accept, 4, result.amount);
+            sqlite3_bind_int(accept, 5, result.wallet_credited ? 1 : 0);
+            sqlite3_bind_int(accept, 6, earned);
+            sqlite3_bind_int(accept, 7, std::string(reinterpret_cast<const char*>(status)) != "canceled" ? 1 : 0);
+            sqlite3_bind_int(accept, 8, sqlite3_column_int(stmt, 9) == 0 ? 1 : 0);
+            ok = sqlite3_step(accept) == SQLITE_DONE;
+            sqlite3_reset(accept);
+            accepted++;
+        }
+        results.push_back(result);
+        points.push_back(earned);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(accept);
+    if (!ok) {
+        std::cerr << "SQL insert error (refund_bills): " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    if (accepted == 0) {
+        return true;
+    }
+
+    // Statements over refund_bills; ?1 is the time, ?2 the admin. Returns the
+    // rows changed, or -1.
+    long long now = std::time(nullptr);
+    auto run = [&](const char* sql) -> long long {
+        sqlite3_stmt* set;
+        if (sqlite3_prepare_v2(db, sql, -1, &set, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (bulk refund): " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        if (sqlite3_bind_parameter_count(set) >= 1) sqlite3_bind_int64(set, 1, now);
+        if (sqlite3_bind_parameter_count(set) >= 2) sqlite3_bind_text(set, 2, admin_user_id.c_str(), -1, SQLITE_STATIC);
+        long long changed = sqlite3_step(set) == SQLITE_DONE ? sqlite3_changes(db) : -1;
+        if (changed < 0) {
+            std::cerr << "SQL error (bulk refund): " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_finalize(set);
+        return changed;
+    };
+
+    // Billed orders are canceled first, so every refund follows a cancel in
+    // the order log as it does for a single refund.
+    long long canceled = run("INSERT INTO order_events (order_id, type, created_at) "
+                             "SELECT DISTINCT order_id, 'canceled', ?1 FROM refund_bills WHERE open = 1 ORDER BY order_id;");
+    long long refunded = canceled < 0 ? -1 :
+        run("INSERT INTO order_events (order_id, type, amount, bill_id, user_id, created_at) "
+            "SELECT order_id, 'refunded', total, bill_id, NULLIF(?2, ''), ?1 FROM refund_bills ORDER BY bill_id;");
+    long long last_event_id = sqlite3_last_insert_rowid(db);
+    ok = refunded >= 0 &&
+         run("UPDATE orders SET status = 'canceled' WHERE order_id IN (SELECT order_id FROM refund_bills WHERE open = 1);") >= 0 &&
+         run("UPDATE bills SET refunded = 1 WHERE bill_id IN (SELECT bill_id FROM refund_bills);") >= 0;
+    if (ok) {
+        maybeSnapshotOrders(db, last_event_id, canceled + refunded);
+    }
+
+    long long credited = ok ? run("INSERT INTO wallet_transactions (user_id, amount, type, reference, created_at) "
+                                  "SELECT user_id, total, 'refund', 'bill ' || bill_id, ?1 FROM refund_bills "
+                                  "WHERE wallet = 1 ORDER BY bill_id;") : -1;
+    ok = credited >= 0;
+    if (ok && credited > 0) {
+        long long last_txn_id = sqlite3_last_insert_rowid(db);
+        if (last_txn_id / kWalletSnapshotInterval != (last_txn_id - credited) / kWalletSnapshotInterval) {
+            snapshotWallets(db);
+        }
+    }
+
+    // Stock of orders that have not released it yet, with one pass over
+    // order_items for the whole set.
+    std::map<int, int> quantities;
+    std::vector<std::tuple<int, int, int>> levels;   // item_id, quantity, threshold
+    if (ok) {
+        ok = sqlite3_prepare_v2(db, "SELECT item_id, SUM(quantity) FROM order_items WHERE order_id IN "
+                                    "(SELECT order_id FROM refund_bills WHERE restock = 1) GROUP BY item_id;",
+                                -1, &stmt, nullptr) == SQLITE_OK;
+        while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+            quantities[sqlite3_column_int(stmt, 0)] = sqlite3_column_int(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (ok && !quantities.empty()) {
+        const char* restock_sql = "UPDATE inventory SET quantity = quantity + ?1 WHERE item_id = ?2;";
+        const char* level_sql = "SELECT quantity, low_stock_threshold FROM inventory WHERE item_id = ?;";
+        sqlite3_stmt* level = nullptr;
+        ok = sqlite3_prepare_v2(db, restock_sql, -1, &stmt, nullptr) == SQLITE_OK &&
+             sqlite3_prepare_v2(db, level_sql, -1, &level, nullptr) == SQLITE_OK;
+        for (auto it = quantities.begin(); ok && it != quantities.end(); ++it) {
+            sqlite3_bind_int(stmt, 1, it->second);
+            sqlite3_bind_int(stmt, 2, it->first);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+            sqlite3_bind_int(level, 1, it->first);
+            if (ok && sqlite3_step(level) == SQLITE_ROW) {
+                levels.emplace_back(it->first, sqlite3_column_int(level, 0), sqlite3_column_int(level, 1));
+            }
+            sqlite3_reset(level);
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_finalize(level);
+        ok = ok && adjustIngredients(db, recipeBook().requirements(quantities), false);
+        if (!ok) {
+            std::cerr << "SQL update error (refund restock): " << sqlite3_errmsg(db) << std::endl;
+        }
+    }
+    ok = ok && run("UPDATE orders SET stock_released = 1 WHERE order_id IN (SELECT order_id FROM refund_bills WHERE restock = 1);") >= 0;
+
+    // Loyalty: what the bills earned comes back off the balance, as far as
+    // the customer has not spent it. Buffered accruals go in first so they
+    // are part of that balance.
+    std::unordered_map<std::string, int> reversed;
+    bool any_points = std::any_of(points.begin(), points.end(), [](int p) { return p > 0; });
+    if (ok && any_points) {
+        ok = flushLoyaltyAccruals(db) >= 0;
+    }
+    if (ok && any_points) {
+        sqlite3_stmt* take = nullptr;
+        sqlite3_stmt* trans = nullptr;
+        const char* due_sql = "SELECT r.user_id, SUM(r.points), COALESCE(MAX(lp.points), 0) FROM refund_bills r "
+                              "LEFT JOIN loyalty_points lp ON lp.user_id = r.user_id WHERE r.points > 0 GROUP BY r.user_id;";
+        const char* take_sql = "UPDATE loyalty_points SET points = points - ? WHERE user_id = ?;";
+        const char* trans_sql = "INSERT INTO loyalty_transactions (user_id, points, type, timestamp) VALUES (?, ?, 'reversed', ?);";
+        ok = sqlite3_prepare_v2(db, due_sql, -1, &stmt, nullptr) == SQLITE_OK &&
+             sqlite3_prepare_v2(db, take_sql, -1, &take, nullptr) == SQLITE_OK &&
+             sqlite3_prepare_v2(db, trans_sql, -1, &trans, nullptr) == SQLITE_OK;
+        while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string user_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            int due = std::min(sqlite3_column_int(stmt, 1), std::max(0, sqlite3_column_int(stmt, 2)));
+            if (due <= 0) continue;
+            sqlite3_bind_int(take, 1, due);
+            sqlite3_bind_text(take, 2, user_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(trans, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(trans, 2, -due);
+            sqlite3_bind_int64(trans, 3, now);
+            ok = sqlite3_step(take) == SQLITE_DONE && sqlite3_step(trans) == SQLITE_DONE &&
+                 consumeLoyaltyLots(db, user_id, due) >= 0;
+            sqlite3_reset(take);
+            sqlite3_reset(trans);
+            reversed[user_id] = due;
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_finalize(take);
+        sqlite3_finalize(trans);
+        if (!ok) {
+            std::cerr << "SQL update error (refund loyalty): " << sqlite3_errmsg(db) << std::endl;
+        }
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // Each customer's reversal is spread over their bills, oldest first.
+    for (size_t i = 0; i < results.size(); i++) {
+        auto it = reversed.find(results[i].user_id);
+        if (!results[i].refunded || it == reversed.end()) continue;
+        results[i].points_reversed = std::min(points[i], it->second);
+        it->second -= results[i].points_reversed;
+    }
+    for (const auto& item : levels) {
+        syncStockAfterCommit(std::get<0>(item), std::get<1>(item));
+        noteStockLevel(db, std::get<0>(item), std::get<1>(item), std::get<2>(item));
+    }
+    return true;
+}
+
+// Stages bills for refundStagedBills() with `fill`, in one savepoint.
+std::vector<RefundResult> refundBillsWhere(sqlite3* db, const std::string& admin_user_id,
+                                           const std::function<bool(sqlite3*)>& fill) {
+    PROFILE_SCOPE("bulkRefundBills");
+    std::vector<RefundResult> results;
+    const char* setup_sql =
+        "SAVEPOINT bulk_refund;"
+        "CREATE TEMP TABLE IF NOT EXISTS refund_request (bill_id INTEGER PRIMARY KEY);"
+        "CREATE TEMP TABLE IF NOT EXISTS refund_bills (bill_id INTEGER PRIMARY KEY, order_id INTEGER NOT NULL, "
+        "user_id TEXT NOT NULL, total REAL NOT NULL, wallet INTEGER NOT NULL, points INTEGER NOT NULL, "
+        "open INTEGER NOT NULL, restock INTEGER NOT NULL);"
+        "DELETE FROM refund_request;"
+        "DELETE FROM refund_bills;";
+    char* errMsg = nullptr;
+    bool ok = sqlite3_exec(db, setup_sql, nullptr, nullptr, &errMsg) == SQLITE_OK;
+    if (!ok) {
+        std::cerr << "Bulk refund error: " << (errMsg ? errMsg : "") << std::endl;
+        sqlite3_free(errMsg);
+    }
+    ok = ok && fill(db) && refundStagedBills(db, admin_user_id, results);
+    if (!ok) {
+        sqlite3_exec(db, "ROLLBACK TO bulk_refund; RELEASE bulk_refund;", nullptr, nullptr, nullptr);
+        for (auto& result : results) {
+            if (result.refunded) {
+                RefundResult failed;
+                failed.bill_id = result.bill_id;
+                failed.reason = "database error";
+                result = failed;
+            }
+        }
+        return results;
+    }
+    sqlite3_exec(db, "DELETE FROM refund_request; DELETE FROM refund_bills; RELEASE bulk_refund;", nullptr, nullptr, nullptr);
+
+    int count = 0;
+    double amount = 0;
+    for (const auto& result : results) {
+        if (!result.refunded) continue;
+        count++;
+        amount += result.amount;
+    }
+    if (count == 1) {
+        for (const auto& result : results) {
+            if (result.refunded) logActivity(db, admin_user_id, "Refund processed for bill_id: " + std::to_string(result.bill_id));
+        }
+    } else if (count > 1) {
+        logActivity(db, admin_user_id, "Bulk refund: " + std::to_string(count) + " bills, Rs " + std::to_string(amount));
+    }
+    if (count > 0) countAfterCommit(metrics().refunds, count);
+    return results;
+}
 
-        if (refunded || status != "canceled") {
-            sqlite3_finalize(stmt);
+// Refunds bills in one transaction: orders canceled, wallet payments
+// credited back, unreleased stock returned and earned loyalty points
+// reversed. One result per distinct bill_id, in bill_id order.
+std::vector<RefundResult> bulkRefundBills(sqlite3* db, const std::vector<int>& bill_ids, const std::string& admin_user_id) {
+    return refundBillsWhere(db, admin_user_id, [&](sqlite3* wdb) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(wdb, "INSERT OR IGNORE INTO refund_request (bill_id) VALUES (?);", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (refund_request): " << sqlite3_errmsg(wdb) << std::endl;
             return false;
         }
-
-        const char* update_sql = "UPDATE bills SET refunded = 1 WHERE bill_id = ?;";
-        if (sqlite3_prepare_v2(db, update_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, bill_id);
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "SQL update error (bills): " << sqlite3_errmsg(db) << std::endl;
-                sqlite3_finalize(stmt);
-                return false;
-            }
-            sqlite3_finalize(stmt);
+        bool ok = true;
+        for (size_t i = 0; ok && i < bill_ids.size(); i++) {
+            sqlite3_bind_int(stmt, 1, bill_ids[i]);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
         }
+        sqlite3_finalize(stmt);
+        return ok;
+    });
+}
 
-        if (payment_method == "wallet" && !user_id.empty()) {
-            const char* wallet_sql = "UPDATE wallets SET balance = balance + ? WHERE user_id = ?;";
-            if (sqlite3_prepare_v2(db, wallet_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-                sqlite3_bind_double(stmt, 1, total);
-                sqlite3_bind_text(stmt, 2, user_id.c_str(), -1, SQLITE_STATIC);
-                if (sqlite3_step(stmt) != SQLITE_DONE) {
-                    std::cerr << "SQL update error (wallets): " << sqlite3_errmsg(db) << std::endl;
-                    sqlite3_finalize(stmt);
-                    return false;
-                }
-                sqlite3_finalize(stmt);
-            }
+// Refunds every unrefunded bill matching `filter`.
+std::vector<RefundResult> bulkRefundBills(sqlite3* db, const RefundFilter& filter, const std::string& admin_user_id) {
+    return refundBillsWhere(db, admin_user_id, [&](sqlite3* wdb) {
+        sqlite3_stmt* stmt;
+        const char* sql = "INSERT OR IGNORE INTO refund_request (bill_id) SELECT b.bill_id FROM bills b "
+                          "WHERE b.refunded = 0 AND (?1 = 0 OR b.created_at >= ?1) AND (?2 = 0 OR b.created_at <= ?2) "
+                          "AND (?3 = '' OR lower(b.payment_method) = lower(?3)) "
+                          "AND (?4 = 0 OR b.order_id IN (SELECT order_id FROM order_items WHERE item_id = ?4));";
+        if (sqlite3_prepare_v2(wdb, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (refund_request): " << sqlite3_errmsg(wdb) << std::endl;
+            return false;
         }
+        sqlite3_bind_int(stmt, 1, filter.from);
+        sqlite3_bind_int(stmt, 2, filter.to);
+        sqlite3_bind_text(stmt, 3, filter.payment_method.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, filter.item_id);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        return ok;
+    });
+}
 
-        logActivity(db, admin_user_id, "Refund processed for bill_id: " + std::to_string(bill_id));
-        success = true;
-    }
-    sqlite3_finalize(stmt);
-    return success;
+bool processRefund(sqlite3* db, int bill_id, const std::string& admin_user_id) {
+    std::vector<RefundResult> results = bulkRefundBills(db, std::vector<int>{bill_id}, admin_user_id);
+    return results.size() == 1 && results[0].refunded;
 }
 
 bool userExists(sqlite3* db, const std::string& user_id) {
@@ -745,138 +2349,357 @@ bool userExists(sqlite3* db, const std::string& user_id) {
 }
 
 float getWalletBalance(sqlite3* db, const std::string& user_id) {
+    PROFILE_SCOPE("getWalletBalance");
+    // Inside a transaction we may see rows that are later rolled back: do not cache those.
+    bool committed = sqlite3_get_autocommit(db) != 0;
+    double cached = 0.0;
+    long long through = 0;
+    bool hit = committed && walletCache().get(user_id, cached, through);
     sqlite3_stmt* stmt;
-    const char* sql = "SELECT balance FROM wallets WHERE user_id = ?;";
-    float balance = 0.0f;
+    const char* sql = hit ? "SELECT ?2 + COALESCE(SUM(t.amount), 0), COALESCE(MAX(t.txn_id), ?3) FROM wallets w "
+                            "LEFT JOIN wallet_transactions t ON t.user_id = w.user_id AND t.txn_id > ?3 WHERE w.user_id = ?1 "
+                            "GROUP BY w.user_id;"
+                          : "SELECT " WALLET_BALANCE_SQL ", (SELECT COALESCE(MAX(txn_id), 0) FROM wallet_transactions) "
+                            "FROM wallets w WHERE w.user_id = ?1;";
+    double balance = 0.0;
+    bool found = false;
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
+        if (hit) {
+            sqlite3_bind_double(stmt, 2, cached);
+            sqlite3_bind_int64(stmt, 3, through);
+        }
         if (sqlite3_step(stmt) == SQLITE_ROW) {
             balance = sqlite3_column_double(stmt, 0);
+            through = sqlite3_column_int64(stmt, 1);
+            found = true;
         }
         sqlite3_finalize(stmt);
     }
-    return balance;
-}
-
-int getLoyaltyPoints(sqlite3* db, const std::string& user_id) {
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT points FROM loyalty_points WHERE user_id = ?;";
-    int points = 0;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            points = sqlite3_column_int(stmt, 0);
-        }
-        sqlite3_finalize(stmt);
+    if (found && committed) {
+        walletCache().put(user_id, balance, through);
+    } else if (!found) {
+        walletCache().erase(user_id);
     }
-    return points;
+    return static_cast<float>(balance);
 }
 
-int createOrder(sqlite3* db, const std::string& user_id, const std::vector<OrderItem>& items) {
+// Creates a pending order and takes its stock from inventory. With
+// `reserved`, the cart already holds the stock (reserveOrderItem) and the
+// hold is committed; otherwise it is reserved here first. Inventory is
+// checked and decremented with one statement each for the whole cart, which
+// also catches stock taken by another terminal since the counters were synced.
+// Items with a recipe also take their ingredients (adjustIngredients).
+int createOrder(sqlite3* db, const std::string& user_id, const std::vector<OrderItem>& items, bool reserved = false) {
     if (!userExists(db, user_id)) {
         std::cerr << "User ID does not exist: " << user_id << std::endl;
         return -1;
     }
 
     float total = 0;
+    std::map<int, int> quantities;
     for (const auto& item : items) {
         total += item.quantity * item.price;
+        quantities[item.item_id] += item.quantity;
+    }
+    if (quantities.empty()) {
+        return -1;
     }
 
-    bool sufficient_stock = true;
-    for (const auto& item : items) {
-        sqlite3_stmt* stmt;
-        const char* sql = "SELECT quantity FROM inventory WHERE item_id = ?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, item.item_id);
-            if (sqlite3_step(stmt) == SQLITE_ROW) {
-                int current_quantity = sqlite3_column_int(stmt, 0);
-                if (current_quantity < item.quantity) {
-                    sufficient_stock = false;
-                    std::cerr << "Insufficient stock for item_id: " << item.item_id << std::endl;
+    StockReservations& reservations = stockReservations();
+    if (!reserved) {
+        for (auto it = quantities.begin(); it != quantities.end(); ++it) {
+            if (!reservations.reserve(it->first, it->second)) {
+                std::cerr << "Insufficient stock for item_id: " << it->first << std::endl;
+                for (auto held = quantities.begin(); held != it; ++held) {
+                    reservations.release(held->first, held->second);
                 }
+                return -1;
             }
-            sqlite3_finalize(stmt);
         }
     }
 
-    if (!sufficient_stock) {
-        return -1;
+    // cart(item_id, quantity) for the statements below.
+    std::string cart = "WITH cart(item_id, quantity) AS (VALUES ";
+    for (size_t i = 0; i < quantities.size(); i++) {
+        cart += i == 0 ? "(?, ?)" : ", (?, ?)";
     }
+    cart += ") ";
+    auto bindCart = [&](sqlite3_stmt* stmt) {
+        int index = 1;
+        for (const auto& entry : quantities) {
+            sqlite3_bind_int(stmt, index++, entry.first);
+            sqlite3_bind_int(stmt, index++, entry.second);
+        }
+    };
 
+    sqlite3_exec(db, "SAVEPOINT create_order;", nullptr, nullptr, nullptr);
+    bool ok = true;
     sqlite3_stmt* stmt;
+    std::string short_sql = cart + "SELECT i.item_id, i.quantity FROM cart JOIN inventory i ON i.item_id = cart.item_id "
+                                   "WHERE i.quantity < cart.quantity;";
+    if (sqlite3_prepare_v2(db, short_sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        bindCart(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int item_id = sqlite3_column_int(stmt, 0);
+            std::cerr << "Insufficient stock for item_id: " << item_id << std::endl;
+            reservations.sync(item_id, sqlite3_column_int(stmt, 1));
+            ok = false;
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        std::cerr << "SQL prepare error (stock check): " << sqlite3_errmsg(db) << std::endl;
+        ok = false;
+    }
+
     const char* sql = "INSERT INTO orders (user_id, status, total, created_at) VALUES (?, 'pending', ?, ?);";
     int order_id = -1;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    long long created_at = std::time(nullptr);
+    if (ok && sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         if (user_id.empty() || user_id == "guest") {
             sqlite3_bind_null(stmt, 1);
         } else {
             sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
         }
         sqlite3_bind_double(stmt, 2, total);
-        sqlite3_bind_int(stmt, 3, std::time(nullptr));
+        sqlite3_bind_int64(stmt, 3, created_at);
         if (sqlite3_step(stmt) == SQLITE_DONE) {
             order_id = sqlite3_last_insert_rowid(db);
         }
         sqlite3_finalize(stmt);
     }
+    ok = ok && order_id != -1;
 
-    if (order_id != -1) {
+    const char* item_sql = "INSERT INTO order_items (order_id, item_id, quantity, price) VALUES (?, ?, ?, ?);";
+    if (ok && sqlite3_prepare_v2(db, item_sql, -1, &stmt, nullptr) == SQLITE_OK) {
         for (const auto& item : items) {
-            const char* item_sql = "INSERT INTO order_items (order_id, item_id, quantity, price) VALUES (?, ?, ?, ?);";
-            if (sqlite3_prepare_v2(db, item_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-                sqlite3_bind_int(stmt, 1, order_id);
-                sqlite3_bind_int(stmt, 2, item.item_id);
-                sqlite3_bind_int(stmt, 3, item.quantity);
-                sqlite3_bind_double(stmt, 4, item.price);
-                if (sqlite3_step(stmt) != SQLITE_DONE) {
-                    std::cerr << "SQL insert error: " << sqlite3_errmsg(db) << std::endl;
-                }
-                sqlite3_finalize(stmt);
+            sqlite3_bind_int(stmt, 1, order_id);
+            sqlite3_bind_int(stmt, 2, item.item_id);
+            sqlite3_bind_int(stmt, 3, item.quantity);
+            sqlite3_bind_double(stmt, 4, item.price);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::cerr << "SQL insert error: " << sqlite3_errmsg(db) << std::endl;
+                ok = false;
+                break;
             }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    }
+    std::vector<OrderEvent> events(1);
+    events[0].order_id = order_id;
+    events[0].amount = total;
+    events[0].user_id = user_id == "guest" ? "" : user_id;
+    events[0].created_at = created_at;
+    for (const auto& item : items) {
+        OrderEvent line;
+        line.order_id = order_id;
+        line.type = OrderEventType::ITEM_ADDED;
+        line.item_id = item.item_id;
+        line.quantity = item.quantity;
+        line.amount = item.price;
+        line.created_at = created_at;
+        events.push_back(line);
+    }
+    ok = ok && appendOrderEvents(db, events);
 
-            const char* update_sql = "UPDATE inventory SET quantity = quantity - ? WHERE item_id = ?;";
-            if (sqlite3_prepare_v2(db, update_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-                sqlite3_bind_int(stmt, 1, item.quantity);
-                sqlite3_bind_int(stmt, 2, item.item_id);
-                if (sqlite3_step(stmt) != SQLITE_DONE) {
-                    std::cerr << "SQL update error (inventory): " << sqlite3_errmsg(db) << std::endl;
-                }
-                sqlite3_finalize(stmt);
-            }
+    std::string update_sql = cart + "UPDATE inventory SET quantity = quantity - "
+                                    "(SELECT quantity FROM cart WHERE cart.item_id = inventory.item_id) "
+                                    "WHERE item_id IN (SELECT item_id FROM cart);";
+    if (ok && sqlite3_prepare_v2(db, update_sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        bindCart(stmt);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "SQL update error (inventory): " << sqlite3_errmsg(db) << std::endl;
+            ok = false;
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // Ingredients for the whole cart, taken in one pass.
+    ok = ok && adjustIngredients(db, recipeBook().requirements(quantities), true);
+
+    // Items this order took to or below their threshold.
+    std::string crossed_sql = cart + "SELECT i.item_id, i.quantity, i.low_stock_threshold FROM cart "
+                                     "JOIN inventory i ON i.item_id = cart.item_id "
+                                     "WHERE i.quantity <= i.low_stock_threshold AND i.quantity + cart.quantity > i.low_stock_threshold;";
+    if (ok && sqlite3_prepare_v2(db, crossed_sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        bindCart(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            noteStockLevel(db, sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (!ok) {
+        sqlite3_exec(db, "ROLLBACK TO create_order;", nullptr, nullptr, nullptr);
+    }
+    sqlite3_exec(db, "RELEASE create_order;", nullptr, nullptr, nullptr);
+    if (!ok) {
+        if (!reserved) {
+            for (const auto& entry : quantities) reservations.release(entry.first, entry.second);
         }
-        logActivity(db, user_id, "Order created: order_id " + std::to_string(order_id));
+        return -1;
+    }
+    // The held units become inventory's once the order commits. If the write
+    // rolls back after all, units reserved here go back; a caller's cart
+    // keeps the ones it holds.
+    WriteQueue::afterCommit([&reservations, quantities] {
+        for (const auto& entry : quantities) reservations.commit(entry.first, entry.second);
+    });
+    if (!reserved) {
+        WriteQueue::onRollback([&reservations, quantities] {
+            for (const auto& entry : quantities) reservations.release(entry.first, entry.second);
+        });
     }
+    WriteQueue::afterCommit([order_id, created_at, quantities] { demandForecaster().observe(order_id, created_at, quantities); });
+    KitchenEvent ticket;
+    ticket.ticket.order_id = order_id;
+    ticket.ticket.created_at = created_at;
+    for (const auto& entry : quantities) {
+        KitchenLine line;
+        line.item_id = entry.first;
+        line.quantity = entry.second;
+        ticket.ticket.lines.push_back(line);
+    }
+    postKitchenEvent(std::move(ticket));
+    logActivity(db, user_id, "Order created: order_id " + std::to_string(order_id));
+    countAfterCommit(metrics().orders_created);
     return order_id;
 }
 
+// Cancels an order. A pending order's stock goes back to inventory, once:
+// orders.stock_released records that it has been returned.
 void cancelOrder(sqlite3* db, int order_id) {
     sqlite3_stmt* stmt;
-    const char* sql = "UPDATE orders SET status = 'canceled' WHERE order_id = ?;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    const char* release_sql = "UPDATE orders SET stock_released = 1 WHERE order_id = ? AND status = 'pending' AND stock_released = 0;";
+    bool release = false;
+    if (sqlite3_prepare_v2(db, release_sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_int(stmt, 1, order_id);
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             std::cerr << "SQL update error: " << sqlite3_errmsg(db) << std::endl;
         }
+        release = sqlite3_changes(db) > 0;
         sqlite3_finalize(stmt);
     }
+    if (release) {
+        const char* restock_sql = "UPDATE inventory SET quantity = quantity + "
+                                  "(SELECT SUM(oi.quantity) FROM order_items oi WHERE oi.order_id = ?1 AND oi.item_id = inventory.item_id) "
+                                  "WHERE item_id IN (SELECT item_id FROM order_items WHERE order_id = ?1);";
+        if (sqlite3_prepare_v2(db, restock_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, order_id);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::cerr << "SQL update error (inventory): " << sqlite3_errmsg(db) << std::endl;
+            }
+            sqlite3_finalize(stmt);
+        }
+        const char* synced_sql = "SELECT item_id, quantity, low_stock_threshold FROM inventory "
+                                 "WHERE item_id IN (SELECT item_id FROM order_items WHERE order_id = ?);";
+        if (sqlite3_prepare_v2(db, synced_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, order_id);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                syncStockAfterCommit(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+                noteStockLevel(db, sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2));
+            }
+            sqlite3_finalize(stmt);
+        }
+        // Ingredients go back by the current recipes.
+        std::map<int, int> quantities;
+        const char* items_sql = "SELECT item_id, SUM(quantity) FROM order_items WHERE order_id = ? GROUP BY item_id;";
+        if (sqlite3_prepare_v2(db, items_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, order_id);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                quantities[sqlite3_column_int(stmt, 0)] = sqlite3_column_int(stmt, 1);
+            }
+            sqlite3_finalize(stmt);
+        }
+        adjustIngredients(db, recipeBook().requirements(quantities), false);
+    }
+
+    OrderEvent canceled;
+    canceled.order_id = order_id;
+    canceled.type = OrderEventType::CANCELED;
+    appendOrderEvent(db, canceled, "o.status <> 'canceled'");
+    KitchenEvent done;
+    done.type = KitchenEvent::REMOVE;
+    done.ticket.order_id = order_id;
+    postKitchenEvent(std::move(done));
     logActivity(db, "", "Order canceled: order_id " + std::to_string(order_id));
 }
 
 void completeOrder(sqlite3* db, int order_id) {
+    OrderEvent completed;
+    completed.order_id = order_id;
+    completed.type = OrderEventType::COMPLETED;
+    appendOrderEvent(db, completed, "o.status <> 'completed'");
+    KitchenEvent done;
+    done.type = KitchenEvent::REMOVE;
+    done.ticket.order_id = order_id;
+    postKitchenEvent(std::move(done));
+    logActivity(db, "", "Order completed: order_id " + std::to_string(order_id));
+}
+
+// Flags a pending order to be cooked ahead of older ones.
+void setOrderRush(sqlite3* db, int order_id, bool rush) {
+    OrderEvent flagged;
+    flagged.order_id = order_id;
+    flagged.type = OrderEventType::RUSH;
+    flagged.quantity = rush ? 1 : 0;
+    if (appendOrderEvent(db, flagged, rush ? "o.status = 'pending' AND o.rush = 0" : "o.status = 'pending' AND o.rush <> 0") > 0) {
+        KitchenEvent event;
+        event.type = KitchenEvent::RUSH;
+        event.ticket.order_id = order_id;
+        event.ticket.rush = rush;
+        postKitchenEvent(std::move(event));
+    }
+}
+
+// Refills the kitchen display from the database: at startup, after a restore
+// and when another connection commits. Otherwise the order writes keep it
+// current.
+void loadKitchenQueue(sqlite3* db) {
+    KitchenEvent clear;
+    clear.type = KitchenEvent::CLEAR;
+    kitchenQueue().post(std::move(clear));
     sqlite3_stmt* stmt;
-    const char* sql = "UPDATE orders SET status = 'completed' WHERE order_id = ?;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, order_id);
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            std::cerr << "SQL update error: " << sqlite3_errmsg(db) << std::endl;
+    if (sqlite3_prepare_v2(db, "SELECT item_id, name, station FROM menu_items;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            KitchenEvent item;
+            item.type = KitchenEvent::MENU_ITEM;
+            item.item_id = sqlite3_column_int(stmt, 0);
+            item.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            item.station = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            kitchenQueue().post(std::move(item));
         }
         sqlite3_finalize(stmt);
     }
-    logActivity(db, "", "Order completed: order_id " + std::to_string(order_id));
+    const char* sql = "SELECT o.order_id, o.created_at, o.rush, oi.item_id, SUM(oi.quantity) FROM orders o "
+                      "JOIN order_items oi ON oi.order_id = o.order_id WHERE o.status = 'pending' "
+                      "GROUP BY o.order_id, oi.item_id ORDER BY o.order_id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (kitchen queue): " << sqlite3_errmsg(db) << std::endl;
+        return;
+    }
+    KitchenEvent ticket;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int order_id = sqlite3_column_int(stmt, 0);
+        if (order_id != ticket.ticket.order_id) {
+            if (ticket.ticket.order_id) kitchenQueue().post(std::move(ticket));
+            ticket = KitchenEvent();
+            ticket.ticket.order_id = order_id;
+            ticket.ticket.created_at = sqlite3_column_int64(stmt, 1);
+            ticket.ticket.rush = sqlite3_column_int(stmt, 2) != 0;
+        }
+        KitchenLine line;
+        line.item_id = sqlite3_column_int(stmt, 3);
+        line.quantity = sqlite3_column_int(stmt, 4);
+        ticket.ticket.lines.push_back(line);
+    }
+    if (ticket.ticket.order_id) kitchenQueue().post(std::move(ticket));
+    sqlite3_finalize(stmt);
 }
 
 std::vector<Order> viewOrders(sqlite3* db, bool completed_only = false) {
+    PROFILE_SCOPE("viewOrders");
     std::vector<Order> orders;
     sqlite3_stmt* stmt;
     std::string sql = completed_only ?
@@ -913,6 +2736,7 @@ std::vector<Order> viewOrders(sqlite3* db, bool completed_only = false) {
 }
 
 std::vector<Bill> viewBills(sqlite3* db) {
+    PROFILE_SCOPE("viewBills");
     std::vector<Bill> bills;
     sqlite3_stmt* stmt;
     const char* sql = "SELECT bill_id, order_id, tax, total, payment_method, created_at, refunded FROM bills;";
@@ -937,54 +2761,69 @@ std::vector<Bill> viewBills(sqlite3* db) {
 
 
 
-bool saveBillAsPDF(sqlite3* db, int bill_id) {
+// Reads a bill for reprinting: its snapshot when it has one, otherwise
+// (bills from before snapshots) rebuilt from the order's rows with the
+// menu's current names and the discounts folded into one amount.
+bool loadBillSnapshot(sqlite3* db, int bill_id, BillSnapshot& bill) {
+    PROFILE_SCOPE("loadBillSnapshot");
     sqlite3_stmt* stmt;
-    const char* bill_sql = "SELECT b.bill_id, b.order_id, b.tax, b.total, b.payment_method, b.created_at "
-                           "FROM bills b WHERE b.bill_id = ?;";
+    const char* bill_sql = "SELECT snapshot, order_id, tax, total, payment_method, created_at FROM bills WHERE bill_id = ?;";
     if (sqlite3_prepare_v2(db, bill_sql, -1, &stmt, nullptr) != SQLITE_OK) {
         std::cerr << "SQL prepare error: " << sqlite3_errmsg(db) << std::endl;
         return false;
     }
-
     sqlite3_bind_int(stmt, 1, bill_id);
-    bool success = false;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        Bill bill;
-        bill.bill_id = sqlite3_column_int(stmt, 0);
-        bill.order_id = sqlite3_column_int(stmt, 1);
-        bill.tax = sqlite3_column_double(stmt, 2);
-        bill.total = sqlite3_column_double(stmt, 3);
-        bill.payment_method = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        bill.created_at = sqlite3_column_int(stmt, 5);
-
-        std::vector<OrderItem> items;
-        const char* item_sql = "SELECT oi.item_id, mi.name, oi.quantity, oi.price "
-                               "FROM order_items oi JOIN menu_items mi ON oi.item_id = mi.item_id "
-                               "WHERE oi.order_id = ?;";
-        sqlite3_stmt* item_stmt;
-        if (sqlite3_prepare_v2(db, item_sql, -1, &item_stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(item_stmt, 1, bill.order_id);
-            while (sqlite3_step(item_stmt) == SQLITE_ROW) {
-                OrderItem item;
-                item.item_id = sqlite3_column_int(item_stmt, 0);
-                item.name = reinterpret_cast<const char*>(sqlite3_column_text(item_stmt, 1));
-                item.quantity = sqlite3_column_int(item_stmt, 2);
-                item.price = sqlite3_column_double(item_stmt, 3);
-                items.push_back(item);
-            }
-            sqlite3_finalize(item_stmt);
-        } else {
-            std::cerr << "SQL prepare error for items: " << sqlite3_errmsg(db) << std::endl;
-            sqlite3_finalize(stmt);
-            return false;
-        }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    bill = BillSnapshot();
+    bill.bill_id = bill_id;
+    if (decodeBillSnapshot(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0), bill)) {
+        sqlite3_finalize(stmt);
+        return true;
+    }
+    if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        std::cerr << "Unreadable snapshot for bill " << bill_id << "; reprinting from the order" << std::endl;
+    }
+    bill.order_id = sqlite3_column_int(stmt, 1);
+    bill.tax = sqlite3_column_double(stmt, 2);
+    bill.total = sqlite3_column_double(stmt, 3);
+    bill.payment_method = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+    bill.created_at = sqlite3_column_int(stmt, 5);
+    sqlite3_finalize(stmt);
+
+    const char* item_sql = "SELECT oi.item_id, mi.name, oi.quantity, oi.price "
+                           "FROM order_items oi JOIN menu_items mi ON oi.item_id = mi.item_id WHERE oi.order_id = ?;";
+    if (sqlite3_prepare_v2(db, item_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error for items: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, bill.order_id);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        BillSnapshotLine line;
+        line.item_id = sqlite3_column_int(stmt, 0);
+        line.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        line.quantity = sqlite3_column_int(stmt, 2);
+        line.price = sqlite3_column_double(stmt, 3);
+        bill.subtotal += line.quantity * line.price;
+        bill.lines.push_back(line);
+    }
+    sqlite3_finalize(stmt);
+    double discount = bill.subtotal - (bill.total - bill.tax);
+    bill.discount = discount >= 0.005 ? discount : 0.0;
+    return true;
+}
 
+bool saveBillAsPDF(sqlite3* db, int bill_id) {
+    BillSnapshot bill;
+    bool success = false;
+    if (loadBillSnapshot(db, bill_id, bill)) {
         std::string bills_dir = "/Users/rudra/Library/Mobile Documents/com~apple~CloudDocs/RUDRA FILES/SEM-2/Hackathon/bills/";
         try {
             std::filesystem::create_directories(bills_dir);
         } catch (const std::exception& e) {
             std::cerr << "Failed to create bills directory: " << e.what() << std::endl;
-            sqlite3_finalize(stmt);
             return false;
         }
 
@@ -1007,7 +2846,7 @@ bool saveBillAsPDF(sqlite3* db, int bill_id) {
                  << "\\begin{tabular}{lr}\n"
                  << "Bill ID: & " << bill.bill_id << " \\\\\n"
                  << "Order ID: & " << bill.order_id << " \\\\\n"
-                 << "Date: & " << formatTimestamp(bill.created_at) << " \\\\\n"
+                 << "Date: & " << formatTimestamp(static_cast<int>(bill.created_at)) << " \\\\\n"
                  << "\\end{tabular}\n"
                  << "\\vspace{0.5cm}\n"
                  << "\\begin{tabular}{llrr}\n"
@@ -1015,7 +2854,7 @@ bool saveBillAsPDF(sqlite3* db, int bill_id) {
                  << "Item & Quantity & Price (Rs) & Total (Rs) \\\\\n"
                  << "\\midrule\n";
 
-            for (const auto& item : items) {
+            for (const auto& item : bill.lines) {
                 std::string escaped_name = item.name;
                 for (char& c : escaped_name) {
                     if (c == '&' || c == '%' || c == '$' || c == '#' || c == '_' || c == '{' || c == '}')
@@ -1028,7 +2867,14 @@ bool saveBillAsPDF(sqlite3* db, int bill_id) {
                  << "\\end{tabular}\n"
                  << "\\vspace{0.5cm}\n"
                  << "\\begin{tabular}{lr}\n"
-                 << "Tax: & Rs \\num{" << bill.tax << "} \\\\\n"
+                 << "Subtotal: & Rs \\num{" << bill.subtotal << "} \\\\\n";
+            if (bill.discount > 0) {
+                file << "Discount: & Rs -\\num{" << bill.discount << "} \\\\\n";
+            }
+            if (bill.loyalty_points > 0) {
+                file << "Loyalty (" << bill.loyalty_points << " points): & Rs -\\num{" << bill.loyalty_discount << "} \\\\\n";
+            }
+            file << "Tax: & Rs \\num{" << bill.tax << "} \\\\\n"
                  << "Total: & Rs \\num{" << bill.total << "} \\\\\n"
                  << "Payment Method: & " << bill.payment_method << " \\\\\n"
                  << "\\end{tabular}\n"
@@ -1050,10 +2896,47 @@ bool saveBillAsPDF(sqlite3* db, int bill_id) {
             success = false;
         }
     }
-    sqlite3_finalize(stmt);
     return success;
 }
 
+// The receipt for a bill as ESC/POS bytes, ready for the printer.
+std::string renderReceipt(const BillSnapshot& bill) {
+    EscPosWriter receipt;
+    receipt.align(EscPosWriter::CENTER).bold(true).large(true).line("CANTEEN").large(false).bold(false);
+    receipt.line("Bill #" + std::to_string(bill.bill_id) + "  Order #" + std::to_string(bill.order_id));
+    receipt.line(formatTimestamp(static_cast<int>(bill.created_at)));
+    receipt.align(EscPosWriter::LEFT).rule();
+    for (const auto& line : bill.lines) {
+        receipt.columns(std::to_string(line.quantity) + " x " + line.name, EscPosWriter::amount(line.quantity * line.price));
+    }
+    receipt.rule();
+    receipt.columns("Subtotal", EscPosWriter::amount(bill.subtotal));
+    if (bill.discount > 0) {
+        receipt.columns("Discount", EscPosWriter::amount(-bill.discount));
+    }
+    if (bill.loyalty_points > 0) {
+        receipt.columns("Loyalty (" + std::to_string(bill.loyalty_points) + " pts)", EscPosWriter::amount(-bill.loyalty_discount));
+    }
+    receipt.columns("Tax", EscPosWriter::amount(bill.tax));
+    receipt.bold(true).columns("TOTAL (Rs)", EscPosWriter::amount(bill.total)).bold(false);
+    receipt.line("Paid by " + bill.payment_method);
+    if (!bill.customer.empty()) receipt.line("Customer: " + bill.customer);
+    if (!bill.biller.empty()) receipt.line("Billed by: " + bill.biller);
+    receipt.align(EscPosWriter::CENTER).feed(1).line("Thank you!").feed(3).cut();
+    return receipt.bytes();
+}
+
+// Queues a bill's receipt for CANTEEN_PRINTER; false if no printer is set
+// or the bill is missing.
+bool printBillReceipt(sqlite3* db, int bill_id) {
+    BillSnapshot bill;
+    if (!printer_queue || !loadBillSnapshot(db, bill_id, bill)) {
+        return false;
+    }
+    printer_queue->submit(renderReceipt(bill), "bill " + std::to_string(bill_id));
+    return true;
+}
+
 
 
 
@@ -1082,42 +2965,28 @@ bool createWallet(sqlite3* db, const std::string& phone_number, float initial_ba
         return false;
     }
 
-    const char* insert_sql = "INSERT INTO wallets (user_id, balance) VALUES (?, ?);";
-    bool success = false;
-    if (sqlite3_prepare_v2(db, insert_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, phone_number.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 2, initial_balance);
-        if (sqlite3_step(stmt) == SQLITE_DONE) {
-            success = true;
-            logActivity(db, phone_number, "Wallet created with phone number: " + phone_number);
-        } else {
-            std::cerr << "SQL insert error (wallets): " << sqlite3_errmsg(db) << std::endl;
-        }
-        sqlite3_finalize(stmt);
+    walletCache().erase(phone_number);
+    bool success = ensureWallet(db, phone_number);
+    if (success && initial_balance > 0) {
+        success = appendWalletTxn(db, phone_number, initial_balance, "opening", "") > 0;
+    }
+    if (success) {
+        logActivity(db, phone_number, "Wallet created with phone number: " + phone_number);
     }
-
     return success;
 }
 
 void topUpWallet(sqlite3* db, const std::string& user_id, float amount) {
-    sqlite3_stmt* stmt;
-    const char* sql = "INSERT OR REPLACE INTO wallets (user_id, balance) VALUES (?, COALESCE((SELECT balance FROM wallets WHERE user_id = ?) + ?, ?));";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, user_id.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 3, amount);
-        sqlite3_bind_double(stmt, 4, amount);
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            std::cerr << "SQL insert error: " << sqlite3_errmsg(db) << std::endl;
-        }
-        sqlite3_finalize(stmt);
+    // An append, not a read-modify-write of the wallet row.
+    if (ensureWallet(db, user_id)) {
+        appendWalletTxn(db, user_id, amount, "topup", "");
     }
     logActivity(db, user_id, "Wallet topped up: " + std::to_string(amount));
 }
 
 void deleteWallet(sqlite3* db, const std::string& user_id) {
     sqlite3_stmt* stmt;
-    const char* check_sql = "SELECT balance FROM wallets WHERE user_id = ?;";
+    const char* check_sql = "SELECT " WALLET_BALANCE_SQL " FROM wallets w WHERE w.user_id = ?;";
     float balance = -1;
     if (sqlite3_prepare_v2(db, check_sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
@@ -1126,7 +2995,9 @@ void deleteWallet(sqlite3* db, const std::string& user_id) {
         }
         sqlite3_finalize(stmt);
     }
-    if (balance == 0) {
+    walletCache().erase(user_id);
+    // Ledger rows stay behind as history; a new wallet with this id starts after them.
+    if (std::fabs(balance) < 0.005f) {
         const char* sql = "DELETE FROM wallets WHERE user_id = ?;";
         if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_STATIC);
@@ -1142,9 +3013,10 @@ void deleteWallet(sqlite3* db, const std::string& user_id) {
 }
 
 std::vector<Wallet> viewWallets(sqlite3* db) {
+    PROFILE_SCOPE("viewWallets");
     std::vector<Wallet> wallets;
     sqlite3_stmt* stmt;
-    const char* sql = "SELECT user_id, balance FROM wallets;";
+    const char* sql = "SELECT w.user_id, " WALLET_BALANCE_SQL " FROM wallets w;";
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             Wallet wallet;
@@ -1157,7 +3029,22 @@ std::vector<Wallet> viewWallets(sqlite3* db) {
     return wallets;
 }
 
+// Changes whenever another connection (the writer thread, AdminPanel) commits.
+int getDataVersion(sqlite3* db) {
+    PROFILE_SCOPE("getDataVersion");
+    sqlite3_stmt* stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
 float getSetting(sqlite3* db, const std::string& key, float default_value) {
+    PROFILE_SCOPE("getSetting");
     sqlite3_stmt* stmt;
     const char* sql = "SELECT value FROM settings WHERE key = ?;";
     float value = default_value;
@@ -1231,9 +3118,21 @@ bool generateBill(sqlite3* db, int order_id, const std::string& payment_method,
         return false;
     }
 
+    BillSnapshot snapshot;
+    snapshot.order_id = order_id;
+    snapshot.customer = order_user_id == "guest" ? "" : order_user_id;
+    snapshot.biller = user_id;
+    snapshot.payment_method = payment_method;
+    snapshot.subtotal = order_total;
+    for (const auto& item : items) {
+        snapshot.lines.push_back({item.item_id, item.name, item.quantity, item.price});
+    }
+
     // Apply discount
     if (discount_id > 0) {
         order_total = applyDiscount(db, discount_id, order_total, items);
+        snapshot.discount_id = discount_id;
+        snapshot.discount = snapshot.subtotal - order_total;
     }
 
     // Apply loyalty points
@@ -1244,6 +3143,8 @@ bool generateBill(sqlite3* db, int order_id, const std::string& payment_method,
             return false;
         }
         order_total = std::max(0.0f, order_total - loyalty_discount);
+        snapshot.loyalty_points = loyalty_points_to_redeem;
+        snapshot.loyalty_discount = loyalty_discount;
     }
 
     // Calculate tax and total
@@ -1251,39 +3152,44 @@ bool generateBill(sqlite3* db, int order_id, const std::string& payment_method,
     float total = order_total + tax;
 
     // Process wallet payment
-    if (payment_method == "wallet" && !order_user_id.empty() && order_user_id != "guest") {
-        float balance = getWalletBalance(db, order_user_id);
-        if (balance < total) {
-            error_message = "Insufficient wallet balance: Rs " + std::to_string(balance) + " < Rs " + std::to_string(total);
+    if (isWalletPayment(payment_method) && !order_user_id.empty() && order_user_id != "guest") {
+        long long txn_id = appendWalletTxn(db, order_user_id, -total, "bill", "order " + std::to_string(order_id), true);
+        if (txn_id < 0) {
+            error_message = "Failed to deduct wallet balance: " + std::string(sqlite3_errmsg(db));
             return false;
         }
-        const char* wallet_sql = "UPDATE wallets SET balance = balance - ? WHERE user_id = ?;";
-        if (sqlite3_prepare_v2(db, wallet_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_double(stmt, 1, total);
-            sqlite3_bind_text(stmt, 2, order_user_id.c_str(), -1, SQLITE_STATIC);
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                error_message = "Failed to deduct wallet balance: " + std::string(sqlite3_errmsg(db));
-                sqlite3_finalize(stmt);
-                return false;
-            }
-            sqlite3_finalize(stmt);
-        } else {
-            error_message = "Database error updating wallet: " + std::string(sqlite3_errmsg(db));
+        if (txn_id == 0) {
+            float balance = getWalletBalance(db, order_user_id);
+            error_message = "Insufficient wallet balance: Rs " + std::to_string(balance) + " < Rs " + std::to_string(total);
             return false;
         }
+        countAfterCommit(metrics().wallet_debits);
+    }
+
+    int points_earned = 0;
+    if (!order_user_id.empty() && order_user_id != "guest") {
+        points_earned = static_cast<int>(total / loyalty_earn_rate);
     }
 
     // Insert bill
-    const char* bill_sql = "INSERT INTO bills (order_id, tax, total, payment_method, created_at, refunded) VALUES (?, ?, ?, ?, ?, 0);";
+    const char* bill_sql = "INSERT INTO bills (order_id, tax, total, payment_method, created_at, refunded, loyalty_earned, snapshot) "
+                           "VALUES (?, ?, ?, ?, ?, 0, ?, ?);";
     int bill_id = -1;
+    snapshot.created_at = std::time(nullptr);
+    snapshot.tax = tax;
+    snapshot.total = total;
+    std::string encoded = encodeBillSnapshot(snapshot);
     if (sqlite3_prepare_v2(db, bill_sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_int(stmt, 1, order_id);
         sqlite3_bind_double(stmt, 2, tax);
         sqlite3_bind_double(stmt, 3, total);
         sqlite3_bind_text(stmt, 4, payment_method.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 5, std::time(nullptr));
+        sqlite3_bind_int64(stmt, 5, snapshot.created_at);
+        sqlite3_bind_int(stmt, 6, points_earned);
+        sqlite3_bind_blob(stmt, 7, encoded.data(), static_cast<int>(encoded.size()), SQLITE_STATIC);
         if (sqlite3_step(stmt) == SQLITE_DONE) {
             bill_id = sqlite3_last_insert_rowid(db);
+            sealHashChain(db, kBillsChain);
         } else {
             error_message = "Failed to insert bill: " + std::string(sqlite3_errmsg(db));
         }
@@ -1297,22 +3203,43 @@ bool generateBill(sqlite3* db, int order_id, const std::string& payment_method,
         return false;
     }
 
+    OrderEvent billed;
+    billed.order_id = order_id;
+    billed.type = OrderEventType::BILLED;
+    billed.amount = total;
+    billed.bill_id = bill_id;
+    billed.user_id = user_id;
+    // The log is what replayOrders() rebuilds orders from, so a bill it does
+    // not record is not generated.
+    if (appendOrderEvent(db, billed) <= 0) {
+        error_message = "Failed to record the bill in the order log.";
+        return false;
+    }
+
     // Update order status
     completeOrder(db, order_id);
 
     // Add loyalty points
-    if (!order_user_id.empty() && order_user_id != "guest") {
-        int points_earned = static_cast<int>(total / loyalty_earn_rate);
-        if (points_earned > 0) {
-            addLoyaltyPoints(db, order_user_id, points_earned, "earned");
-        }
+    if (points_earned > 0) {
+        accrueLoyaltyPoints(db, order_user_id, points_earned);
     }
 
     logActivity(db, user_id, "Bill generated: order_id " + std::to_string(order_id));
+    countAfterCommit(metrics().bills_generated);
+    // Printed only once the bill is committed; paper cannot be rolled back.
+    if (printer_queue) {
+        snapshot.bill_id = bill_id;
+        WriteQueue::afterCommit([snapshot] {
+            if (printer_queue) {
+                printer_queue->submit(renderReceipt(snapshot), "bill " + std::to_string(snapshot.bill_id));
+            }
+        });
+    }
     return true;
 }
 
 SalesData getSalesData(sqlite3* db) {
+    PROFILE_SCOPE("getSalesData");
     SalesData data = {0.0f, 0};
     sqlite3_stmt* stmt;
     const char* sql = "SELECT SUM(total), COUNT(*) FROM bills WHERE refunded = 0;";
@@ -1327,6 +3254,7 @@ SalesData getSalesData(sqlite3* db) {
 }
 
 std::vector<TopItem> getTopItems(sqlite3* db) {
+    PROFILE_SCOPE("getTopItems");
     std::vector<TopItem> items;
     sqlite3_stmt* stmt;
     const char* sql = "SELECT oi.item_id, mi.name, SUM(oi.quantity) as total_quantity "
@@ -1349,6 +3277,102 @@ std::vector<TopItem> getTopItems(sqlite3* db) {
     return items;
 }
 
+// Adds a line to a cart, merging it into an existing line for the same item.
+void mergeOrderItem(std::vector<OrderItem>& items, const OrderItem& item) {
+    for (auto& existing : items) {
+        if (existing.item_id == item.item_id) {
+            existing.quantity += item.quantity;
+            return;
+        }
+    }
+    items.push_back(item);
+}
+
+// Holds stock for a cart line, then merges it in. False (cart unchanged)
+// when not enough is available.
+bool reserveOrderItem(std::vector<OrderItem>& items, const OrderItem& item) {
+    if (!stockReservations().reserve(item.item_id, item.quantity)) {
+        return false;
+    }
+    mergeOrderItem(items, item);
+    return true;
+}
+
+// Empties a cart, giving back the stock it holds.
+void releaseOrderItems(std::vector<OrderItem>& items) {
+    for (const auto& item : items) {
+        stockReservations().release(item.item_id, item.quantity);
+    }
+    items.clear();
+}
+
+// std::isdigit on a plain char is undefined for bytes above 0x7f (UTF-8 input).
+bool isDigit(char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+// Parses rapid-entry input such as "18 3*9 2*4": each token is an item code,
+// optionally prefixed by a quantity multiplier ("3*18" or "3x18").
+bool parseRapidEntry(const std::string& input, std::vector<RapidEntryLine>& lines, std::string& error_message) {
+    std::string normalized = input;
+    std::replace(normalized.begin(), normalized.end(), ',', ' ');
+    std::replace(normalized.begin(), normalized.end(), '+', ' ');
+    std::stringstream ss(normalized);
+    std::string token;
+    while (ss >> token) {
+        size_t sep = token.find_first_of("*xX");
+        std::string qty_part = sep == std::string::npos ? "1" : token.substr(0, sep);
+        std::string code_part = sep == std::string::npos ? token : token.substr(sep + 1);
+        if (qty_part.empty() || code_part.empty() ||
+            !std::all_of(qty_part.begin(), qty_part.end(), isDigit) ||
+            !std::all_of(code_part.begin(), code_part.end(), isDigit) ||
+            qty_part.size() > 4 || code_part.size() > 9) {
+            error_message = "Invalid entry: " + token;
+            return false;
+        }
+        RapidEntryLine line;
+        line.quantity = std::stoi(qty_part);
+        line.item_code = std::stoi(code_part);
+        if (line.quantity < 1) {
+            error_message = "Invalid quantity: " + token;
+            return false;
+        }
+        lines.push_back(line);
+    }
+    return true;
+}
+
+// Folds order_items rows added since the last refresh into the ranking, so
+// repeated calls only scan new rows.
+void refreshPopularity(sqlite3* db, PopularityRanking& ranking) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT item_id, SUM(quantity), MAX(order_item_id) FROM order_items "
+                      "WHERE order_item_id > ? GROUP BY item_id;";
+    bool changed = false;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, ranking.last_order_item_id);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int item_id = sqlite3_column_int(stmt, 0);
+            ranking.quantity_by_item[item_id] += sqlite3_column_int(stmt, 1);
+            ranking.last_order_item_id = std::max(ranking.last_order_item_id, sqlite3_column_int64(stmt, 2));
+            changed = true;
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (changed) {
+        ranking.ranked_item_ids.clear();
+        for (const auto& entry : ranking.quantity_by_item) {
+            ranking.ranked_item_ids.push_back(entry.first);
+        }
+        std::sort(ranking.ranked_item_ids.begin(), ranking.ranked_item_ids.end(), [&](int a, int b) {
+            int qa = ranking.quantity_by_item[a];
+            int qb = ranking.quantity_by_item[b];
+            return qa != qb ? qa > qb : a < b;
+        });
+    }
+}
+
 bool backupDatabase(sqlite3* db, const std::string& backup_path) {
     sqlite3* backup_db;
     if (sqlite3_open(backup_path.c_str(), &backup_db) != SQLITE_OK) {
@@ -1357,10 +3381,12 @@ bool backupDatabase(sqlite3* db, const std::string& backup_path) {
         return false;
     }
 
+    auto started = std::chrono::steady_clock::now();
     sqlite3_backup* backup = sqlite3_backup_init(backup_db, "main", db, "main");
     if (backup) {
         sqlite3_backup_step(backup, -1);
         sqlite3_backup_finish(backup);
+        metrics().backup_seconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
     } else {
         std::cerr << "Backup initialization failed: " << sqlite3_errmsg(backup_db) << std::endl;
         sqlite3_close(backup_db);
@@ -1391,20 +3417,31 @@ bool restoreDatabase(sqlite3* db, const std::string& backup_path) {
     }
 
     sqlite3_close(backup_db);
+    walletCache().clear();
+    loyaltyAccruals().clear();
+    stockReservations().load(db);
+    recipeBook().load(db);
+    refreshLowStockAlerts(db, false);
+    initOrderEvents(db);
+    loadKitchenQueue(db);
+    invalidateViews();
     logActivity(db, "", "Database restored from " + backup_path);
     return true;
 }
 
 std::vector<UserDetails> viewUserDetails(sqlite3* db) {
+    PROFILE_SCOPE("viewUserDetails");
     std::vector<UserDetails> users;
     sqlite3_stmt* stmt;
     const char* sql = "SELECT u.username, COALESCE(MAX(o.created_at), 0) as last_order, "
-                     "COALESCE(lp.points, 0) as points, COALESCE(w.balance, 0.0) as balance "
+                     "COALESCE(lp.points, 0) as points, COALESCE(" WALLET_BALANCE_SQL ", 0.0) as balance, "
+                     "(SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'loyalty_flushed_batch') as flushed_batch "
                      "FROM users u "
                      "LEFT JOIN orders o ON u.username = o.user_id "
                      "LEFT JOIN loyalty_points lp ON u.username = lp.user_id "
                      "LEFT JOIN wallets w ON u.username = w.user_id "
                      "GROUP BY u.username;";
+    long long flushed_batch = 0;
     if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             UserDetails user;
@@ -1413,14 +3450,77 @@ std::vector<UserDetails> viewUserDetails(sqlite3* db) {
             user.last_order = last_order_time ? formatTimestamp(last_order_time) : "None";
             user.loyalty_points = sqlite3_column_int(stmt, 2);
             user.wallet_balance = sqlite3_column_double(stmt, 3);
+            flushed_batch = sqlite3_column_int64(stmt, 4);
             users.push_back(user);
         }
         sqlite3_finalize(stmt);
     }
+    auto pending = loyaltyAccruals().pendingByUser(flushed_batch);
+    for (auto& user : users) {
+        auto it = pending.find(user.username);
+        if (it != pending.end()) user.loyalty_points += it->second;
+    }
     return users;
 }
 
+#ifndef CANTEEN_HEADLESS
+enum Page { DASHBOARD, PROFILE, MENU, ORDERS, KITCHEN, BILLING, WALLETS, DISCOUNTS, INVENTORY, LOYALTY, ACTIVITY_LOG, ANALYTICS, SETTINGS, BACKUP, USERS };
+
+const char* pageName(Page page) {
+    static const char* names[] = {"Dashboard", "Profile", "Menu", "Orders", "Kitchen", "Billing", "Wallets", "Discounts",
+                                  "Inventory", "Loyalty", "Activity Log", "Analytics", "Settings", "Backup", "Users"};
+    static_assert(sizeof(names) / sizeof(names[0]) == USERS + 1, "pageName() needs a name for every Page");
+    return names[page];
+}
+
+// The main loop sleeps in glfwWaitEventsTimeout and only builds frames while
+// redraw_frames > 0. Input, writer commits, data_version changes and running
+// animations raise it; pages can call requestRedraw() for anything else.
+// A few frames per request let ImGui settle hover and layout changes.
+static std::atomic<int> redraw_frames{3};
+
+void requestRedraw(int frames = 3) {
+    int current = redraw_frames.load(std::memory_order_relaxed);
+    while (current < frames && !redraw_frames.compare_exchange_weak(current, frames, std::memory_order_relaxed)) {
+    }
+}
+
+bool consumeRedraw() {
+    int current = redraw_frames.load(std::memory_order_relaxed);
+    while (current > 0 && !redraw_frames.compare_exchange_weak(current, current - 1, std::memory_order_relaxed)) {
+    }
+    return current > 0;
+}
+
+// A view*() result kept across frames. get() runs the query again only
+// after invalidateViews() or when `key` (role, time bucket, ...) changes, so
+// redrawing an unchanged page costs no SQL and no allocation.
+template <typename T>
+class CachedView {
+public:
+    template <typename Load>
+    const T& get(Load load, long long key = 0) {
+        unsigned generation = view_generation.load(std::memory_order_relaxed);
+        if (!loaded || generation != loaded_generation || key != loaded_key) {
+            value = load();
+            loaded = true;
+            loaded_generation = generation;
+            loaded_key = key;
+        }
+        return value;
+    }
+
+    void clear() { loaded = false; }
+
+private:
+    T value{};
+    bool loaded = false;
+    unsigned loaded_generation = 0;
+    long long loaded_key = 0;
+};
+
 void renderDashboard(sqlite3* db, const std::string& username, const std::string& role) {
+    PROFILE_SCOPE("renderDashboard");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Welcome, %s!", username.c_str());
     ImGui::PopFont();
@@ -1428,9 +3528,46 @@ void renderDashboard(sqlite3* db, const std::string& username, const std::string
     ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 0.8f), "Role: %s", role.c_str());
     ImGui::Dummy(ImVec2(0, 10));
     ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 0.8f), "Canteen Management System");
+
+    static CachedView<std::vector<StockAlert>> low_stock_view;
+    const auto& low_stock = low_stock_view.get([] { return lowStockAlerts().restockList(); });
+    ImGui::Dummy(ImVec2(0, 20));
+    if (low_stock.empty()) {
+        ImGui::TextColored(ImVec4(0.30f, 0.69f, 0.31f, 1.0f), "All items in stock");
+        return;
+    }
+    ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Low stock: %zu item%s", low_stock.size(), low_stock.size() == 1 ? "" : "s");
+    for (const auto& alert : low_stock) {
+        ImGui::BulletText("%s: %d left (threshold %d)", alert.name.c_str(), alert.quantity, alert.threshold);
+    }
+}
+
+// Shortages raised in the last few seconds, in the top-right corner of
+// every page.
+void renderLowStockToasts() {
+    const auto toast_seconds = std::chrono::seconds(6);
+    // Toasts time out to the second, so that is as often as the list changes
+    // without a write.
+    static CachedView<std::vector<StockAlert>> toasts_view;
+    const auto& toasts = toasts_view.get([&] { return lowStockAlerts().recent(toast_seconds); }, std::time(nullptr));
+    if (toasts.empty()) {
+        return;
+    }
+    ImGuiIO& io = ImGui::GetIO();
+    ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 20, 20), ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha(0.9f);
+    ImGui::Begin("##low_stock_toasts", nullptr,
+                 ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+                     ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
+    for (const auto& alert : toasts) {
+        ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Low stock: %s (%d left)", alert.name.c_str(), alert.quantity);
+    }
+    ImGui::End();
+    requestRedraw(1);   // keep drawing until the toast times out
 }
 
 void renderProfile(sqlite3* db, const std::string& username) {
+    PROFILE_SCOPE("renderProfile");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "User Profile");
     ImGui::PopFont();
@@ -1439,9 +3576,11 @@ void renderProfile(sqlite3* db, const std::string& username) {
 }
 
 void renderMenuManagement(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderMenuManagement");
     static char name[128] = "";
     static float price = 0.0f;
     static bool available = true;
+    static char station[64] = "Main";
     static int edit_id = -1;
     static std::string error_message = "";
 
@@ -1455,20 +3594,23 @@ void renderMenuManagement(sqlite3* db, const std::string& role) {
         ImGui::InputFloat("Price (Rs)", &price, 1.0f, 1.0f, "%.2f");
         if (price < 0) price = 0;
         ImGui::Checkbox("Available", &available);
+        ImGui::InputText("Kitchen Station", station, sizeof(station));
 
         if (ImGui::Button(edit_id == -1 ? "Add Item" : "Update Item")) {
             if (strlen(name) > 0 && price > 0) {
                 bool success = false;
+                std::string station_name = station[0] ? station : KitchenQueue::kDefaultStation;
                 if (edit_id == -1) {
-                    success = addMenuItem(db, name, price, available);
+                    success = runWrite(db, [&](sqlite3* wdb) { return addMenuItem(wdb, name, price, available, station_name); }, false);
                 } else {
-                    editMenuItem(db, edit_id, name, price, available);
+                    runWrite(db, [&](sqlite3* wdb) { editMenuItem(wdb, edit_id, name, price, available, station_name); });
                     success = true;
                 }
                 if (success) {
                     name[0] = '\0';
                     price = 0.0f;
                     available = true;
+                    strncpy(station, KitchenQueue::kDefaultStation, sizeof(station));
                     edit_id = -1;
                     error_message = "Operation successful!";
                 } else {
@@ -1484,6 +3626,7 @@ void renderMenuManagement(sqlite3* db, const std::string& role) {
             name[0] = '\0';
             price = 0.0f;
             available = true;
+            strncpy(station, KitchenQueue::kDefaultStation, sizeof(station));
             error_message = "";
         }
 
@@ -1493,12 +3636,14 @@ void renderMenuManagement(sqlite3* db, const std::string& role) {
     }
 
     ImGui::Dummy(ImVec2(0, 10));
-    auto items = viewMenuItems(db, role == "biller");
-    if (ImGui::BeginTable("MenuItems", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    static CachedView<std::vector<MenuItem>> items_view;
+    const auto& items = items_view.get([&] { return viewMenuItems(db, role == "biller"); }, role == "biller");
+    if (ImGui::BeginTable("MenuItems", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("ID");
         ImGui::TableSetupColumn("Name");
         ImGui::TableSetupColumn("Price (Rs)");
         ImGui::TableSetupColumn("Available");
+        ImGui::TableSetupColumn("Station");
         ImGui::TableHeadersRow();
 
         for (const auto& item : items) {
@@ -1511,6 +3656,8 @@ void renderMenuManagement(sqlite3* db, const std::string& role) {
             ImGui::Text("Rs %.2f", item.price);
             ImGui::TableSetColumnIndex(3);
             ImGui::Text("%s", item.available ? "Yes" : "No");
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%s", item.station.c_str());
 
             if (role == "admin" || role == "manager") {
                 ImGui::TableSetColumnIndex(0);
@@ -1520,20 +3667,81 @@ void renderMenuManagement(sqlite3* db, const std::string& role) {
                     strncpy(name, item.name.c_str(), sizeof(name));
                     price = item.price;
                     available = item.available;
+                    strncpy(station, item.station.c_str(), sizeof(station) - 1);
+                    station[sizeof(station) - 1] = '\0';
                     error_message = "";
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Delete")) {
-                    deleteMenuItem(db, item.id);
+                    runWrite(db, [&](sqlite3* wdb) { deleteMenuItem(wdb, item.id); });
+                }
+                ImGui::PopID();
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
+// One column per station, tickets in cooking order: rush first, then
+// oldest. Drawn from the in-memory kitchen queue only; orders leave it when
+// they are billed or canceled.
+void renderKitchen(sqlite3* db) {
+    PROFILE_SCOPE("renderKitchen");
+    ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
+    ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Kitchen Display");
+    ImGui::PopFont();
+    ImGui::Dummy(ImVec2(0, 20));
+
+    KitchenQueue& kitchen = kitchenQueue();
+    if (kitchen.pending() == 0) {
+        ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 0.8f), "No pending orders.");
+        return;
+    }
+    ImGui::Text("%zu pending orders", kitchen.pending());
+    FrameVector<std::pair<const std::string*, const KitchenQueue::StationQueue*>> columns(frameArena().resource());
+    for (const auto& station : kitchen.stationNames()) {
+        const KitchenQueue::StationQueue& queue = kitchen.queue(station);
+        if (!queue.empty()) columns.emplace_back(&station, &queue);
+    }
+    long long now = std::time(nullptr);
+    if (ImGui::BeginTable("Kitchen", static_cast<int>(std::min<size_t>(columns.size(), 16)), ImGuiTableFlags_Borders)) {
+        for (size_t c = 0; c < columns.size() && c < 16; c++) {
+            char header[96];
+            snprintf(header, sizeof(header), "%s (%zu)", columns[c].first->c_str(), columns[c].second->size());
+            ImGui::TableSetupColumn(header);
+        }
+        ImGui::TableHeadersRow();
+        ImGui::TableNextRow();
+        for (size_t c = 0; c < columns.size() && c < 16; c++) {
+            ImGui::TableSetColumnIndex(static_cast<int>(c));
+            ImGui::PushID(static_cast<int>(c));
+            for (int order_id : *columns[c].second) {
+                const KitchenTicket* ticket = kitchen.ticket(order_id);
+                long long age = std::max(0LL, now - ticket->created_at);
+                ImVec4 color = ticket->rush ? ImVec4(0.94f, 0.33f, 0.31f, 1.0f) :
+                               age >= 15 * 60 ? ImVec4(0.98f, 0.75f, 0.18f, 1.0f) : ImVec4(0.96f, 0.96f, 0.96f, 1.0f);
+                ImGui::TextColored(color, "#%d  %02lld:%02lld%s", order_id, age / 60, age % 60, ticket->rush ? "  RUSH" : "");
+                for (const auto& line : ticket->lines) {
+                    if (line.station == *columns[c].first) {
+                        ImGui::BulletText("%d x %s", line.quantity, line.name.c_str());
+                    }
+                }
+                ImGui::PushID(order_id);
+                bool rush = !ticket->rush;
+                if (ImGui::SmallButton(ticket->rush ? "Unrush" : "Rush")) {
+                    runWrite(db, [&](sqlite3* wdb) { setOrderRush(wdb, order_id, rush); });
                 }
                 ImGui::PopID();
+                ImGui::Separator();
             }
+            ImGui::PopID();
         }
         ImGui::EndTable();
     }
 }
 
-void renderOrderManagement(sqlite3* db, const std::string& role) {
+void renderOrderManagement(sqlite3* db, const std::string& role, Page& current_page, BillingHandoff& billing_handoff) {
+    PROFILE_SCOPE("renderOrderManagement");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Order Management");
     ImGui::PopFont();
@@ -1544,26 +3752,127 @@ void renderOrderManagement(sqlite3* db, const std::string& role) {
         static std::vector<OrderItem> new_order_items;
         static int selected_item_id = -1;
         static std::string error_message = "";
+        static bool rapid_entry = false;
+        static char rapid_input[128] = "";
+        static PopularityRanking popularity;
+        static double last_popularity_refresh = -1.0;
+        const size_t max_tiles = 12;
 
         ImGui::InputText("Customer ID (required, enter 'guest' for non-registered)", customer_id, sizeof(customer_id));
-        auto items = viewMenuItems(db, true);
-        std::vector<const char*> item_names;
-        for (const auto& item : items) {
-            item_names.push_back(item.name.c_str());
-        }
+        static CachedView<std::vector<MenuItem>> items_view;
+        const auto& items = items_view.get([&] { return viewMenuItems(db, true); });
+        ImGui::Checkbox("Rapid Entry Mode", &rapid_entry);
+
+        bool submit_order = false;
+        if (rapid_entry) {
+            if (last_popularity_refresh < 0 || ImGui::GetTime() - last_popularity_refresh > 5.0) {
+                refreshPopularity(db, popularity);
+                last_popularity_refresh = ImGui::GetTime();
+            }
 
-        ImGui::Combo("Select Item", &selected_item_id, item_names.data(), item_names.size());
-        static int quantity = 1;
-        ImGui::InputInt("Quantity", &quantity);
-        if (quantity < 1) quantity = 1;
-        if (ImGui::Button("Add to Order") && selected_item_id >= 0 && selected_item_id < items.size() && quantity > 0) {
-            OrderItem item;
-            item.item_id = items[selected_item_id].id;
-            item.name = items[selected_item_id].name;
-            item.quantity = quantity;
-            item.price = items[selected_item_id].price;
-            new_order_items.push_back(item);
-            quantity = 1;
+            std::pmr::unordered_map<int, const MenuItem*> items_by_code(frameArena().resource());
+            for (const auto& item : items) {
+                items_by_code[item.id] = &item;
+            }
+
+            // Tiles: most popular available items first, then the rest of the menu.
+            FrameVector<const MenuItem*> tiles(frameArena().resource());
+            for (int item_id : popularity.ranked_item_ids) {
+                auto it = items_by_code.find(item_id);
+                if (it != items_by_code.end()) tiles.push_back(it->second);
+                if (tiles.size() == max_tiles) break;
+            }
+            for (const auto& item : items) {
+                if (tiles.size() == max_tiles) break;
+                if (std::find(tiles.begin(), tiles.end(), &item) == tiles.end()) tiles.push_back(&item);
+            }
+
+            // A pending "N*" in the entry box multiplies the next tile or hotkey.
+            int multiplier = 1;
+            FrameString pending(rapid_input, frameArena().resource());
+            if (!pending.empty() && (pending.back() == '*' || pending.back() == 'x' || pending.back() == 'X') &&
+                std::all_of(pending.begin(), pending.end() - 1, isDigit) && pending.size() > 1 && pending.size() <= 5) {
+                multiplier = std::atoi(pending.c_str());   // stops at the '*'
+            }
+
+            ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 0.8f), "Type codes like '18 3*9', Enter to add. Enter on an empty line creates the order and opens Billing.");
+            ImGui::PushItemWidth(300);
+            bool entered = ImGui::InputTextWithHint("##rapid_entry", "qty*code ...", rapid_input, sizeof(rapid_input), ImGuiInputTextFlags_EnterReturnsTrue);
+            ImGui::PopItemWidth();
+            if (entered) {
+                std::vector<RapidEntryLine> lines;
+                if (strlen(rapid_input) == 0) {
+                    submit_order = true;
+                } else if (parseRapidEntry(rapid_input, lines, error_message)) {
+                    bool all_known = true;
+                    for (const auto& line : lines) {
+                        if (items_by_code.find(line.item_code) == items_by_code.end()) {
+                            error_message = "Unknown or unavailable item code: " + std::to_string(line.item_code);
+                            all_known = false;
+                            break;
+                        }
+                    }
+                    if (all_known) {
+                        // All lines or none: give back what this entry held if one is short.
+                        std::vector<OrderItem> entry_items;
+                        for (const auto& line : lines) {
+                            const MenuItem* menu_item = items_by_code[line.item_code];
+                            if (!reserveOrderItem(entry_items, {menu_item->id, menu_item->name, line.quantity, menu_item->price})) {
+                                error_message = "Not enough stock for " + menu_item->name;
+                                releaseOrderItems(entry_items);
+                                all_known = false;
+                                break;
+                            }
+                        }
+                        if (all_known) {
+                            for (const auto& item : entry_items) mergeOrderItem(new_order_items, item);
+                            rapid_input[0] = '\0';
+                            error_message = "";
+                        }
+                    }
+                }
+                ImGui::SetKeyboardFocusHere(-1);
+            }
+
+            for (size_t i = 0; i < tiles.size(); i++) {
+                const MenuItem* tile = tiles[i];
+                char label[160];
+                snprintf(label, sizeof(label), "F%zu [%d]\n%s", i + 1, tile->id, tile->name.c_str());
+                if (i % 4 != 0) ImGui::SameLine();
+                ImGui::PushID(tile->id + 3000);
+                bool hotkey = ImGui::IsKeyPressed(static_cast<ImGuiKey>(ImGuiKey_F1 + i), false);
+                if (ImGui::Button(label, ImVec2(180, 60)) || hotkey) {
+                    if (reserveOrderItem(new_order_items, {tile->id, tile->name, multiplier, tile->price})) {
+                        if (multiplier > 1) rapid_input[0] = '\0';
+                    } else {
+                        error_message = "Not enough stock for " + tile->name;
+                    }
+                }
+                ImGui::PopID();
+            }
+        } else {
+            FrameVector<const char*> item_names(frameArena().resource());
+            for (const auto& item : items) {
+                item_names.push_back(item.name.c_str());
+            }
+
+            ImGui::Combo("Select Item", &selected_item_id, item_names.data(), item_names.size());
+            static int quantity = 1;
+            ImGui::InputInt("Quantity", &quantity);
+            if (quantity < 1) quantity = 1;
+            if (ImGui::Button("Add to Order") && selected_item_id >= 0 && selected_item_id < items.size() && quantity > 0) {
+                OrderItem item;
+                item.item_id = items[selected_item_id].id;
+                item.name = items[selected_item_id].name;
+                item.quantity = quantity;
+                item.price = items[selected_item_id].price;
+                if (reserveOrderItem(new_order_items, item)) {
+                    quantity = 1;
+                } else {
+                    error_message = "Not enough stock for " + item.name + " (" +
+                                    std::to_string(std::max(0, stockReservations().available(item.item_id))) + " left)";
+                }
+            }
         }
 
         if (ImGui::BeginTable("NewOrderItems", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
@@ -1583,13 +3892,28 @@ void renderOrderManagement(sqlite3* db, const std::string& role) {
             }
             ImGui::EndTable();
         }
+        if (ImGui::Button("Create Order")) {
+            submit_order = true;
+        }
+        if (!new_order_items.empty()) {
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Order")) {
+                releaseOrderItems(new_order_items);
+            }
+        }
 
-        if (ImGui::Button("Create Order") && !new_order_items.empty() && strlen(customer_id) > 0) {
+        if (submit_order && !new_order_items.empty() && strlen(customer_id) > 0) {
             if (!userExists(db, customer_id)) {
                 error_message = "Invalid Customer ID. Use 'guest' for non-registered.";
             } else {
-                int order_id = createOrder(db, customer_id, new_order_items);
+                int order_id = runWrite(db, [&](sqlite3* wdb) { return createOrder(wdb, customer_id, new_order_items, true); }, -1);
                 if (order_id != -1) {
+                    if (rapid_entry) {
+                        billing_handoff.order_id = order_id;
+                        billing_handoff.customer_id = customer_id;
+                        current_page = BILLING;
+                        refreshPopularity(db, popularity);
+                    }
                     new_order_items.clear();
                     customer_id[0] = '\0';
                     selected_item_id = -1;
@@ -1606,7 +3930,8 @@ void renderOrderManagement(sqlite3* db, const std::string& role) {
     }
 
     ImGui::Dummy(ImVec2(0, 10));
-    auto orders = viewOrders(db);
+    static CachedView<std::vector<Order>> orders_view;
+    const auto& orders = orders_view.get([&] { return viewOrders(db); });
     if (ImGui::BeginTable("Orders", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("ID");
         ImGui::TableSetupColumn("Customer");
@@ -1626,30 +3951,77 @@ void renderOrderManagement(sqlite3* db, const std::string& role) {
             ImGui::TableSetColumnIndex(3);
             ImGui::Text("Rs %.2f", order.total);
             ImGui::TableSetColumnIndex(4);
-            ImGui::Text("%s", formatTimestamp(order.created_at).c_str());
+            ImGui::Text("%s", formatTimestampCached(order.created_at));
 
             if (role == "admin" || role == "manager") {
                 ImGui::TableSetColumnIndex(0);
                 ImGui::PushID(order.order_id);
                 if (ImGui::Button("Cancel") && order.status == "pending") {
-                    cancelOrder(db, order.order_id);
+                    runWrite(db, [&](sqlite3* wdb) { cancelOrder(wdb, order.order_id); });
                 }
                 ImGui::PopID();
             }
         }
         ImGui::EndTable();
     }
+
+    // Every recorded transition of one order, for disputes.
+    ImGui::Dummy(ImVec2(0, 10));
+    static int timeline_order_id = 0;
+    static std::vector<OrderEvent> timeline;
+    ImGui::PushItemWidth(150);
+    ImGui::InputInt("Order ID##timeline", &timeline_order_id);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Show Timeline")) {
+        timeline = orderTimeline(db, timeline_order_id);
+    }
+    if (!timeline.empty() && ImGui::BeginTable("OrderTimeline", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Time");
+        ImGui::TableSetupColumn("Event");
+        ImGui::TableSetupColumn("Details");
+        ImGui::TableSetupColumn("By");
+        ImGui::TableSetupColumn("Status After");
+        ImGui::TableHeadersRow();
+
+        OrderState state;
+        for (const auto& event : timeline) {
+            applyOrderEvent(state, event);
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", formatTimestampCached(event.created_at));
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%s", orderEventName(event.type));
+            ImGui::TableSetColumnIndex(2);
+            if (event.type == OrderEventType::ITEM_ADDED) {
+                ImGui::Text("%d x item %d @ Rs %.2f", event.quantity, event.item_id, event.amount);
+            } else if (event.type == OrderEventType::BILLED || event.type == OrderEventType::REFUNDED) {
+                ImGui::Text("Bill %lld, Rs %.2f", event.bill_id, event.amount);
+            } else if (event.type == OrderEventType::CREATED) {
+                ImGui::Text("Rs %.2f", event.amount);
+            } else if (event.type == OrderEventType::RUSH) {
+                ImGui::Text("%s", event.quantity ? "On" : "Off");
+            }
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%s", event.user_id.c_str());
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%s%s%s", state.status.c_str(), state.rush ? ", rush" : "", state.refunded ? ", refunded" : "");
+        }
+        ImGui::EndTable();
+    }
 }
 
 
 
-void renderBilling(sqlite3* db, const std::string& role, const std::string& user_id) {
+void renderBilling(sqlite3* db, const std::string& role, const std::string& user_id, BillingHandoff& billing_handoff) {
+    PROFILE_SCOPE("renderBilling");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Billing and Payment");
     ImGui::PopFont();
     ImGui::Dummy(ImVec2(0, 20));
 
-    static bool refresh_completed_orders = true;
+    static CachedView<std::vector<Bill>> bills_view;
+    const auto& bills = bills_view.get([&] { return viewBills(db); });
     if (role == "biller") {
         static int order_id = -1;
         static char customer_id[128] = "";
@@ -1661,6 +4033,24 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
         static std::string error_message = "";
         const char* methods[] = { "Wallet", "Cash", "Card" };
 
+        // Order handed over from rapid entry: prefill it as if "Check Customer" was pressed.
+        if (billing_handoff.order_id > 0) {
+            order_id = billing_handoff.order_id;
+            strncpy(customer_id, billing_handoff.customer_id.c_str(), sizeof(customer_id) - 1);
+            customer_id[sizeof(customer_id) - 1] = '\0';
+            error_message = "";
+            loyalty_points_to_redeem = 0;
+            if (billing_handoff.customer_id != "guest") {
+                available_points = getLoyaltyPoints(db, customer_id);
+                show_points = true;
+            } else {
+                show_points = false;
+                payment_method = 1;
+            }
+            billing_handoff.order_id = -1;
+            billing_handoff.customer_id.clear();
+        }
+
         ImGui::InputInt("Order ID", &order_id);
         ImGui::InputText("Customer ID (required, enter 'guest' for non-registered)", customer_id, sizeof(customer_id));
         if (ImGui::Button("Check Customer")) {
@@ -1690,13 +4080,15 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
         }
 
         ImGui::Combo("Payment Method", &payment_method, methods, IM_ARRAYSIZE(methods));
-        if (std::string(customer_id) == "guest") {
+        if (strcmp(customer_id, "guest") == 0) {
             payment_method = payment_method == 0 ? 1 : payment_method; // Force Cash/Card for guest
         }
 
-        auto discounts = viewDiscounts(db, true);
-        std::vector<const char*> discount_names = {"None"};
-        std::vector<int> discount_ids = {0};
+        // Active discounts depend on the clock too, so re-query at least once a minute.
+        static CachedView<std::vector<Discount>> discounts_view;
+        const auto& discounts = discounts_view.get([&] { return viewDiscounts(db, true); }, std::time(nullptr) / 60);
+        FrameVector<const char*> discount_names(1, "None", frameArena().resource());
+        FrameVector<int> discount_ids(1, 0, frameArena().resource());
         for (const auto& discount : discounts) {
             discount_names.push_back(discount.name.c_str());
             discount_ids.push_back(discount.discount_id);
@@ -1714,9 +4106,11 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
             } else if (!userExists(db, customer_id)) {
                 error_message = "Invalid Customer ID.";
             } else {
-                if (generateBill(db, order_id, methods[payment_method], selected_discount_id, loyalty_points_to_redeem, user_id, error_message)) {
+                bool billed = runWrite(db, [&](sqlite3* wdb) {
+                    return generateBill(wdb, order_id, methods[payment_method], selected_discount_id, loyalty_points_to_redeem, user_id, error_message);
+                }, false);
+                if (billed) {
                     error_message = "Bill generated successfully!";
-                    refresh_completed_orders = true;
                     order_id = -1;
                     customer_id[0] = '\0';
                     discount_index = 0;
@@ -1736,10 +4130,11 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
         ImGui::Dummy(ImVec2(0, 20));
         ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Completed Orders");
         ImGui::Dummy(ImVec2(0, 10));
-        auto completed_orders = viewOrders(db, true);
-        if (refresh_completed_orders) {
-            completed_orders = viewOrders(db, true); // Force refresh
-            refresh_completed_orders = false;
+        static CachedView<std::vector<Order>> completed_view;
+        const auto& completed_orders = completed_view.get([&] { return viewOrders(db, true); });
+        std::pmr::unordered_map<int, int> bill_for_order(frameArena().resource());
+        for (const auto& bill : bills) {
+            bill_for_order.emplace(bill.order_id, bill.bill_id);
         }
         if (ImGui::BeginTable("CompletedOrders", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
             ImGui::TableSetupColumn("Order ID");
@@ -1761,25 +4156,19 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
                 ImGui::TableSetColumnIndex(3);
                 ImGui::Text("Rs %.2f", order.total);
                 ImGui::TableSetColumnIndex(4);
-                ImGui::Text("%s", formatTimestamp(order.created_at).c_str());
+                ImGui::Text("%s", formatTimestampCached(order.created_at));
                 ImGui::TableSetColumnIndex(5);
                 ImGui::PushID(order.order_id + 2000);
-                auto bills = viewBills(db);
-                bool found = false;
-                for (const auto& bill : bills) {
-                    if (bill.order_id == order.order_id) {
-                        if (ImGui::Button("Save as PDF")) {
-                            if (saveBillAsPDF(db, bill.bill_id)) {
-                                ImGui::TextColored(ImVec4(0.30f, 0.69f, 0.31f, 1.0f), "Saved!");
-                            } else {
-                                ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Failed!");
-                            }
+                auto bill = bill_for_order.find(order.order_id);
+                if (bill != bill_for_order.end()) {
+                    if (ImGui::Button("Save as PDF")) {
+                        if (saveBillAsPDF(db, bill->second)) {
+                            ImGui::TextColored(ImVec4(0.30f, 0.69f, 0.31f, 1.0f), "Saved!");
+                        } else {
+                            ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Failed!");
                         }
-                        found = true;
-                        break;
                     }
-                }
-                if (!found) {
+                } else {
                     ImGui::Text("No bill found");
                 }
                 ImGui::PopID();
@@ -1788,10 +4177,99 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
         }
     }
 
+    if (role == "admin") {
+        ImGui::Dummy(ImVec2(0, 20));
+        ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Refunds");
+        ImGui::Dummy(ImVec2(0, 10));
+        static char refund_bill_ids[1024] = "";
+        static char refund_from[32] = "";
+        static char refund_to[32] = "";
+        static int refund_item_id = 0;
+        static std::vector<RefundResult> refund_results;
+        static std::string refund_message;
+        auto summarize = [&]() {
+            int count = 0;
+            float amount = 0;
+            for (const auto& result : refund_results) {
+                if (!result.refunded) continue;
+                count++;
+                amount += result.amount;
+            }
+            refund_message = "Refunded " + std::to_string(count) + " of " + std::to_string(refund_results.size()) +
+                             " bills, Rs " + std::to_string(amount);
+        };
+
+        ImGui::InputText("Bill IDs (e.g., 12,15,20)", refund_bill_ids, sizeof(refund_bill_ids));
+        if (ImGui::Button("Refund Bills")) {
+            std::vector<int> bill_ids;
+            std::stringstream ss(refund_bill_ids);
+            std::string bill_id;
+            while (std::getline(ss, bill_id, ',')) {
+                int id = std::atoi(bill_id.c_str());
+                if (id > 0) bill_ids.push_back(id);
+            }
+            if (bill_ids.empty()) {
+                refund_message = "Enter at least one bill ID.";
+            } else {
+                runWrite(db, [&](sqlite3* wdb) { refund_results = bulkRefundBills(wdb, bill_ids, user_id); });
+                summarize();
+                refund_bill_ids[0] = '\0';
+            }
+        }
+        ImGui::InputText("From (DD-MM-YYYY HH:MM:SS)##refund", refund_from, sizeof(refund_from));
+        ImGui::InputText("To (DD-MM-YYYY HH:MM:SS)##refund", refund_to, sizeof(refund_to));
+        ImGui::InputInt("Containing Item ID (0 = any)##refund", &refund_item_id);
+        if (refund_item_id < 0) refund_item_id = 0;
+        if (ImGui::Button("Refund Matching Bills")) {
+            struct tm tm_from = {}, tm_to = {};
+            if (strptime(refund_from, "%d-%m-%Y %H:%M:%S", &tm_from) && strptime(refund_to, "%d-%m-%Y %H:%M:%S", &tm_to)) {
+                RefundFilter filter;
+                filter.from = mktime(&tm_from);
+                filter.to = mktime(&tm_to);
+                filter.item_id = refund_item_id;
+                runWrite(db, [&](sqlite3* wdb) { refund_results = bulkRefundBills(wdb, filter, user_id); });
+                summarize();
+            } else {
+                refund_message = "Invalid date/time format.";
+            }
+        }
+        if (!refund_message.empty()) {
+            ImGui::Text("%s", refund_message.c_str());
+        }
+        if (!refund_results.empty() && ImGui::BeginTable("RefundResults", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0, 200))) {
+            ImGui::TableSetupColumn("Bill ID");
+            ImGui::TableSetupColumn("Order ID");
+            ImGui::TableSetupColumn("Customer");
+            ImGui::TableSetupColumn("Result");
+            ImGui::TableSetupColumn("Amount (Rs)");
+            ImGui::TableSetupColumn("Points Reversed");
+            ImGui::TableHeadersRow();
+            for (const auto& result : refund_results) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%d", result.bill_id);
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%d", result.order_id);
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%s", result.user_id.c_str());
+                ImGui::TableSetColumnIndex(3);
+                if (result.refunded) {
+                    ImGui::TextColored(ImVec4(0.30f, 0.69f, 0.31f, 1.0f), result.wallet_credited ? "Refunded to wallet" : "Refunded");
+                } else {
+                    ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "%s", result.reason.c_str());
+                }
+                ImGui::TableSetColumnIndex(4);
+                ImGui::Text("Rs %.2f", result.amount);
+                ImGui::TableSetColumnIndex(5);
+                ImGui::Text("%d", result.points_reversed);
+            }
+            ImGui::EndTable();
+        }
+    }
+
     ImGui::Dummy(ImVec2(0, 20));
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "All Bills");
     ImGui::Dummy(ImVec2(0, 10));
-    auto bills = viewBills(db);
     if (ImGui::BeginTable("Bills", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("ID");
         ImGui::TableSetupColumn("Order ID");
@@ -1801,7 +4279,7 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
         ImGui::TableSetupColumn("Actions");
         ImGui::TableHeadersRow();
 
-        for (auto& bill : bills) {
+        for (const auto& bill : bills) {
             ImGui::TableNextRow();
             ImGui::TableSetColumnIndex(0);
             ImGui::Text("%d", bill.bill_id);
@@ -1812,7 +4290,7 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
             ImGui::TableSetColumnIndex(3);
             ImGui::Text("Rs %.2f", bill.total);
             ImGui::TableSetColumnIndex(4);
-            ImGui::Text("%s", bill.payment_method.c_str());
+            ImGui::Text("%s%s", bill.payment_method.c_str(), bill.refunded ? " (refunded)" : "");
             ImGui::TableSetColumnIndex(5);
             if (role == "admin" || role == "biller") {
                 ImGui::PushID(bill.bill_id + 1000);
@@ -1823,6 +4301,12 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
                         ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Failed!");
                     }
                 }
+                if (printer_queue) {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Reprint Receipt")) {
+                        printBillReceipt(db, bill.bill_id);
+                    }
+                }
                 ImGui::PopID();
             }
         }
@@ -1834,7 +4318,8 @@ void renderBilling(sqlite3* db, const std::string& role, const std::string& user
 
 
 
-void renderWallets(sqlite3* db, const std::string& role) {
+void renderWallets(sqlite3* db, const std::string& role, const std::string& logged_in_user) {
+    PROFILE_SCOPE("renderWallets");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Wallet Management");
     ImGui::PopFont();
@@ -1850,7 +4335,7 @@ void renderWallets(sqlite3* db, const std::string& role) {
         if (amount < 0) amount = 0;
         if (ImGui::Button("Top Up") && strlen(user_id) > 0 && amount > 0) {
             if (userExists(db, user_id) && user_id != std::string("guest")) {
-                topUpWallet(db, user_id, amount);
+                runWrite(db, [&](sqlite3* wdb) { topUpWallet(wdb, user_id, amount); });
                 error_message = "Wallet topped up successfully!";
                 user_id[0] = '\0';
                 amount = 0.0f;
@@ -1873,7 +4358,7 @@ void renderWallets(sqlite3* db, const std::string& role) {
         ImGui::InputFloat("Initial Balance (Rs)", &initial_balance, 1.0f, 1.0f, "%.2f");
         if (initial_balance < 0) initial_balance = 0;
         if (ImGui::Button("Create Wallet") && strlen(phone_number) > 0) {
-            if (createWallet(db, phone_number, initial_balance)) {
+            if (runWrite(db, [&](sqlite3* wdb) { return createWallet(wdb, phone_number, initial_balance); }, false)) {
                 error_message = "Wallet created successfully!";
                 phone_number[0] = '\0';
                 initial_balance = 0.0f;
@@ -1882,14 +4367,26 @@ void renderWallets(sqlite3* db, const std::string& role) {
             }
         }
 
+        ImGui::Dummy(ImVec2(0, 10));
+        static char credit_path[256] = "wallet_credits.csv";
+        ImGui::InputText("Bulk Credit File (user_id,amount[,note])", credit_path, sizeof(credit_path));
+        if (ImGui::Button("Credit Wallets")) {
+            std::string credit_error;
+            int credited = runWrite(db, [&](sqlite3* wdb) { return bulkCreditWallets(wdb, credit_path, logged_in_user, credit_error); }, -1);
+            error_message = credited >= 0 ? "Credited " + std::to_string(credited) + " wallets." : "Bulk credit failed: " + credit_error;
+        }
+
         if (!error_message.empty()) {
             ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "%s", error_message.c_str());
         }
     }
 
     if (role == "admin") {
+        static std::string statement_user;
         ImGui::Dummy(ImVec2(0, 10));
-        auto wallets = viewWallets(db);
+        static CachedView<std::vector<Wallet>> wallets_view;
+        static CachedView<std::vector<WalletTransaction>> statement_view;
+        const auto& wallets = wallets_view.get([&] { return viewWallets(db); });
         if (ImGui::BeginTable("Wallets", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
             ImGui::TableSetupColumn("User ID");
             ImGui::TableSetupColumn("Balance (Rs)");
@@ -1905,16 +4402,50 @@ void renderWallets(sqlite3* db, const std::string& role) {
                 ImGui::TableSetColumnIndex(2);
                 ImGui::PushID(wallet.user_id.c_str());
                 if (ImGui::Button("Delete") && wallet.balance == 0) {
-                    deleteWallet(db, wallet.user_id);
+                    runWrite(db, [&](sqlite3* wdb) { deleteWallet(wdb, wallet.user_id); });
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Statement")) {
+                    statement_user = wallet.user_id;
+                    statement_view.clear();
                 }
                 ImGui::PopID();
             }
             ImGui::EndTable();
         }
+
+        if (!statement_user.empty()) {
+            ImGui::Dummy(ImVec2(0, 10));
+            ImGui::Text("Statement for %s (latest 50)", statement_user.c_str());
+            const auto& transactions = statement_view.get([&] { return getWalletStatement(db, statement_user); });
+            if (ImGui::BeginTable("WalletStatement", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+                ImGui::TableSetupColumn("Time");
+                ImGui::TableSetupColumn("Type");
+                ImGui::TableSetupColumn("Amount (Rs)");
+                ImGui::TableSetupColumn("Reference");
+                ImGui::TableHeadersRow();
+                for (const auto& txn : transactions) {
+                    time_t created = txn.created_at;
+                    char when[32];
+                    std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M", std::localtime(&created));
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::Text("%s", when);
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::Text("%s", txn.type.c_str());
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::Text("%+.2f", txn.amount);
+                    ImGui::TableSetColumnIndex(3);
+                    ImGui::Text("%s", txn.reference.c_str());
+                }
+                ImGui::EndTable();
+            }
+        }
     }
 }
 
 void renderDiscounts(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderDiscounts");
     static char name[128] = "";
     static int type_index = 0;
     static float value = 0.0f;
@@ -1946,9 +4477,9 @@ void renderDiscounts(sqlite3* db, const std::string& role) {
                     int start_ts = mktime(&tm_start);
                     int end_ts = mktime(&tm_end);
                     if (edit_id == -1) {
-                        addDiscount(db, name, types[type_index], value, start_ts, end_ts, combo_items);
+                        runWrite(db, [&](sqlite3* wdb) { addDiscount(wdb, name, types[type_index], value, start_ts, end_ts, combo_items); });
                     } else {
-                        editDiscount(db, edit_id, name, types[type_index], value, start_ts, end_ts, combo_items);
+                        runWrite(db, [&](sqlite3* wdb) { editDiscount(wdb, edit_id, name, types[type_index], value, start_ts, end_ts, combo_items); });
                     }
                     name[0] = '\0';
                     type_index = 0;
@@ -1983,7 +4514,10 @@ void renderDiscounts(sqlite3* db, const std::string& role) {
     }
 
     ImGui::Dummy(ImVec2(0, 10));
-    auto discounts = viewDiscounts(db, role == "biller");
+    // Billers see active discounts only, which depend on the clock too.
+    static CachedView<std::vector<Discount>> discounts_view;
+    const auto& discounts = discounts_view.get([&] { return viewDiscounts(db, role == "biller"); },
+                                               role == "biller" ? std::time(nullptr) / 60 : -1);
     if (ImGui::BeginTable("Discounts", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("ID");
         ImGui::TableSetupColumn("Name");
@@ -2005,9 +4539,9 @@ void renderDiscounts(sqlite3* db, const std::string& role) {
             ImGui::TableSetColumnIndex(3);
             ImGui::Text("%.2f", discount.value);
             ImGui::TableSetColumnIndex(4);
-            ImGui::Text("%s", formatTimestamp(discount.start_time).c_str());
+            ImGui::Text("%s", formatTimestampCached(discount.start_time));
             ImGui::TableSetColumnIndex(5);
-            ImGui::Text("%s", formatTimestamp(discount.end_time).c_str());
+            ImGui::Text("%s", formatTimestampCached(discount.end_time));
             ImGui::TableSetColumnIndex(6);
             ImGui::Text("%s", discount.combo_items.c_str());
 
@@ -2031,7 +4565,7 @@ void renderDiscounts(sqlite3* db, const std::string& role) {
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Delete")) {
-                    deleteDiscount(db, discount.discount_id);
+                    runWrite(db, [&](sqlite3* wdb) { deleteDiscount(wdb, discount.discount_id); });
                 }
                 ImGui::PopID();
             }
@@ -2041,6 +4575,7 @@ void renderDiscounts(sqlite3* db, const std::string& role) {
 }
 
 void renderInventory(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderInventory");
     static int item_id = 0;
     static int quantity = 0;
     static int low_stock_threshold = 10;
@@ -2062,9 +4597,9 @@ void renderInventory(sqlite3* db, const std::string& role) {
         if (ImGui::Button(edit_id == -1 ? "Add Stock" : "Update Stock")) {
             if (item_id > 0) {
                 if (edit_id == -1) {
-                    addInventory(db, item_id, quantity, low_stock_threshold);
+                    runWrite(db, [&](sqlite3* wdb) { addInventory(wdb, item_id, quantity, low_stock_threshold); });
                 } else {
-                    updateInventory(db, edit_id, quantity, low_stock_threshold);
+                    runWrite(db, [&](sqlite3* wdb) { updateInventory(wdb, edit_id, quantity, low_stock_threshold); });
                 }
                 item_id = 0;
                 quantity = 0;
@@ -2090,7 +4625,9 @@ void renderInventory(sqlite3* db, const std::string& role) {
     }
 
     ImGui::Dummy(ImVec2(0, 10));
-    auto inventory = viewInventory(db);
+    static CachedView<std::vector<Inventory>> inventory_view;
+    static CachedView<std::vector<MenuItem>> items_view;
+    const auto& inventory = inventory_view.get([&] { return viewInventory(db); });
     if (ImGui::BeginTable("Inventory", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("Item ID");
         ImGui::TableSetupColumn("Item Name");
@@ -2099,20 +4636,20 @@ void renderInventory(sqlite3* db, const std::string& role) {
         ImGui::TableSetupColumn("Status");
         ImGui::TableHeadersRow();
 
-        auto items = viewMenuItems(db);
+        const auto& items = items_view.get([&] { return viewMenuItems(db); });
         for (const auto& inv : inventory) {
             ImGui::TableNextRow();
             ImGui::TableSetColumnIndex(0);
             ImGui::Text("%d", inv.item_id);
             ImGui::TableSetColumnIndex(1);
-            std::string item_name = "Unknown";
+            const char* item_name = "Unknown";
             for (const auto& item : items) {
                 if (item.id == inv.item_id) {
-                    item_name = item.name;
+                    item_name = item.name.c_str();
                     break;
                 }
             }
-            ImGui::Text("%s", item_name.c_str());
+            ImGui::Text("%s", item_name);
             ImGui::TableSetColumnIndex(2);
             ImGui::Text("%d", inv.quantity);
             ImGui::TableSetColumnIndex(3);
@@ -2139,9 +4676,182 @@ void renderInventory(sqlite3* db, const std::string& role) {
         }
         ImGui::EndTable();
     }
+
+    ImGui::Dummy(ImVec2(0, 20));
+    ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Ingredients");
+    if (role == "admin" || role == "manager") {
+        static char ingredient_name[64] = "";
+        static char ingredient_unit[16] = "g";
+        static double ingredient_quantity = 0.0;
+        static int stock_ingredient_id = 0;
+        static double stock_quantity = 0.0;
+        ImGui::InputText("Ingredient Name", ingredient_name, sizeof(ingredient_name));
+        ImGui::InputText("Unit", ingredient_unit, sizeof(ingredient_unit));
+        ImGui::InputDouble("Stock", &ingredient_quantity);
+        if (ImGui::Button("Add Ingredient") && ingredient_name[0] != '\0') {
+            std::string name = ingredient_name, unit = ingredient_unit;
+            double amount = std::max(0.0, ingredient_quantity);
+            runWrite(db, [&](sqlite3* wdb) { addIngredient(wdb, name, unit, amount); });
+            ingredient_name[0] = '\0';
+        }
+        ImGui::InputInt("Ingredient ID", &stock_ingredient_id);
+        ImGui::InputDouble("New Stock", &stock_quantity);
+        if (ImGui::Button("Set Ingredient Stock") && stock_ingredient_id > 0) {
+            int id = stock_ingredient_id;
+            double amount = std::max(0.0, stock_quantity);
+            runWrite(db, [&](sqlite3* wdb) { setIngredientStock(wdb, id, amount); });
+        }
+    }
+    static CachedView<std::vector<Ingredient>> ingredients_view;
+    const auto& ingredients = ingredients_view.get([&] { return viewIngredients(db); });
+    if (!ingredients.empty() && ImGui::BeginTable("Ingredients", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("ID");
+        ImGui::TableSetupColumn("Name");
+        ImGui::TableSetupColumn("Stock");
+        ImGui::TableSetupColumn("Used By");
+        ImGui::TableHeadersRow();
+        for (const auto& ingredient : ingredients) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%d", ingredient.ingredient_id);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%s", ingredient.name.c_str());
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.2f %s", ingredient.quantity, ingredient.unit.c_str());
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%zu items", recipeBook().dependentCount(ingredient.ingredient_id));
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Dummy(ImVec2(0, 20));
+    ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Recipes");
+    if (role == "admin" || role == "manager") {
+        static int recipe_item_id = 0;
+        static int recipe_ingredient_id = 0;
+        static double recipe_quantity = 0.0;
+        ImGui::InputInt("Recipe Item ID", &recipe_item_id);
+        ImGui::InputInt("Recipe Ingredient ID", &recipe_ingredient_id);
+        ImGui::InputDouble("Per Portion (0 removes)", &recipe_quantity);
+        if (ImGui::Button("Save Recipe Line") && recipe_item_id > 0 && recipe_ingredient_id > 0) {
+            int item = recipe_item_id, ingredient = recipe_ingredient_id;
+            double amount = std::max(0.0, recipe_quantity);
+            runWrite(db, [&](sqlite3* wdb) { setRecipeItem(wdb, item, ingredient, amount); });
+        }
+    }
+    static CachedView<std::vector<RecipeLine>> recipe_view;
+    const auto& recipe = recipe_view.get([&] { return viewRecipeItems(db); });
+    if (!recipe.empty() && ImGui::BeginTable("Recipes", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Item");
+        ImGui::TableSetupColumn("Ingredient");
+        ImGui::TableSetupColumn("Per Portion");
+        ImGui::TableSetupColumn("Can Make");
+        ImGui::TableHeadersRow();
+        for (size_t i = 0; i < recipe.size(); i++) {
+            const RecipeLine& line = recipe[i];
+            bool first = i == 0 || recipe[i - 1].item_id != line.item_id;
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", first ? line.item_name.c_str() : "");
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%s", line.ingredient_name.c_str());
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.2f %s", line.quantity, line.unit.c_str());
+            ImGui::TableSetColumnIndex(3);
+            if (first) {
+                int portions = recipeBook().portions(line.item_id);
+                if (portions == 0) {
+                    ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Unavailable");
+                } else {
+                    ImGui::Text("%d", portions);
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    // Next-day demand from the forecaster against what is on hand now. The
+    // model also moves with the clock and the background trainer, so it is
+    // re-run at least once a minute.
+    static CachedView<std::vector<ItemForecast>> forecasts_view;
+    const auto& forecasts = forecasts_view.get([&] {
+        std::unordered_map<int, int> on_hand;
+        for (const auto& inv : inventory) {
+            on_hand[inv.item_id] = inv.quantity;
+        }
+        return demandForecaster().forecast(std::time(nullptr), on_hand);
+    }, std::time(nullptr) / 60);
+    if (!forecasts.empty()) {
+        ImGui::Dummy(ImVec2(0, 20));
+        ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Demand Forecast (next 24 h)");
+        if (ImGui::BeginTable("DemandForecast", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Item ID");
+            ImGui::TableSetupColumn("On Hand");
+            ImGui::TableSetupColumn("Expected");
+            ImGui::TableSetupColumn("Suggested Reorder");
+            ImGui::TableHeadersRow();
+            for (const auto& forecast : forecasts) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%d", forecast.item_id);
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%d", forecast.on_hand);
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.1f +/- %.1f", forecast.next_day, forecast.stddev);
+                ImGui::TableSetColumnIndex(3);
+                if (forecast.reorder > 0) {
+                    ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "%d", forecast.reorder);
+                } else {
+                    ImGui::Text("-");
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    static CachedView<std::vector<StockAlert>> restock_view;
+    const auto& restock = restock_view.get([] { return lowStockAlerts().restockList(); });
+    if (restock.empty()) {
+        return;
+    }
+    ImGui::Dummy(ImVec2(0, 20));
+    ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Restock List");
+    if (ImGui::BeginTable("RestockList", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Item");
+        ImGui::TableSetupColumn("Quantity");
+        ImGui::TableSetupColumn("Threshold");
+        ImGui::TableSetupColumn("Order");
+        ImGui::TableHeadersRow();
+        int total = 0;
+        for (const auto& alert : restock) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", alert.name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%d", alert.quantity);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%d", alert.threshold);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%d", alert.restockQuantity());
+            total += alert.restockQuantity();
+        }
+        ImGui::EndTable();
+        ImGui::Text("%zu items, %d units to order", restock.size(), total);
+    }
+    static char restock_path[256] = "restock_list.csv";
+    static std::string restock_status;
+    ImGui::InputText("Restock CSV", restock_path, sizeof(restock_path));
+    ImGui::SameLine();
+    if (ImGui::Button("Export")) {
+        restock_status = writeRestockList(restock_path) ? std::string("Saved to ") + restock_path : "Could not write the file.";
+    }
+    if (!restock_status.empty()) {
+        ImGui::Text("%s", restock_status.c_str());
+    }
 }
 
 void renderLoyalty(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderLoyalty");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Loyalty Program");
     ImGui::PopFont();
@@ -2157,7 +4867,7 @@ void renderLoyalty(sqlite3* db, const std::string& role) {
         if (points < 0) points = 0;
         if (ImGui::Button("Add Points") && strlen(user_id) > 0 && points > 0) {
             if (userExists(db, user_id) && user_id != std::string("guest")) {
-                addLoyaltyPoints(db, user_id, points, "earned");
+                runWrite(db, [&](sqlite3* wdb) { addLoyaltyPoints(wdb, user_id, points, "earned"); });
                 error_message = "Points added successfully!";
                 user_id[0] = '\0';
                 points = 0;
@@ -2172,7 +4882,8 @@ void renderLoyalty(sqlite3* db, const std::string& role) {
     }
 
     ImGui::Dummy(ImVec2(0, 10));
-    auto points = viewLoyaltyPoints(db);
+    static CachedView<std::vector<LoyaltyPoints>> points_view;
+    const auto& points = points_view.get([&] { return viewLoyaltyPoints(db); });
     if (ImGui::BeginTable("LoyaltyPoints", 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("User ID");
         ImGui::TableSetupColumn("Points");
@@ -2189,7 +4900,8 @@ void renderLoyalty(sqlite3* db, const std::string& role) {
     }
 
     ImGui::Dummy(ImVec2(0, 10));
-    auto transactions = viewLoyaltyTransactions(db);
+    static CachedView<std::vector<LoyaltyTransaction>> transactions_view;
+    const auto& transactions = transactions_view.get([&] { return viewLoyaltyTransactions(db); });
     if (ImGui::BeginTable("LoyaltyTransactions", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("Transaction ID");
         ImGui::TableSetupColumn("User ID");
@@ -2213,13 +4925,15 @@ void renderLoyalty(sqlite3* db, const std::string& role) {
 }
 
 void renderActivityLog(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderActivityLog");
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]);
     ImGui::TextColored(ImVec4(0.96f, 0.96f, 0.96f, 1.0f), "Activity Log");
     ImGui::PopFont();
     ImGui::Dummy(ImVec2(0, 20));
 
     if (role == "admin" || role == "manager") {
-        auto logs = viewActivityLog(db);
+        static CachedView<std::vector<ActivityLog>> logs_view;
+        const auto& logs = logs_view.get([&] { return viewActivityLog(db); });
         if (ImGui::BeginTable("ActivityLog", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
             ImGui::TableSetupColumn("Log ID");
             ImGui::TableSetupColumn("User ID");
@@ -2236,7 +4950,7 @@ void renderActivityLog(sqlite3* db, const std::string& role) {
                 ImGui::TableSetColumnIndex(2);
                 ImGui::Text("%s", log.action.c_str());
                 ImGui::TableSetColumnIndex(3);
-                ImGui::Text("%s", formatTimestamp(log.timestamp).c_str());
+                ImGui::Text("%s", formatTimestampCached(log.timestamp));
             }
             ImGui::EndTable();
         }
@@ -2246,6 +4960,7 @@ void renderActivityLog(sqlite3* db, const std::string& role) {
 }
 
 void renderAnalytics(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderAnalytics");
     if (role != "admin" && role != "manager") {
         ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Access restricted to Admin or Manager roles.");
         return;
@@ -2256,12 +4971,14 @@ void renderAnalytics(sqlite3* db, const std::string& role) {
     ImGui::PopFont();
     ImGui::Dummy(ImVec2(0, 20));
 
-    SalesData sales = getSalesData(db);
+    static CachedView<SalesData> sales_view;
+    static CachedView<std::vector<TopItem>> top_items_view;
+    const SalesData& sales = sales_view.get([&] { return getSalesData(db); });
     ImGui::Text("Total Sales: Rs %.2f", sales.total_sales);
     ImGui::Text("Total Orders: %d", sales.order_count);
     ImGui::Dummy(ImVec2(0, 10));
 
-    auto top_items = getTopItems(db);
+    const auto& top_items = top_items_view.get([&] { return getTopItems(db); });
     if (ImGui::BeginTable("TopItems", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("Item ID");
         ImGui::TableSetupColumn("Name");
@@ -2279,9 +4996,56 @@ void renderAnalytics(sqlite3* db, const std::string& role) {
         }
         ImGui::EndTable();
     }
+
+    if (role == "admin") {
+        ImGui::Dummy(ImVec2(0, 20));
+        ImGui::Text("SQL Statement Latency");
+        ImGui::SameLine();
+        // Every statement, this page's included, moves the counters; a
+        // once-a-second snapshot is fresh enough to read.
+        static CachedView<std::vector<SqlStatementReport>> statements_view;
+        if (ImGui::Button("Reset SQL Stats")) {
+            SqlTrace::instance().reset();
+            statements_view.clear();
+        }
+        const auto& statements = statements_view.get([] { return SqlTrace::instance().snapshot(); }, std::time(nullptr));
+        if (ImGui::BeginTable("SqlTrace", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0, 300))) {
+            ImGui::TableSetupColumn("Statement");
+            ImGui::TableSetupColumn("Calls");
+            ImGui::TableSetupColumn("Rows");
+            ImGui::TableSetupColumn("Total ms");
+            ImGui::TableSetupColumn("p50 us");
+            ImGui::TableSetupColumn("p99 us");
+            ImGui::TableSetupColumn("Max us");
+            ImGui::TableHeadersRow();
+
+            for (const auto& statement : statements) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%.60s", statement.sql.c_str());
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("%s", statement.sql.c_str());
+                }
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%llu", static_cast<unsigned long long>(statement.calls));
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%llu", static_cast<unsigned long long>(statement.rows));
+                ImGui::TableSetColumnIndex(3);
+                ImGui::Text("%.2f", statement.total_ms);
+                ImGui::TableSetColumnIndex(4);
+                ImGui::Text("%.1f", statement.p50_us);
+                ImGui::TableSetColumnIndex(5);
+                ImGui::Text("%.1f", statement.p99_us);
+                ImGui::TableSetColumnIndex(6);
+                ImGui::Text("%.1f", statement.max_us);
+            }
+            ImGui::EndTable();
+        }
+    }
 }
 
 void renderSettings(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderSettings");
     if (role != "admin") {
         ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Access restricted to Admin role.");
         return;
@@ -2294,19 +5058,26 @@ void renderSettings(sqlite3* db, const std::string& role) {
 
     static float tax_rate = getSetting(db, "tax_rate", 0.08f);
     static float loyalty_earn_rate = getSetting(db, "loyalty_earn_rate", 10.0f);
+    static float loyalty_expiry_days = getSetting(db, "loyalty_expiry_days", kLoyaltyExpiryDays);
     ImGui::InputFloat("Tax Rate", &tax_rate, 0.01f, 0.01f, "%.2f");
     ImGui::InputFloat("Loyalty Earn Rate (Rs per point)", &loyalty_earn_rate, 1.0f, 1.0f, "%.2f");
+    ImGui::InputFloat("Loyalty Points Expire After (days, 0 = never)", &loyalty_expiry_days, 1.0f, 30.0f, "%.0f");
     if (tax_rate < 0) tax_rate = 0;
     if (loyalty_earn_rate < 0) loyalty_earn_rate = 0;
+    if (loyalty_expiry_days < 0) loyalty_expiry_days = 0;
 
     if (ImGui::Button("Save Settings")) {
-        setSetting(db, "tax_rate", tax_rate);
-        setSetting(db, "loyalty_earn_rate", loyalty_earn_rate);
+        runWrite(db, [&](sqlite3* wdb) {
+            setSetting(wdb, "tax_rate", tax_rate);
+            setSetting(wdb, "loyalty_earn_rate", loyalty_earn_rate);
+            setSetting(wdb, "loyalty_expiry_days", loyalty_expiry_days);
+        });
         ImGui::TextColored(ImVec4(0.30f, 0.69f, 0.31f, 1.0f), "Settings saved!");
     }
 }
 
 void renderBackup(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderBackup");
     if (role != "admin") {
         ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Access restricted to Admin role.");
         return;
@@ -2336,9 +5107,55 @@ void renderBackup(sqlite3* db, const std::string& role) {
             ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Restore failed!");
         }
     }
+
+    ImGui::Dummy(ImVec2(0, 20));
+    static std::vector<HashChainReport> chain_reports;
+    if (ImGui::Button("Verify Audit Chains")) {
+        chain_reports = {verifyHashChain(db, kBillsChain), verifyHashChain(db, kActivityLogChain)};
+        logActivity(db, "", "Verified audit hash chains");
+    }
+    ImGui::SameLine();
+    ImGui::Text("SHA-256 engine: %s", sha256EngineName(sha256Engine()));
+    for (const auto& report : chain_reports) {
+        if (report.ok()) {
+            ImGui::TextColored(ImVec4(0.30f, 0.69f, 0.31f, 1.0f), "%s: %lld rows intact (%.2f s)",
+                               report.table.c_str(), report.rows, report.seconds);
+        } else {
+            ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f),
+                               "%s: %lld bad hashes, %lld broken links, %lld unsealed of %lld rows; first bad id %lld",
+                               report.table.c_str(), report.bad_hashes, report.broken_links, report.unsealed,
+                               report.rows, report.first_bad_id);
+        }
+    }
+
+    // Order projection against the order event log.
+    static bool replayed = false;
+    static OrderReplayReport replay_report;
+    if (ImGui::Button("Verify Order Log")) {
+        replay_report = replayOrders(db, false);
+        replayed = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Repair Orders From Log")) {
+        replay_report = runWrite(db, [](sqlite3* wdb) {
+            OrderReplayReport report = replayOrders(wdb, true);
+            logActivity(wdb, "", "Repaired " + std::to_string(report.repaired) + " orders from the order log");
+            return report;
+        }, OrderReplayReport());
+        replayed = true;
+    }
+    if (replayed) {
+        ImVec4 color = replay_report.mismatched == replay_report.repaired ? ImVec4(0.30f, 0.69f, 0.31f, 1.0f)
+                                                                        : ImVec4(0.94f, 0.33f, 0.31f, 1.0f);
+        ImGui::TextColored(color, "%lld orders, %lld from snapshots, %lld events folded: %lld differ from the log, %lld repaired, "
+                                  "%lld without events (%.2f s)",
+                           replay_report.orders, replay_report.snapshots_used, replay_report.events, replay_report.mismatched,
+                           replay_report.repaired, replay_report.without_events, replay_report.seconds);
+    }
 }
 
 void renderUsers(sqlite3* db, const std::string& role) {
+    PROFILE_SCOPE("renderUsers");
     if (role != "admin") {
         ImGui::TextColored(ImVec4(0.94f, 0.33f, 0.31f, 1.0f), "Access restricted to Admin role.");
         return;
@@ -2349,7 +5166,8 @@ void renderUsers(sqlite3* db, const std::string& role) {
     ImGui::PopFont();
     ImGui::Dummy(ImVec2(0, 20));
 
-    auto users = viewUserDetails(db);
+    static CachedView<std::vector<UserDetails>> users_view;
+    const auto& users = users_view.get([&] { return viewUserDetails(db); });
     if (ImGui::BeginTable("Users", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("Username");
         ImGui::TableSetupColumn("Last Order");
@@ -2372,7 +5190,6 @@ void renderUsers(sqlite3* db, const std::string& role) {
     }
 }
 
-enum Page { DASHBOARD, PROFILE, MENU, ORDERS, BILLING, WALLETS, DISCOUNTS, INVENTORY, LOYALTY, ACTIVITY_LOG, ANALYTICS, SETTINGS, BACKUP, USERS };
 enum LoginStage { LOGIN_CREDENTIALS, LOGIN_TOTP };
 
 int main() {
@@ -2382,7 +5199,39 @@ int main() {
         std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
         return -1;
     }
+    SqlTrace::instance().install(db);
     initDatabase(db);
+    sqlite3_busy_timeout(db, 5000);
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+    stockReservations().load(db);
+    recipeBook().load(db);
+    refreshLowStockAlerts(db, false);
+    loadKitchenQueue(db);
+    // CANTEEN_PRINTER is an ESC/POS printer device (e.g. /dev/usb/lp0) or a
+    // spool file that receipts are appended to. Declared before the writer,
+    // whose last bills may still queue receipts.
+    const char* printer_path = std::getenv("CANTEEN_PRINTER");
+    std::unique_ptr<PrinterQueue> printer;
+    if (printer_path && *printer_path) {
+        printer.reset(new PrinterQueue(printer_path));
+        printer_queue = printer.get();
+    }
+    WriteQueue writer(db_path);
+    if (writer.isOpen()) {
+        write_queue = &writer;
+        // First command on the writer thread: trace its connection too.
+        writer.submit([](sqlite3* wdb) { SqlTrace::instance().install(wdb); });
+    }
+
+    // CANTEEN_METRICS_PORT serves /metrics on localhost; CANTEEN_METRICS_FILE is
+    // rewritten every 15 s for node-exporter's textfile collector.
+    SqlTrace::instance().setObserver([](uint64_t ns) { metrics().sql_seconds.observe(ns / 1e9); });
+    const char* metrics_port = std::getenv("CANTEEN_METRICS_PORT");
+    const char* metrics_file = std::getenv("CANTEEN_METRICS_FILE");
+    MetricsExporter metrics_exporter(metrics_port ? std::atoi(metrics_port) : 0, metrics_file ? metrics_file : "");
+#ifdef CANTEEN_PROFILER
+    bool show_profiler = false;
+#endif
 
     if (!glfwInit()) {
         sqlite3_close(db);
@@ -2401,9 +5250,28 @@ int main() {
         sqlite3_close(db);
         return -1;
     }
+
     glfwMakeContextCurrent(window);
     glfwSwapInterval(1);
 
+    // Installed before the ImGui backend, which chains to them.
+    glfwSetKeyCallback(window, [](GLFWwindow*, int, int, int, int) { requestRedraw(); });
+    glfwSetCharCallback(window, [](GLFWwindow*, unsigned int) { requestRedraw(); });
+    glfwSetMouseButtonCallback(window, [](GLFWwindow*, int, int, int) { requestRedraw(); });
+    glfwSetCursorPosCallback(window, [](GLFWwindow*, double, double) { requestRedraw(); });
+    glfwSetCursorEnterCallback(window, [](GLFWwindow*, int) { requestRedraw(); });
+    glfwSetScrollCallback(window, [](GLFWwindow*, double, double) { requestRedraw(); });
+    glfwSetWindowFocusCallback(window, [](GLFWwindow*, int) { requestRedraw(); });
+    glfwSetWindowSizeCallback(window, [](GLFWwindow*, int, int) { requestRedraw(); });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow*, int, int) { requestRedraw(); });
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow*) { requestRedraw(); });
+    if (write_queue) {
+        write_queue->setOnCommit([] {
+            requestRedraw();
+            glfwPostEmptyEvent();
+        });
+    }
+
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
@@ -2436,6 +5304,17 @@ int main() {
         return -1;
     }
 
+    // Training reads the whole order history, so it runs on its own
+    // connection while the first frames draw; createOrder() keeps it current
+    // after. Started past the last early return, which would skip the join.
+    std::thread forecast_trainer([db_path] {
+        sqlite3* tdb;
+        if (sqlite3_open_v2(db_path, &tdb, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+            demandForecaster().train(tdb);
+        }
+        sqlite3_close(tdb);
+    });
+
     char username[128] = "";
     char password[128] = "";
     char totp_code[7] = "";
@@ -2448,10 +5327,70 @@ int main() {
     bool logged_in = false;
     float panel_alpha = 1.0f;
     Page current_page = DASHBOARD;
+    BillingHandoff billing_handoff;
     LoginStage login_stage = LOGIN_CREDENTIALS;
 
+    const double idle_wait_seconds = 0.25;
+    int data_version = getDataVersion(db);
+    uint64_t seen_writer_commits = write_queue ? write_queue->commitCount() : 0;
+    uint64_t seen_foreign_commits = write_queue ? write_queue->foreignCommitCount() : 0;
+    auto next_expiry_sweep = std::chrono::steady_clock::now();
+    time_t kitchen_clock = 0;
+    // Input events redraw on their own; a focused text field only needs a
+    // frame per cursor blink phase (the idle wait is shorter than this).
+    const auto cursor_blink_interval = std::chrono::milliseconds(500);
+    auto next_cursor_blink = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+        if (redraw_frames.load(std::memory_order_relaxed) > 0) {
+            glfwPollEvents();
+        } else {
+            glfwWaitEventsTimeout(idle_wait_seconds);
+        }
+        int current_version = getDataVersion(db);
+        if (current_version != data_version) {
+            data_version = current_version;
+            invalidateViews();
+            // This process's writes keep the counters, recipes, alerts and kitchen
+            // current as they commit; only another connection's need a reload.
+            uint64_t writer_commits = write_queue ? write_queue->commitCount() : 0;
+            uint64_t foreign_commits = write_queue ? write_queue->foreignCommitCount() : 0;
+            if (writer_commits == seen_writer_commits || foreign_commits != seen_foreign_commits) {
+                stockReservations().load(db);   // inventory may have changed under the counters
+                recipeBook().load(db);
+                refreshLowStockAlerts(db, true);
+                loadKitchenQueue(db);   // orders taken at other counters
+            }
+            seen_writer_commits = writer_commits;
+            seen_foreign_commits = foreign_commits;
+            requestRedraw();
+        }
+        if (io.WantTextInput && std::chrono::steady_clock::now() >= next_cursor_blink) {
+            next_cursor_blink = std::chrono::steady_clock::now() + cursor_blink_interval;
+            requestRedraw(1);
+        }
+        if (kitchenQueue().drain() > 0) {
+            requestRedraw();
+        }
+        if (current_page == KITCHEN && kitchenQueue().pending() > 0 && std::time(nullptr) != kitchen_clock) {
+            kitchen_clock = std::time(nullptr);   // ticket ages tick once a second
+            requestRedraw(1);
+        }
+        if (write_queue && loyaltyAccruals().due()) {
+            write_queue->submit(flushLoyaltyAccruals);
+        }
+        if (write_queue && std::chrono::steady_clock::now() >= next_expiry_sweep) {
+            next_expiry_sweep = std::chrono::steady_clock::now() + kLoyaltyExpirySweepInterval;
+            write_queue->submit([](sqlite3* wdb) { return expireLoyaltyLots(wdb, std::time(nullptr)); });
+        }
+        if (!consumeRedraw()) {
+            continue;
+        }
+
+        auto frame_started = std::chrono::steady_clock::now();
+#ifdef CANTEEN_PROFILER
+        Profiler::instance().beginFrame(logged_in ? pageName(current_page) : "Login");
+#endif
+        frameArena().reset();
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -2541,6 +5480,7 @@ int main() {
                 ImGui::TextColored(status_color, "%s", status.c_str());
                 status_alpha -= 0.01f;
                 if (status_alpha < 0.0f) status_alpha = 0.0f;
+                if (status_alpha > 0.0f) requestRedraw(1);
             }
 
             ImGui::End();
@@ -2565,6 +5505,11 @@ int main() {
             if (ImGui::Button("Orders", ImVec2(150, 40))) {
                 current_page = ORDERS;
             }
+            char kitchen_label[64];
+            snprintf(kitchen_label, sizeof(kitchen_label), "Kitchen (%zu)###Kitchen", kitchenQueue().pending());
+            if (ImGui::Button(kitchen_label, ImVec2(150, 40))) {
+                current_page = KITCHEN;
+            }
             if (ImGui::Button("Billing", ImVec2(150, 40))) {
                 current_page = BILLING;
             }
@@ -2579,7 +5524,10 @@ int main() {
                 }
             }
             if (user_role == "admin" || user_role == "manager") {
-                if (ImGui::Button("Inventory", ImVec2(150, 40))) {
+                size_t low_stock = lowStockAlerts().count();
+                char label[64] = "Inventory###Inventory";
+                if (low_stock) snprintf(label, sizeof(label), "Inventory (%zu low)###Inventory", low_stock);
+                if (ImGui::Button(label, ImVec2(150, 40))) {
                     current_page = INVENTORY;
                 }
             }
@@ -2624,6 +5572,7 @@ int main() {
                 totp_code[0] = '\0';
                 pending_totp_secret = "";
                 current_page = DASHBOARD;
+                billing_handoff = BillingHandoff();
                 login_stage = LOGIN_CREDENTIALS;
                 logActivity(db, logged_in_username, "User logged out");
             }
@@ -2642,13 +5591,16 @@ int main() {
                     renderMenuManagement(db, user_role);
                     break;
                 case ORDERS:
-                    renderOrderManagement(db, user_role);
+                    renderOrderManagement(db, user_role, current_page, billing_handoff);
+                    break;
+                case KITCHEN:
+                    renderKitchen(db);
                     break;
                 case BILLING:
-                    renderBilling(db, user_role, logged_in_username);
+                    renderBilling(db, user_role, logged_in_username, billing_handoff);
                     break;
                 case WALLETS:
-                    renderWallets(db, user_role);
+                    renderWallets(db, user_role, logged_in_username);
                     break;
                 case DISCOUNTS:
                     renderDiscounts(db, user_role);
@@ -2678,7 +5630,19 @@ int main() {
             ImGui::EndGroup();
 
             ImGui::End();
+            renderLowStockToasts();
+        }
+
+#ifdef CANTEEN_PROFILER
+        // Ctrl+Shift+P; the F-keys are taken by rapid entry tiles.
+        if (io.KeyCtrl && io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_P, false)) {
+            show_profiler = !show_profiler;
+        }
+        if (show_profiler) {
+            Profiler::instance().draw(&show_profiler);
+            requestRedraw(1);   // the overlay measures frames, so keep producing them
         }
+#endif
 
         ImGui::Render();
         int display_w, display_h;
@@ -2687,15 +5651,32 @@ int main() {
         glClearColor(0.07f, 0.08f, 0.09f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+#ifdef CANTEEN_PROFILER
+        Profiler::instance().endFrame(frameArena().bytesUsed());
+#endif
+        metrics().frame_seconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_started).count());
     }
 
+    if (write_queue) {
+        write_queue->setOnCommit(nullptr);   // GLFW is about to go away
+    }
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
     glfwDestroyWindow(window);
     glfwTerminate();
+    metrics_exporter.stop();
+    forecast_trainer.join();
+    runWrite(db, flushLoyaltyAccruals, -1);
+    write_queue = nullptr;
+    printer_queue = nullptr;
+    SqlTrace::instance().dump(std::cerr);
     sqlite3_close(db);
 
     return 0;
 }
+#endif
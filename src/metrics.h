@@ -0,0 +1,328 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#if defined(MSG_NOSIGNAL)
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;   // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+// Metrics with Prometheus text exposition. Updates are single atomic
+// operations; only registration and rendering take the registry mutex.
+
+class MetricCounter {
+public:
+    void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+class MetricGauge {
+public:
+    void set(double v) { value.store(v, std::memory_order_relaxed); }
+    void add(double delta) {
+        double current = value.load(std::memory_order_relaxed);
+        while (!value.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+        }
+    }
+    double get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value{0.0};
+};
+
+class MetricHistogram {
+public:
+    explicit MetricHistogram(std::vector<double> bounds)
+        : bounds(std::move(bounds)), counts(new std::atomic<uint64_t>[this->bounds.size() + 1]) {
+        for (size_t i = 0; i <= this->bounds.size(); i++) counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    void observe(double v) {
+        size_t i = 0;
+        while (i < bounds.size() && v > bounds[i]) i++;
+        counts[i].fetch_add(1, std::memory_order_relaxed);
+        double current = sum.load(std::memory_order_relaxed);
+        while (!sum.compare_exchange_weak(current, current + v, std::memory_order_relaxed)) {
+        }
+    }
+
+    void render(std::ostream& out, const std::string& name) const {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < bounds.size(); i++) {
+            cumulative += counts[i].load(std::memory_order_relaxed);
+            out << name << "_bucket{le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+        }
+        cumulative += counts[bounds.size()].load(std::memory_order_relaxed);
+        out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+        out << name << "_sum " << sum.load(std::memory_order_relaxed) << "\n";
+        out << name << "_count " << cumulative << "\n";
+    }
+
+    // Upper bounds growing by `factor`, e.g. exponentialBuckets(0.001, 2, 11).
+    static std::vector<double> exponentialBuckets(double start, double factor, int count) {
+        std::vector<double> bounds;
+        for (int i = 0; i < count; i++, start *= factor) bounds.push_back(start);
+        return bounds;
+    }
+
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<double> sum{0.0};
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    MetricCounter& counter(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.emplace_back();
+        entries.push_back({name, help, "counter", &counters.back(), nullptr, nullptr, nullptr});
+        return counters.back();
+    }
+
+    MetricGauge& gauge(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        gauges.emplace_back();
+        entries.push_back({name, help, "gauge", nullptr, &gauges.back(), nullptr, nullptr});
+        return gauges.back();
+    }
+
+    // Gauge sampled when the metrics are rendered, for values that already live elsewhere.
+    void gauge(const std::string& name, const std::string& help, std::function<double()> sample) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.push_back({name, help, "gauge", nullptr, nullptr, nullptr, std::move(sample)});
+    }
+
+    MetricHistogram& histogram(const std::string& name, const std::string& help, std::vector<double> bounds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        histograms.emplace_back(std::move(bounds));
+        entries.push_back({name, help, "histogram", nullptr, nullptr, &histograms.back(), nullptr});
+        return histograms.back();
+    }
+
+    std::string render() {
+        std::ostringstream out;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : entries) {
+            out << "# HELP " << entry.name << " " << entry.help << "\n";
+            out << "# TYPE " << entry.name << " " << entry.type << "\n";
+            if (entry.counter) {
+                out << entry.name << " " << entry.counter->get() << "\n";
+            } else if (entry.gauge) {
+                out << entry.name << " " << entry.gauge->get() << "\n";
+            } else if (entry.histogram) {
+                entry.histogram->render(out, entry.name);
+            } else if (entry.sample) {
+                out << entry.name << " " << entry.sample() << "\n";
+            }
+        }
+        return out.str();
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        std::string help;
+        const char* type;
+        MetricCounter* counter;
+        MetricGauge* gauge;
+        MetricHistogram* histogram;
+        std::function<double()> sample;
+    };
+
+    MetricsRegistry() = default;
+
+    std::mutex mutex;
+    std::deque<MetricCounter> counters;      // deques keep element addresses stable
+    std::deque<MetricGauge> gauges;
+    std::deque<MetricHistogram> histograms;
+    std::vector<Entry> entries;
+};
+
+// Serves the registry on 127.0.0.1:<port>/metrics and/or rewrites a textfile
+// for node-exporter's textfile collector (written to a temp file and renamed,
+// so the collector never reads a partial file). One background thread does both.
+class MetricsExporter {
+public:
+    MetricsExporter(int port, const std::string& textfile_path, std::chrono::seconds interval = std::chrono::seconds(15))
+        : textfile_path(textfile_path), interval(interval) {
+        if (port > 0) {
+            listen_fd = openListener(port);
+        }
+        if (listen_fd >= 0 || !textfile_path.empty()) {
+            worker = std::thread(&MetricsExporter::run, this);
+        }
+    }
+
+    ~MetricsExporter() { stop(); }
+
+    void stop() {
+        stopping.store(true);
+        if (worker.joinable()) {
+            worker.join();
+        }
+#ifndef _WIN32
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            listen_fd = -1;
+        }
+#endif
+    }
+
+    bool writeTextfile() {
+        std::string tmp_path = textfile_path + ".tmp";
+        {
+            std::ofstream file(tmp_path, std::ios::trunc);
+            if (!file) {
+                std::cerr << "Failed to write metrics file: " << tmp_path << std::endl;
+                return false;
+            }
+            file << MetricsRegistry::instance().render();
+        }
+        if (std::rename(tmp_path.c_str(), textfile_path.c_str()) != 0) {
+            std::cerr << "Failed to rename metrics file to " << textfile_path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    int openListener(int port) {
+#ifndef _WIN32
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            std::cerr << "Metrics listener: socket() failed" << std::endl;
+            return -1;
+        }
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);   // never exposed beyond this machine
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+            std::cerr << "Metrics listener: cannot listen on 127.0.0.1:" << port << std::endl;
+            close(fd);
+            return -1;
+        }
+        std::cerr << "Serving metrics on http://127.0.0.1:" << port << "/metrics" << std::endl;
+        return fd;
+#else
+        std::cerr << "Metrics listener is not supported on this platform; use the textfile exporter" << std::endl;
+        return -1;
+#endif
+    }
+
+    void serveOne() {
+#ifndef _WIN32
+        int client = accept(listen_fd, nullptr, nullptr);
+        if (client < 0) return;
+        // A client that connects and then stalls must not hold up the
+        // exporter thread (and with it stop()).
+        timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        char request[1024];
+        ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+        std::string response;
+        if (n > 0 && std::string(request, n).rfind("GET /metrics", 0) == 0) {
+            std::string body = MetricsRegistry::instance().render();
+            response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                       std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        } else {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        // A client that hung up gets EPIPE here, not a SIGPIPE that kills the app.
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t written = send(client, response.data() + sent, response.size() - sent, kSendFlags);
+            if (written <= 0) break;
+            sent += static_cast<size_t>(written);
+        }
+        close(client);
+#endif
+    }
+
+    void run() {
+        auto next_write = std::chrono::steady_clock::now();
+        while (!stopping.load()) {
+            if (!textfile_path.empty() && std::chrono::steady_clock::now() >= next_write) {
+                writeTextfile();
+                next_write = std::chrono::steady_clock::now() + interval;
+            }
+#ifndef _WIN32
+            if (listen_fd >= 0) {
+                pollfd pfd{listen_fd, POLLIN, 0};
+                if (poll(&pfd, 1, 200) > 0 && (pfd.revents & POLLIN)) {
+                    serveOne();
+                }
+                continue;
+            }
+#endif
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        if (!textfile_path.empty()) {
+            writeTextfile();
+        }
+    }
+
+    std::string textfile_path;
+    std::chrono::seconds interval;
+    int listen_fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+};
+
+#endif
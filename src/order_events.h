@@ -0,0 +1,602 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ORDER_EVENTS_H
+#define ORDER_EVENTS_H
+
+#include <sqlite3.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Order lifecycle as an append-only log. Every transition is one typed row in
+// order_events and rows are never updated or deleted. The orders table (status,
+// total, rush) and bills.refunded are the projection of that log: each append
+// applies its event to them in the same statement sequence, and replayOrders()
+// can recompute and repair them from the log at any time.
+//
+// order_snapshots holds every order's folded state up to a point in the log,
+// refreshed every kOrderSnapshotInterval events, so a replay only folds the
+// events since each order's snapshot.
+enum class OrderEventType { CREATED, ITEM_ADDED, BILLED, COMPLETED, CANCELED, REFUNDED, RUSH };
+
+struct OrderEvent {
+    long long event_id = 0;
+    long long order_id = 0;
+    OrderEventType type = OrderEventType::CREATED;
+    int item_id = 0;            // ITEM_ADDED
+    int quantity = 0;           // ITEM_ADDED; 1/0 for RUSH
+    double amount = 0.0;        // order total, line price or bill total
+    long long bill_id = 0;      // BILLED, REFUNDED
+    std::string user_id;        // customer for CREATED, otherwise who did it
+    long long created_at = 0;
+};
+
+// Folded state of one order.
+struct OrderState {
+    std::string status;         // empty until CREATED
+    double total = 0.0;
+    bool rush = false;
+    long long bill_id = 0;
+    bool refunded = false;
+    std::map<int, int> items;   // item_id -> quantity
+    long long through_event_id = 0;
+};
+
+struct OrderReplayReport {
+    long long orders = 0;
+    long long events = 0;              // folded in this replay
+    long long snapshots_used = 0;
+    long long mismatched = 0;          // projection differed from the log
+    long long without_events = 0;
+    long long repaired = 0;
+    long long first_mismatch = -1;
+    double seconds = 0.0;
+};
+
+const long long kOrderSnapshotInterval = 1024;
+
+static const char* const kOrderEventNames[] = {"created", "item_added", "billed", "completed", "canceled", "refunded", "rush"};
+
+const char* orderEventName(OrderEventType type) {
+    return kOrderEventNames[static_cast<int>(type)];
+}
+
+bool parseOrderEventType(const char* name, OrderEventType& type) {
+    for (int i = 0; i < 7; i++) {
+        if (name && std::string(name) == kOrderEventNames[i]) {
+            type = static_cast<OrderEventType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void applyOrderEvent(OrderState& state, const OrderEvent& event) {
+    switch (event.type) {
+        case OrderEventType::CREATED:
+            state.status = "pending";
+            state.total = event.amount;
+            break;
+        case OrderEventType::ITEM_ADDED:
+            state.items[event.item_id] += event.quantity;
+            break;
+        case OrderEventType::BILLED:
+            state.bill_id = event.bill_id;
+            break;
+        case OrderEventType::COMPLETED:
+            state.status = "completed";
+            break;
+        case OrderEventType::CANCELED:
+            state.status = "canceled";
+            break;
+        case OrderEventType::REFUNDED:
+            state.refunded = true;
+            break;
+        case OrderEventType::RUSH:
+            state.rush = event.quantity != 0;
+            break;
+    }
+    state.through_event_id = event.event_id;
+}
+
+// Snapshot items as "item_id:quantity,..."
+std::string encodeOrderItems(const std::map<int, int>& items) {
+    std::string out;
+    for (const auto& item : items) {
+        if (!out.empty()) out += ',';
+        out += std::to_string(item.first) + ':' + std::to_string(item.second);
+    }
+    return out;
+}
+
+std::map<int, int> decodeOrderItems(const char* text) {
+    std::map<int, int> items;
+    std::stringstream ss(text ? text : "");
+    std::string entry;
+    while (std::getline(ss, entry, ',')) {
+        size_t colon = entry.find(':');
+        if (colon != std::string::npos) {
+            items[std::atoi(entry.c_str())] = std::atoi(entry.c_str() + colon + 1);
+        }
+    }
+    return items;
+}
+
+#define ORDER_EVENT_COLUMNS "event_id, order_id, type, item_id, quantity, amount, bill_id, user_id, created_at"
+
+// Reads a row selected with ORDER_EVENT_COLUMNS. False for an unknown type.
+bool readOrderEvent(sqlite3_stmt* stmt, OrderEvent& event) {
+    event.event_id = sqlite3_column_int64(stmt, 0);
+    event.order_id = sqlite3_column_int64(stmt, 1);
+    event.item_id = sqlite3_column_int(stmt, 3);
+    event.quantity = sqlite3_column_int(stmt, 4);
+    event.amount = sqlite3_column_double(stmt, 5);
+    event.bill_id = sqlite3_column_int64(stmt, 6);
+    event.user_id = sqlite3_column_text(stmt, 7) ? reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7)) : "";
+    event.created_at = sqlite3_column_int64(stmt, 8);
+    return parseOrderEventType(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)), event.type);
+}
+
+#define ORDER_SNAPSHOT_COLUMNS "status, total, rush, bill_id, refunded, items, through_event_id"
+
+// Reads ORDER_SNAPSHOT_COLUMNS starting at column `first`.
+void readOrderSnapshot(sqlite3_stmt* stmt, int first, OrderState& state) {
+    state.status = reinterpret_cast<const char*>(sqlite3_column_text(stmt, first));
+    state.total = sqlite3_column_double(stmt, first + 1);
+    state.rush = sqlite3_column_int(stmt, first + 2) != 0;
+    state.bill_id = sqlite3_column_int64(stmt, first + 3);
+    state.refunded = sqlite3_column_int(stmt, first + 4) != 0;
+    state.items = decodeOrderItems(reinterpret_cast<const char*>(sqlite3_column_text(stmt, first + 5)));
+    state.through_event_id = sqlite3_column_int64(stmt, first + 6);
+}
+
+long long orderEventSetting(sqlite3* db, const char* key) {
+    sqlite3_stmt* stmt;
+    long long value = 0;
+    if (sqlite3_prepare_v2(db, "SELECT CAST(value AS INTEGER) FROM settings WHERE key = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
+
+void setOrderEventSetting(sqlite3* db, const char* key, long long value) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO settings (key, value) VALUES (?, ?);", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, value);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+}
+
+// Folds the events after the previous snapshot point into order_snapshots,
+// only for orders that have such events.
+bool snapshotOrders(sqlite3* db) {
+    long long from = orderEventSetting(db, "order_snapshot_event_id");
+    long long to = 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(event_id), 0) FROM order_events;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) to = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (to <= from) {
+        return true;
+    }
+
+    sqlite3_stmt* events = nullptr;
+    sqlite3_stmt* load = nullptr;
+    sqlite3_stmt* save = nullptr;
+    const char* events_sql = "SELECT " ORDER_EVENT_COLUMNS " FROM order_events WHERE event_id > ? AND event_id <= ? ORDER BY order_id, event_id;";
+    const char* load_sql = "SELECT " ORDER_SNAPSHOT_COLUMNS " FROM order_snapshots WHERE order_id = ?;";
+    const char* save_sql = "INSERT OR REPLACE INTO order_snapshots (order_id, " ORDER_SNAPSHOT_COLUMNS ") "
+                           "VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(db, events_sql, -1, &events, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, load_sql, -1, &load, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, save_sql, -1, &save, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (order snapshots): " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(events);
+        sqlite3_finalize(load);
+        sqlite3_finalize(save);
+        return false;
+    }
+
+    auto saveState = [&](long long order_id, const OrderState& state) {
+        std::string items = encodeOrderItems(state.items);
+        sqlite3_bind_int64(save, 1, order_id);
+        sqlite3_bind_text(save, 2, state.status.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(save, 3, state.total);
+        sqlite3_bind_int(save, 4, state.rush ? 1 : 0);
+        sqlite3_bind_int64(save, 5, state.bill_id);
+        sqlite3_bind_int(save, 6, state.refunded ? 1 : 0);
+        sqlite3_bind_text(save, 7, items.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(save, 8, state.through_event_id);
+        bool ok = sqlite3_step(save) == SQLITE_DONE;
+        sqlite3_reset(save);
+        return ok;
+    };
+
+    sqlite3_exec(db, "SAVEPOINT order_snapshots;", nullptr, nullptr, nullptr);
+    bool ok = true;
+    long long current = 0;
+    OrderState state;
+    OrderEvent event;
+    sqlite3_bind_int64(events, 1, from);
+    sqlite3_bind_int64(events, 2, to);
+    while (ok && sqlite3_step(events) == SQLITE_ROW) {
+        if (!readOrderEvent(events, event)) continue;
+        if (event.order_id != current) {
+            if (current) ok = saveState(current, state);
+            current = event.order_id;
+            state = OrderState();
+            sqlite3_bind_int64(load, 1, current);
+            if (sqlite3_step(load) == SQLITE_ROW) readOrderSnapshot(load, 0, state);
+            sqlite3_reset(load);
+        }
+        if (event.event_id > state.through_event_id) applyOrderEvent(state, event);
+    }
+    if (ok && current) ok = saveState(current, state);
+    sqlite3_finalize(events);
+    sqlite3_finalize(load);
+    sqlite3_finalize(save);
+    if (ok) {
+        setOrderEventSetting(db, "order_snapshot_event_id", to);
+    } else {
+        std::cerr << "SQL insert error (order snapshots): " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_exec(db, "ROLLBACK TO order_snapshots;", nullptr, nullptr, nullptr);
+    }
+    sqlite3_exec(db, "RELEASE order_snapshots;", nullptr, nullptr, nullptr);
+    return ok;
+}
+
+// Applies one appended event to the projection. CREATED and ITEM_ADDED are
+// projected by the order insert itself, BILLED by the bill insert.
+bool projectOrderEvent(sqlite3* db, const OrderEvent& event) {
+    const char* sql = nullptr;
+    switch (event.type) {
+        case OrderEventType::COMPLETED: sql = "UPDATE orders SET status = 'completed' WHERE order_id = ?1;"; break;
+        case OrderEventType::CANCELED:  sql = "UPDATE orders SET status = 'canceled' WHERE order_id = ?1;"; break;
+        case OrderEventType::RUSH:      sql = "UPDATE orders SET rush = ?2 WHERE order_id = ?1;"; break;
+        case OrderEventType::REFUNDED:  sql = "UPDATE bills SET refunded = 1 WHERE bill_id = ?3;"; break;
+        default: return true;
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (order projection): " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, event.order_id);
+    if (event.type == OrderEventType::RUSH) sqlite3_bind_int(stmt, 2, event.quantity != 0 ? 1 : 0);
+    if (event.type == OrderEventType::REFUNDED) sqlite3_bind_int64(stmt, 3, event.bill_id);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        std::cerr << "SQL update error (order projection): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Snapshots when the last append crossed a multiple of kOrderSnapshotInterval.
+void maybeSnapshotOrders(sqlite3* db, long long last_event_id, long long appended) {
+    if (appended > 0 && last_event_id / kOrderSnapshotInterval != (last_event_id - appended) / kOrderSnapshotInterval) {
+        snapshotOrders(db);
+    }
+}
+
+// Appends an event for an existing order and applies it to the projection,
+// both or neither. `when` is an optional SQL condition on the order's row (alias o), checked in
+// the insert itself, e.g. "o.status = 'pending'". Returns the event_id, 0 if
+// the order is missing or the condition does not hold, -1 on a database error.
+long long appendOrderEvent(sqlite3* db, const OrderEvent& event, const char* when = nullptr) {
+    std::string sql = "INSERT INTO order_events (order_id, type, item_id, quantity, amount, bill_id, user_id, created_at) "
+                      "SELECT o.order_id, ?2, ?3, ?4, ?5, ?6, ?7, ?8 FROM orders o WHERE o.order_id = ?1";
+    if (when) {
+        sql += std::string(" AND (") + when + ")";
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (order_events): " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, event.order_id);
+    sqlite3_bind_text(stmt, 2, orderEventName(event.type), -1, SQLITE_STATIC);
+    if (event.item_id) sqlite3_bind_int(stmt, 3, event.item_id); else sqlite3_bind_null(stmt, 3);
+    sqlite3_bind_int(stmt, 4, event.quantity);
+    sqlite3_bind_double(stmt, 5, event.amount);
+    if (event.bill_id) sqlite3_bind_int64(stmt, 6, event.bill_id); else sqlite3_bind_null(stmt, 6);
+    if (!event.user_id.empty()) sqlite3_bind_text(stmt, 7, event.user_id.c_str(), -1, SQLITE_STATIC); else sqlite3_bind_null(stmt, 7);
+    sqlite3_bind_int64(stmt, 8, event.created_at ? event.created_at : static_cast<long long>(std::time(nullptr)));
+    sqlite3_exec(db, "SAVEPOINT order_event;", nullptr, nullptr, nullptr);
+    long long event_id = -1;
+    if (sqlite3_step(stmt) == SQLITE_DONE) {
+        event_id = sqlite3_changes(db) > 0 ? sqlite3_last_insert_rowid(db) : 0;
+    } else {
+        std::cerr << "SQL insert error (order_events): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+    if (event_id > 0 && !projectOrderEvent(db, event)) {
+        sqlite3_exec(db, "ROLLBACK TO order_event;", nullptr, nullptr, nullptr);
+        event_id = -1;
+    }
+    sqlite3_exec(db, "RELEASE order_event;", nullptr, nullptr, nullptr);
+    if (event_id > 0) {
+        maybeSnapshotOrders(db, event_id, 1);
+    }
+    return event_id;
+}
+
+// Appends events whose projection the caller has already written, such as
+// a new order's CREATED and ITEM_ADDED rows, in one statement.
+bool appendOrderEvents(sqlite3* db, const std::vector<OrderEvent>& events) {
+    if (events.empty()) {
+        return true;
+    }
+    std::string sql = "INSERT INTO order_events (order_id, type, item_id, quantity, amount, bill_id, user_id, created_at) VALUES ";
+    for (size_t i = 0; i < events.size(); i++) {
+        sql += i == 0 ? "(?, ?, ?, ?, ?, ?, ?, ?)" : ", (?, ?, ?, ?, ?, ?, ?, ?)";
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (order_events): " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    int index = 1;
+    for (const auto& event : events) {
+        sqlite3_bind_int64(stmt, index++, event.order_id);
+        sqlite3_bind_text(stmt, index++, orderEventName(event.type), -1, SQLITE_STATIC);
+        if (event.item_id) sqlite3_bind_int(stmt, index, event.item_id);
+        index++;
+        sqlite3_bind_int(stmt, index++, event.quantity);
+        sqlite3_bind_double(stmt, index++, event.amount);
+        if (event.bill_id) sqlite3_bind_int64(stmt, index, event.bill_id);
+        index++;
+        if (!event.user_id.empty()) sqlite3_bind_text(stmt, index, event.user_id.c_str(), -1, SQLITE_STATIC);
+        index++;
+        sqlite3_bind_int64(stmt, index++, event.created_at ? event.created_at : static_cast<long long>(std::time(nullptr)));
+    }
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        std::cerr << "SQL insert error (order_events): " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+    if (ok) {
+        maybeSnapshotOrders(db, sqlite3_last_insert_rowid(db), static_cast<long long>(events.size()));
+    }
+    return ok;
+}
+
+// Every event of one order, oldest first.
+std::vector<OrderEvent> orderTimeline(sqlite3* db, long long order_id) {
+    std::vector<OrderEvent> timeline;
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT " ORDER_EVENT_COLUMNS " FROM order_events WHERE order_id = ? ORDER BY event_id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (order timeline): " << sqlite3_errmsg(db) << std::endl;
+        return timeline;
+    }
+    sqlite3_bind_int64(stmt, 1, order_id);
+    OrderEvent event;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (readOrderEvent(stmt, event)) timeline.push_back(event);
+    }
+    sqlite3_finalize(stmt);
+    return timeline;
+}
+
+// Writes the log for orders that have none: orders placed before the log
+// existed, and rows written directly (canteen_datagen). Times the log cannot
+// know are taken from the bill, else from the order. Only orders above the
+// last backfilled order_id are looked at.
+bool backfillOrderEvents(sqlite3* db) {
+    long long mark = orderEventSetting(db, "order_events_order_id");
+    long long last = 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(order_id), 0) FROM orders;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) last = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (last <= mark) {
+        return true;
+    }
+
+    std::string range = std::to_string(mark);
+    std::string sql =
+        "SAVEPOINT backfill_order_events;"
+        "CREATE TEMP TABLE IF NOT EXISTS backfill_orders (order_id INTEGER PRIMARY KEY, finished_at INTEGER NOT NULL);"
+        "DELETE FROM backfill_orders;"
+        "INSERT INTO backfill_orders (order_id, finished_at) "
+        "SELECT o.order_id, COALESCE(b.billed_at, o.created_at) FROM orders o "
+        "LEFT JOIN (SELECT order_id, MAX(created_at) AS billed_at FROM bills WHERE order_id > " + range + " GROUP BY order_id) b "
+        "ON b.order_id = o.order_id WHERE o.order_id > " + range + " "
+        "AND NOT EXISTS (SELECT 1 FROM order_events e WHERE e.order_id = o.order_id);"
+        "INSERT INTO order_events (order_id, type, item_id, quantity, amount, user_id, created_at) "
+        "SELECT o.order_id, 'created', NULL, 0, o.total, o.user_id, o.created_at "
+        "FROM backfill_orders t JOIN orders o ON o.order_id = t.order_id ORDER BY o.order_id;"
+        "INSERT INTO order_events (order_id, type, item_id, quantity, amount, created_at) "
+        "SELECT oi.order_id, 'item_added', oi.item_id, oi.quantity, oi.price, o.created_at "
+        "FROM backfill_orders t JOIN orders o ON o.order_id = t.order_id JOIN order_items oi ON oi.order_id = t.order_id "
+        "ORDER BY oi.order_id, oi.order_item_id;"
+        "INSERT INTO order_events (order_id, type, amount, bill_id, created_at) "
+        "SELECT b.order_id, 'billed', b.total, b.bill_id, b.created_at "
+        "FROM bills b JOIN backfill_orders t ON t.order_id = b.order_id ORDER BY b.order_id, b.bill_id;"
+        "INSERT INTO order_events (order_id, type, created_at) "
+        "SELECT o.order_id, o.status, t.finished_at FROM backfill_orders t JOIN orders o ON o.order_id = t.order_id "
+        "WHERE o.status IN ('completed', 'canceled') ORDER BY o.order_id;"
+        "INSERT INTO order_events (order_id, type, amount, bill_id, created_at) "
+        "SELECT b.order_id, 'refunded', b.total, b.bill_id, b.created_at "
+        "FROM bills b JOIN backfill_orders t ON t.order_id = b.order_id WHERE b.refunded = 1 ORDER BY b.order_id, b.bill_id;"
+        "INSERT INTO order_events (order_id, type, quantity, created_at) "
+        "SELECT o.order_id, 'rush', 1, o.created_at FROM backfill_orders t JOIN orders o ON o.order_id = t.order_id "
+        "WHERE o.rush = 1 ORDER BY o.order_id;"
+        "INSERT OR REPLACE INTO settings (key, value) VALUES ('order_events_order_id', " + std::to_string(last) + ");"
+        "DROP TABLE backfill_orders;"
+        "RELEASE backfill_order_events;";
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Order event backfill error: " << (errMsg ? errMsg : "") << std::endl;
+        sqlite3_free(errMsg);
+        sqlite3_exec(db, "ROLLBACK TO backfill_order_events; RELEASE backfill_order_events;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    return snapshotOrders(db);
+}
+
+// Creates the log and snapshot tables and backfills orders without events.
+void initOrderEvents(sqlite3* db) {
+    const char* sql = R"(
+        CREATE TABLE IF NOT EXISTS order_events (
+            event_id INTEGER PRIMARY KEY AUTOINCREMENT,
+            order_id INTEGER NOT NULL,
+            type TEXT NOT NULL CHECK (type IN ('created', 'item_added', 'billed', 'completed', 'canceled', 'refunded', 'rush')),
+            item_id INTEGER,
+            quantity INTEGER NOT NULL DEFAULT 0,
+            amount REAL NOT NULL DEFAULT 0,
+            bill_id INTEGER,
+            user_id TEXT,
+            created_at INTEGER NOT NULL
+        );
+        CREATE INDEX IF NOT EXISTS idx_order_events_order ON order_events(order_id, event_id);
+        CREATE TABLE IF NOT EXISTS order_snapshots (
+            order_id INTEGER PRIMARY KEY,
+            status TEXT NOT NULL,
+            total REAL NOT NULL,
+            rush INTEGER NOT NULL DEFAULT 0,
+            bill_id INTEGER NOT NULL DEFAULT 0,
+            refunded INTEGER NOT NULL DEFAULT 0,
+            items TEXT NOT NULL DEFAULT '',
+            through_event_id INTEGER NOT NULL
+        );
+    )";
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Order events init error: " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        return;
+    }
+    backfillOrderEvents(db);
+}
+
+// Recomputes every order from the log and compares it with the projection
+// (orders.status, total, rush and the bill's refunded flag). With
+// use_snapshots each order starts from its snapshot and folds only later
+// events; otherwise the whole log is folded. With repair, differing rows are
+// rewritten from the log. The three cursors are all ordered by order_id, so
+// memory stays flat however many orders there are.
+OrderReplayReport replayOrders(sqlite3* db, bool repair, bool use_snapshots = true) {
+    auto started = std::chrono::steady_clock::now();
+    OrderReplayReport report;
+    long long snapshot_mark = use_snapshots ? orderEventSetting(db, "order_snapshot_event_id") : 0;
+    sqlite3_stmt* orders = nullptr;
+    sqlite3_stmt* snapshots = nullptr;
+    sqlite3_stmt* events = nullptr;
+    sqlite3_stmt* fix_order = nullptr;
+    sqlite3_stmt* fix_bill = nullptr;
+    const char* orders_sql = "SELECT o.order_id, o.status, o.total, o.rush, COALESCE(b.refunded, 0) FROM orders o "
+                             "LEFT JOIN (SELECT order_id, MAX(refunded) AS refunded FROM bills GROUP BY order_id) b "
+                             "ON b.order_id = o.order_id ORDER BY o.order_id;";
+    const char* snapshots_sql = "SELECT order_id, " ORDER_SNAPSHOT_COLUMNS " FROM order_snapshots WHERE ? ORDER BY order_id;";
+    // Events after the snapshot point are few and read in order_id order;
+    // a full replay walks the (order_id, event_id) index instead.
+    const char* events_sql = "SELECT " ORDER_EVENT_COLUMNS " FROM order_events WHERE event_id > ? ORDER BY order_id, event_id;";
+    if (sqlite3_prepare_v2(db, orders_sql, -1, &orders, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, snapshots_sql, -1, &snapshots, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, events_sql, -1, &events, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "UPDATE orders SET status = ?, total = ?, rush = ? WHERE order_id = ?;", -1, &fix_order, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "UPDATE bills SET refunded = ? WHERE order_id = ?;", -1, &fix_bill, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL prepare error (order replay): " << sqlite3_errmsg(db) << std::endl;
+        for (sqlite3_stmt* stmt : {orders, snapshots, events, fix_order, fix_bill}) sqlite3_finalize(stmt);
+        return report;
+    }
+    sqlite3_bind_int(snapshots, 1, use_snapshots ? 1 : 0);
+    sqlite3_bind_int64(events, 1, snapshot_mark);
+
+    if (repair) {
+        sqlite3_exec(db, "SAVEPOINT replay_orders;", nullptr, nullptr, nullptr);
+    }
+    bool have_snapshot = sqlite3_step(snapshots) == SQLITE_ROW;
+    bool have_event = sqlite3_step(events) == SQLITE_ROW;
+    OrderEvent event;
+    while (sqlite3_step(orders) == SQLITE_ROW) {
+        long long order_id = sqlite3_column_int64(orders, 0);
+        report.orders++;
+        OrderState state;
+        // Snapshots and events of orders no longer in the table are skipped.
+        while (have_snapshot && sqlite3_column_int64(snapshots, 0) < order_id) {
+            have_snapshot = sqlite3_step(snapshots) == SQLITE_ROW;
+        }
+        if (have_snapshot && sqlite3_column_int64(snapshots, 0) == order_id) {
+            readOrderSnapshot(snapshots, 1, state);
+            report.snapshots_used++;
+        }
+        while (have_event && sqlite3_column_int64(events, 1) < order_id) {
+            have_event = sqlite3_step(events) == SQLITE_ROW;
+        }
+        while (have_event && sqlite3_column_int64(events, 1) == order_id) {
+            if (readOrderEvent(events, event) && event.event_id > state.through_event_id) {
+                applyOrderEvent(state, event);
+                report.events++;
+            }
+            have_event = sqlite3_step(events) == SQLITE_ROW;
+        }
+        if (state.status.empty()) {
+            report.without_events++;
+            continue;
+        }
+
+        std::string status = reinterpret_cast<const char*>(sqlite3_column_text(orders, 1));
+        bool same = status == state.status &&
+                    std::fabs(sqlite3_column_double(orders, 2) - state.total) < 0.005 &&
+                    (sqlite3_column_int(orders, 3) != 0) == state.rush &&
+                    (sqlite3_column_int(orders, 4) != 0) == state.refunded;
+        if (same) {
+            continue;
+        }
+        report.mismatched++;
+        if (report.first_mismatch < 0) report.first_mismatch = order_id;
+        if (repair) {
+            sqlite3_bind_text(fix_order, 1, state.status.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_double(fix_order, 2, state.total);
+            sqlite3_bind_int(fix_order, 3, state.rush ? 1 : 0);
+            sqlite3_bind_int64(fix_order, 4, order_id);
+            sqlite3_bind_int(fix_bill, 1, state.refunded ? 1 : 0);
+            sqlite3_bind_int64(fix_bill, 2, order_id);
+            if (sqlite3_step(fix_order) == SQLITE_DONE && sqlite3_step(fix_bill) == SQLITE_DONE) {
+                report.repaired++;
+            } else {
+                std::cerr << "SQL update error (order replay): " << sqlite3_errmsg(db) << std::endl;
+            }
+            sqlite3_reset(fix_order);
+            sqlite3_reset(fix_bill);
+        }
+    }
+    for (sqlite3_stmt* stmt : {orders, snapshots, events, fix_order, fix_bill}) sqlite3_finalize(stmt);
+    if (repair) {
+        sqlite3_exec(db, "RELEASE replay_orders;", nullptr, nullptr, nullptr);
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+#endif
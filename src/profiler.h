@@ -0,0 +1,413 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame and scope profiler for the UI loop. Everything below compiles away
+// unless CANTEEN_PROFILER is defined, so PROFILE_SCOPE can stay in hot paths.
+#ifdef CANTEEN_PROFILER
+
+#include <array>
+#include <cfloat>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+class Profiler {
+public:
+    static constexpr int kHistory = 240;
+    static constexpr size_t kWorstFrames = 8;
+
+    struct ScopeStats {
+        const char* name;
+        int calls_this_frame = 0;
+        float ms_this_frame = 0.0f;
+        std::array<float, kHistory> history{};
+        float max_ms = 0.0f;
+        long long total_calls = 0;
+    };
+
+    struct PageStats {
+        const char* name;
+        std::array<float, kHistory> frame_ms{};
+        int cursor = 0;
+        int samples = 0;
+        float max_ms = 0.0f;
+    };
+
+    struct WorstFrame {
+        float ms = 0.0f;
+        const char* page = "";
+        int sql_statements = 0;
+        long long allocations = 0;
+        const char* top_scope = "";
+        float top_scope_ms = 0.0f;
+        long long frame_index = 0;
+    };
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    void beginFrame(const char* page) {
+        if (owner == std::thread::id()) {
+            owner = std::this_thread::get_id();
+        }
+        current_page = page;
+        frame_start = std::chrono::steady_clock::now();
+        sql_at_frame_start = sql_statements.load(std::memory_order_relaxed);
+        allocations_at_frame_start = allocations;
+        in_frame = true;
+    }
+
+    // `arena_bytes` is how much of the frame arena the frame used.
+    void endFrame(size_t arena_bytes = 0) {
+        if (!in_frame) return;
+        in_frame = false;
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+        int sql = static_cast<int>(sql_statements.load(std::memory_order_relaxed) - sql_at_frame_start);
+        long long allocs = allocations - allocations_at_frame_start;
+
+        frame_ms[cursor] = ms;
+        sql_per_frame[cursor] = static_cast<float>(sql);
+        last_frame_ms = ms;
+        last_frame_sql = sql;
+        allocations_per_frame[cursor] = static_cast<float>(allocs);
+        last_frame_allocations = allocs;
+        last_frame_arena_bytes = arena_bytes;
+
+        PageStats& page = pageStats(current_page);
+        page.frame_ms[page.cursor] = ms;
+        page.cursor = (page.cursor + 1) % kHistory;
+        page.samples = std::min(page.samples + 1, kHistory);
+        page.max_ms = std::max(page.max_ms, ms);
+
+        WorstFrame frame;
+        frame.ms = ms;
+        frame.page = current_page;
+        frame.sql_statements = sql;
+        frame.allocations = allocs;
+        frame.frame_index = frame_index;
+        for (auto& scope : scopes) {
+            if (scope.ms_this_frame > frame.top_scope_ms) {
+                frame.top_scope = scope.name;
+                frame.top_scope_ms = scope.ms_this_frame;
+            }
+            scope.history[cursor] = scope.ms_this_frame;
+            scope.max_ms = std::max(scope.max_ms, scope.ms_this_frame);
+            scope.calls_this_frame = 0;
+            scope.ms_this_frame = 0.0f;
+        }
+        if (worst.size() < kWorstFrames || ms > worst.back().ms) {
+            if (worst.size() == kWorstFrames) worst.pop_back();
+            worst.insert(std::upper_bound(worst.begin(), worst.end(), frame,
+                                          [](const WorstFrame& a, const WorstFrame& b) { return a.ms > b.ms; }),
+                         frame);
+        }
+        cursor = (cursor + 1) % kHistory;
+        frame_index++;
+    }
+
+    // Scopes are only attributed to frames on the UI thread; work done on the
+    // writer thread shows up as waiting time in the calling scope instead.
+    void addScope(const char* name, float ms) {
+        if (!in_frame || std::this_thread::get_id() != owner) return;
+        for (auto& scope : scopes) {
+            if (scope.name == name || std::strcmp(scope.name, name) == 0) {
+                scope.calls_this_frame++;
+                scope.ms_this_frame += ms;
+                scope.total_calls++;
+                return;
+            }
+        }
+        ScopeStats scope;
+        scope.name = name;
+        scope.calls_this_frame = 1;
+        scope.ms_this_frame = ms;
+        scope.total_calls = 1;
+        scopes.push_back(scope);
+    }
+
+    // Called from the SQL trace callback (sqltrace.h) for every statement started.
+    void countStatement() { sql_statements.fetch_add(1, std::memory_order_relaxed); }
+
+    // Called from the global operator new below. Per thread, so the writer
+    // thread's allocations are not charged to UI frames.
+    static void countAllocation() { allocations++; }
+    static long long allocationsOnThisThread() { return allocations; }
+
+    void reset() {
+        scopes.clear();
+        pages.clear();
+        worst.clear();
+        frame_ms.fill(0.0f);
+        sql_per_frame.fill(0.0f);
+        allocations_per_frame.fill(0.0f);
+    }
+
+#ifndef CANTEEN_HEADLESS
+    void draw(bool* open);
+#endif
+
+private:
+    Profiler() { worst.reserve(kWorstFrames); }
+
+    PageStats& pageStats(const char* name) {
+        for (auto& page : pages) {
+            if (page.name == name || std::strcmp(page.name, name) == 0) return page;
+        }
+        PageStats page;
+        page.name = name;
+        pages.push_back(page);
+        return pages.back();
+    }
+
+    // Rolling history in chronological order, for plotting.
+    template <size_t N>
+    std::array<float, N> ordered(const std::array<float, N>& ring, int start) const {
+        std::array<float, N> out;
+        for (size_t i = 0; i < N; i++) out[i] = ring[(start + i) % N];
+        return out;
+    }
+
+    std::thread::id owner;
+    bool in_frame = false;
+    const char* current_page = "";
+    std::chrono::steady_clock::time_point frame_start;
+    std::atomic<long long> sql_statements{0};
+    long long sql_at_frame_start = 0;
+    static inline thread_local long long allocations = 0;
+    long long allocations_at_frame_start = 0;
+    long long frame_index = 0;
+    int cursor = 0;
+    float last_frame_ms = 0.0f;
+    int last_frame_sql = 0;
+    long long last_frame_allocations = 0;
+    size_t last_frame_arena_bytes = 0;
+    std::array<float, kHistory> frame_ms{};
+    std::array<float, kHistory> sql_per_frame{};
+    std::array<float, kHistory> allocations_per_frame{};
+    std::vector<ScopeStats> scopes;
+    std::vector<PageStats> pages;
+    std::vector<WorstFrame> worst;
+};
+
+#ifndef CANTEEN_HEADLESS
+void Profiler::draw(bool* open) {
+    ImGui::SetNextWindowSize(ImVec2(720, 640), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Profiler", open)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("Frame %.2f ms (%.0f fps)   SQL statements: %d", last_frame_ms,
+                last_frame_ms > 0 ? 1000.0f / last_frame_ms : 0.0f, last_frame_sql);
+    ImGui::Text("Heap allocations: %lld   Frame arena: %.1f KB", last_frame_allocations, last_frame_arena_bytes / 1024.0f);
+    auto frames = ordered(frame_ms, cursor);
+    ImGui::PlotLines("Frame ms", frames.data(), kHistory, 0, nullptr, 0.0f, FLT_MAX, ImVec2(-1, 60));
+    auto sql = ordered(sql_per_frame, cursor);
+    ImGui::PlotHistogram("SQL / frame", sql.data(), kHistory, 0, nullptr, 0.0f, FLT_MAX, ImVec2(-1, 40));
+    auto allocs = ordered(allocations_per_frame, cursor);
+    ImGui::PlotHistogram("Allocations / frame", allocs.data(), kHistory, 0, nullptr, 0.0f, FLT_MAX, ImVec2(-1, 40));
+    if (ImGui::Button("Reset")) {
+        reset();
+    }
+
+    if (ImGui::CollapsingHeader("Pages", ImGuiTreeNodeFlags_DefaultOpen) &&
+        ImGui::BeginTable("ProfilerPages", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Page");
+        ImGui::TableSetupColumn("Avg ms");
+        ImGui::TableSetupColumn("p95 ms");
+        ImGui::TableSetupColumn("Max ms");
+        ImGui::TableSetupColumn("Distribution");
+        ImGui::TableHeadersRow();
+        for (const auto& page : pages) {
+            // Sorted on the stack: the overlay must not allocate in the frames it measures.
+            int samples = page.samples;
+            std::array<float, kHistory> sorted = page.frame_ms;
+            std::sort(sorted.begin(), sorted.begin() + samples);
+            float sum = 0.0f;
+            for (int i = 0; i < samples; i++) sum += sorted[i];
+            // Bucket the rolling window into 16 bins between 0 and the window max.
+            std::array<float, 16> bins{};
+            float top = samples == 0 ? 1.0f : std::max(sorted[samples - 1], 0.001f);
+            for (int i = 0; i < samples; i++) bins[std::min<size_t>(15, static_cast<size_t>(sorted[i] / top * 16))] += 1.0f;
+
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", page.name);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.2f", samples == 0 ? 0.0f : sum / samples);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.2f", samples == 0 ? 0.0f : sorted[samples * 95 / 100]);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.2f", page.max_ms);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::PushID(page.name);
+            ImGui::PlotHistogram("##dist", bins.data(), 16, 0, nullptr, 0.0f, FLT_MAX, ImVec2(160, 24));
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
+    if (ImGui::CollapsingHeader("Scopes", ImGuiTreeNodeFlags_DefaultOpen) &&
+        ImGui::BeginTable("ProfilerScopes", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Last ms");
+        ImGui::TableSetupColumn("Avg ms");
+        ImGui::TableSetupColumn("Max ms");
+        ImGui::TableSetupColumn("History");
+        ImGui::TableHeadersRow();
+        int last = (cursor + kHistory - 1) % kHistory;
+        for (const auto& scope : scopes) {
+            float sum = 0.0f;
+            for (float v : scope.history) sum += v;
+            auto history = ordered(scope.history, cursor);
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", scope.name);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%lld", scope.total_calls);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.3f", scope.history[last]);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.3f", sum / kHistory);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%.3f", scope.max_ms);
+            ImGui::TableSetColumnIndex(5);
+            ImGui::PushID(scope.name);
+            ImGui::PlotLines("##history", history.data(), kHistory, 0, nullptr, 0.0f, FLT_MAX, ImVec2(160, 24));
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
+    if (ImGui::CollapsingHeader("Worst Frames", ImGuiTreeNodeFlags_DefaultOpen) &&
+        ImGui::BeginTable("ProfilerWorst", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Frame");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Page");
+        ImGui::TableSetupColumn("SQL");
+        ImGui::TableSetupColumn("Allocations");
+        ImGui::TableSetupColumn("Heaviest Scope");
+        ImGui::TableHeadersRow();
+        for (const auto& frame : worst) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%lld", frame.frame_index);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.2f", frame.ms);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%s", frame.page);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%d", frame.sql_statements);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%lld", frame.allocations);
+            ImGui::TableSetColumnIndex(5);
+            ImGui::Text("%s (%.2f ms)", frame.top_scope, frame.top_scope_ms);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+#endif
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : name(name), start(std::chrono::steady_clock::now()) {}
+    ~ProfileScope() {
+        Profiler::instance().addScope(name, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Counts every C++ heap allocation for the overlay. SQLite and ImGui use
+// malloc directly and are not counted. The whole replaceable set is defined
+// (array, nothrow, sized and aligned forms), so every new is paired with a
+// delete from the same allocator.
+namespace profiler_detail {
+inline void* allocate(std::size_t size) {
+    Profiler::countAllocation();
+    return std::malloc(size ? size : 1);
+}
+
+// aligned_alloc wants a size that is a multiple of the alignment.
+inline void* allocate(std::size_t size, std::align_val_t align) {
+    Profiler::countAllocation();
+    std::size_t alignment = static_cast<std::size_t>(align);
+    std::size_t rounded = size ? (size + alignment - 1) / alignment * alignment : alignment;
+    return std::aligned_alloc(alignment, rounded);
+}
+
+template <typename... Align>
+void* allocateOrThrow(std::size_t size, Align... align) {
+    if (void* p = allocate(size, align...)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+}  // namespace profiler_detail
+
+void* operator new(std::size_t size) { return profiler_detail::allocateOrThrow(size); }
+void* operator new[](std::size_t size) { return profiler_detail::allocateOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return profiler_detail::allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return profiler_detail::allocate(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return profiler_detail::allocateOrThrow(size, align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return profiler_detail::allocateOrThrow(size, align); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return profiler_detail::allocate(size, align);
+}
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return profiler_detail::allocate(size, align);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
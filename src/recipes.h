@@ -0,0 +1,219 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef RECIPES_H
+#define RECIPES_H
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// The bill of materials (recipe_items) as a sparse item x ingredient matrix
+// of quantities per portion, kept twice:
+//
+//   by item (CSR)        row i: the ingredients one portion of item i uses
+//   by ingredient (CSC)  column j: the items that use ingredient j
+//
+// Rows turn a cart into ingredient totals; columns let a stock change
+// re-check only the items that depend on that ingredient. An item is short
+// while any of its ingredients has less than one portion's worth, tracked as
+// a per-item count of short ingredients. Items without a recipe are never
+// short here.
+class RecipeBook {
+public:
+    // Rebuilds the matrix and stock from recipe_items and ingredients.
+    bool load(sqlite3* db) {
+        std::vector<Entry> entries;
+        std::unordered_map<int, int> items, ingredients;
+        std::vector<int> item_ids, ingredient_ids;
+        std::vector<double> ingredient_stock;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT ingredient_id, quantity FROM ingredients ORDER BY ingredient_id;", -1, &stmt, nullptr) !=
+            SQLITE_OK) {
+            std::cerr << "SQL prepare error (ingredients): " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ingredients[sqlite3_column_int(stmt, 0)] = static_cast<int>(ingredient_ids.size());
+            ingredient_ids.push_back(sqlite3_column_int(stmt, 0));
+            ingredient_stock.push_back(sqlite3_column_double(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+
+        const char* sql = "SELECT item_id, ingredient_id, quantity FROM recipe_items WHERE quantity > 0 ORDER BY item_id, ingredient_id;";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (recipe_items): " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto ingredient = ingredients.find(sqlite3_column_int(stmt, 1));
+            if (ingredient == ingredients.end()) continue;   // recipe line for a deleted ingredient
+            int item_id = sqlite3_column_int(stmt, 0);
+            auto item = items.emplace(item_id, static_cast<int>(item_ids.size()));
+            if (item.second) item_ids.push_back(item_id);
+            entries.push_back({item.first->second, ingredient->second, sqlite3_column_double(stmt, 2)});
+        }
+        sqlite3_finalize(stmt);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        item_index.swap(items);
+        ingredient_index.swap(ingredients);
+        this->item_ids.swap(item_ids);
+        this->ingredient_ids.swap(ingredient_ids);
+        stock.swap(ingredient_stock);
+        build(entries);
+        return true;
+    }
+
+    // Ingredient totals for a cart (item_id -> portions): one pass over each
+    // item's row. Keyed by ingredient_id.
+    std::map<int, double> requirements(const std::map<int, int>& quantities) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<int, double> totals;
+        for (const auto& line : quantities) {
+            auto item = item_index.find(line.first);
+            if (item == item_index.end()) continue;
+            for (int k = row_start[item->second]; k < row_start[item->second + 1]; k++) {
+                totals[ingredient_ids[row_ingredient[k]]] += row_quantity[k] * line.second;
+            }
+        }
+        return totals;
+    }
+
+    // Sets an ingredient's stock and re-checks the items in its column.
+    // Returns the item_ids whose availability changed.
+    std::vector<int> setStock(int ingredient_id, double quantity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<int> changed;
+        auto ingredient = ingredient_index.find(ingredient_id);
+        if (ingredient == ingredient_index.end()) {
+            return changed;
+        }
+        int j = ingredient->second;
+        double previous = stock[j];
+        stock[j] = quantity;
+        for (int k = col_start[j]; k < col_start[j + 1]; k++) {
+            bool was_short = previous < col_quantity[k];
+            bool is_short = quantity < col_quantity[k];
+            if (was_short == is_short) continue;
+            int i = col_item[k];
+            bool was_available = short_count[i] == 0;
+            short_count[i] += is_short ? 1 : -1;
+            if (was_available != (short_count[i] == 0)) changed.push_back(item_ids[i]);
+        }
+        return changed;
+    }
+
+    bool available(int item_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto item = item_index.find(item_id);
+        return item == item_index.end() || short_count[item->second] == 0;
+    }
+
+    // Portions the ingredients on hand can make; -1 without a recipe.
+    int portions(int item_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto item = item_index.find(item_id);
+        if (item == item_index.end()) {
+            return -1;
+        }
+        double limit = std::numeric_limits<double>::max();
+        for (int k = row_start[item->second]; k < row_start[item->second + 1]; k++) {
+            limit = std::min(limit, stock[row_ingredient[k]] / row_quantity[k]);
+        }
+        return static_cast<int>(limit);
+    }
+
+    bool hasRecipe(int item_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return item_index.count(item_id) > 0;
+    }
+
+    // Item ids that use the ingredient.
+    std::vector<int> dependents(int ingredient_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<int> result;
+        auto ingredient = ingredient_index.find(ingredient_id);
+        if (ingredient != ingredient_index.end()) {
+            for (int k = col_start[ingredient->second]; k < col_start[ingredient->second + 1]; k++) {
+                result.push_back(item_ids[col_item[k]]);
+            }
+        }
+        return result;
+    }
+
+    size_t dependentCount(int ingredient_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto ingredient = ingredient_index.find(ingredient_id);
+        return ingredient != ingredient_index.end() ? col_start[ingredient->second + 1] - col_start[ingredient->second] : 0;
+    }
+
+private:
+    struct Entry {
+        int item;
+        int ingredient;
+        double quantity;
+    };
+
+    // Entries arrive sorted by item, so the rows fill in order; the columns
+    // are a counting sort of the same entries.
+    void build(const std::vector<Entry>& entries) {
+        size_t items = item_ids.size();
+        size_t ingredients = ingredient_ids.size();
+        row_start.assign(items + 1, 0);
+        col_start.assign(ingredients + 1, 0);
+        row_ingredient.resize(entries.size());
+        row_quantity.resize(entries.size());
+        col_item.resize(entries.size());
+        col_quantity.resize(entries.size());
+        for (size_t k = 0; k < entries.size(); k++) {
+            row_start[entries[k].item + 1]++;
+            col_start[entries[k].ingredient + 1]++;
+            row_ingredient[k] = entries[k].ingredient;
+            row_quantity[k] = entries[k].quantity;
+        }
+        for (size_t i = 0; i < items; i++) row_start[i + 1] += row_start[i];
+        for (size_t j = 0; j < ingredients; j++) col_start[j + 1] += col_start[j];
+        std::vector<int> next(col_start.begin(), col_start.end() - 1);
+        short_count.assign(items, 0);
+        for (const auto& entry : entries) {
+            int k = next[entry.ingredient]++;
+            col_item[k] = entry.item;
+            col_quantity[k] = entry.quantity;
+            if (stock[entry.ingredient] < entry.quantity) short_count[entry.item]++;
+        }
+    }
+
+    std::mutex mutex;
+    std::unordered_map<int, int> item_index;         // item_id -> row
+    std::unordered_map<int, int> ingredient_index;   // ingredient_id -> column
+    std::vector<int> item_ids;
+    std::vector<int> ingredient_ids;
+    std::vector<int> row_start, row_ingredient;
+    std::vector<double> row_quantity;
+    std::vector<int> col_start, col_item;
+    std::vector<double> col_quantity;
+    std::vector<double> stock;                       // per column
+    std::vector<int> short_count;                    // per row
+};
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef RESERVATIONS_H
+#define RESERVATIONS_H
+
+#include <sqlite3.h>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+// In-memory stock counters for carts. Per item:
+//
+//   available = inventory.quantity - stock held by open carts
+//   reserved  = stock held by open carts
+//
+// Both live in one atomic word and every change is a single compare-and-swap
+// of the pair, so two terminals can never both get the last unit, a resync
+// cannot lose a concurrent reservation, and no SQL runs while a cart is
+// built. createOrder() then writes the held stock to inventory and
+// commits the reservation. inventory stays the authority: createOrder()
+// re-checks it, and the counters are resynced whenever it changes.
+class StockReservations {
+public:
+    // Items with a larger id (or no inventory row) are not tracked here;
+    // only createOrder()'s SQL check applies to them.
+    static constexpr int kMaxItemId = 1 << 16;
+
+    StockReservations() : counters(new std::atomic<Counter*>[kMaxItemId]) {
+        for (int i = 0; i < kMaxItemId; i++) {
+            counters[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~StockReservations() {
+        for (int i = 0; i < kMaxItemId; i++) {
+            delete counters[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    StockReservations(const StockReservations&) = delete;
+    StockReservations& operator=(const StockReservations&) = delete;
+
+    // Sets an item's inventory quantity; stock held by carts stays held.
+    void sync(int item_id, int quantity) {
+        Counter* counter = find(item_id, true);
+        if (counter) {
+            update(counter, [quantity](int& available, int& reserved) {
+                available = quantity - reserved;
+                return true;
+            });
+        }
+    }
+
+    // Syncs every item from the inventory table.
+    bool load(sqlite3* db) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT item_id, quantity FROM inventory;", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL prepare error (stock reservations): " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            sync(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    }
+
+    // Holds `quantity` units; false if fewer are available.
+    bool reserve(int item_id, int quantity) {
+        Counter* counter = find(item_id, false);
+        if (!counter) {
+            return true;
+        }
+        return update(counter, [quantity](int& available, int& reserved) {
+            if (available < quantity) {
+                return false;
+            }
+            available -= quantity;
+            reserved += quantity;
+            return true;
+        });
+    }
+
+    // Gives held units back (cart line removed or order not created).
+    void release(int item_id, int quantity) {
+        Counter* counter = find(item_id, false);
+        if (counter) {
+            update(counter, [quantity](int& available, int& reserved) {
+                reserved -= quantity;
+                available += quantity;
+                return true;
+            });
+        }
+    }
+
+    // The order holding these units has taken them from inventory.
+    void commit(int item_id, int quantity) {
+        Counter* counter = find(item_id, false);
+        if (counter) {
+            update(counter, [quantity](int&, int& reserved) {
+                reserved -= quantity;
+                return true;
+            });
+        }
+    }
+
+    // -1 for untracked items.
+    int available(int item_id) {
+        Counter* counter = find(item_id, false);
+        return counter ? availableOf(counter->state.load(std::memory_order_acquire)) : -1;
+    }
+
+    int reserved(int item_id) {
+        Counter* counter = find(item_id, false);
+        return counter ? reservedOf(counter->state.load(std::memory_order_acquire)) : 0;
+    }
+
+private:
+    // One cache line per item, so terminals selling different items do not
+    // contend on the same line.
+    // available in the high half, reserved in the low half.
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> state{0};
+    };
+
+    static int availableOf(uint64_t state) { return static_cast<int32_t>(static_cast<uint32_t>(state >> 32)); }
+    static int reservedOf(uint64_t state) { return static_cast<int32_t>(static_cast<uint32_t>(state)); }
+    static uint64_t pack(int available, int reserved) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(available)) << 32) | static_cast<uint32_t>(reserved);
+    }
+
+    // Applies change(available, reserved) to both counters at once, retrying
+    // on contention. A change returning false leaves them as
+    // they were, and update() returns false.
+    template <typename Change>
+    static bool update(Counter* counter, Change change) {
+        uint64_t state = counter->state.load(std::memory_order_relaxed);
+        while (true) {
+            int available = availableOf(state);
+            int reserved = reservedOf(state);
+            if (!change(available, reserved)) {
+                return false;
+            }
+            if (counter->state.compare_exchange_weak(state, pack(available, reserved), std::memory_order_acq_rel,
+                                                     std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    Counter* find(int item_id, bool create) {
+        if (item_id <= 0 || item_id >= kMaxItemId) {
+            return nullptr;
+        }
+        Counter* counter = counters[item_id].load(std::memory_order_acquire);
+        if (counter || !create) {
+            return counter;
+        }
+        Counter* fresh = new Counter;
+        if (!counters[item_id].compare_exchange_strong(counter, fresh, std::memory_order_acq_rel)) {
+            delete fresh;   // another thread installed one first
+            return counter;
+        }
+        return fresh;
+    }
+
+    std::unique_ptr<std::atomic<Counter*>[]> counters;
+};
+
+#endif
@@ -13,46 +13,350 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
- 
- 
+
+
 #ifndef SHA256_H
 #define SHA256_H
 
 #include <string>
 #include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <array>
 #include <vector>
-#include <random>
 #include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <openssl/evp.h>
 #include <openssl/hmac.h>
+#include <openssl/rand.h>
 #include <openssl/sha.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA256_X86_ACCEL 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+// One message for sha256Batch().
+struct Sha256Input {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Compression engines, picked once at startup from CPUID. setSha256Engine()
+// lets benchmarks force one; unsupported requests are refused.
+enum class Sha256Engine { Scalar, Avx2, ShaNi };
+
+namespace sha256_detail {
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+using TransformFn = void (*)(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+void transformScalar(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    uint32_t w[64];
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (data[i * 4] << 24) | (data[i * 4 + 1] << 16) | (data[i * 4 + 2] << 8) | data[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = (w[i - 15] >> 7 | w[i - 15] << 25) ^ (w[i - 15] >> 18 | w[i - 15] << 14) ^ (w[i - 15] >> 3);
+            uint32_t s1 = (w[i - 2] >> 17 | w[i - 2] << 15) ^ (w[i - 2] >> 19 | w[i - 2] << 13) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        for (int i = 0; i < 64; ++i) {
+            uint32_t S1 = (e >> 6 | e << 26) ^ (e >> 11 | e << 21) ^ (e >> 25 | e << 7);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t temp1 = h + S1 + ch + K[i] + w[i];
+            uint32_t S0 = (a >> 2 | a << 30) ^ (a >> 13 | a << 19) ^ (a >> 22 | a << 10);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = S0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA256_X86_ACCEL
+// Intel SHA extensions: two rounds per sha256rnds2, message schedule in four
+// rotating registers.
+__attribute__((target("sha,sse4.1,ssse3")))
+void transformShaNi(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);                 // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);           // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);        // CDGH
+
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i w[4];
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byte_swap);
+            } else {
+                __m128i& next = w[i % 4];
+                next = _mm_sha256msg1_epu32(next, w[(i + 1) % 4]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[(i + 3) % 4], w[(i + 2) % 4], 4));
+                next = _mm_sha256msg2_epu32(next, w[(i + 3) % 4]);
+            }
+            __m128i msg = _mm_add_epi32(w[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);              // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);           // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);        // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);           // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+// Lambdas do not inherit the target attribute, so the rotate is a macro.
+#define rotr(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+// One block for each of eight independent messages; lanes with a zero mask
+// keep their state.
+__attribute__((target("avx2")))
+void transformAvx2x8(__m256i st[8], const uint8_t* const block[8], __m256i active) {
+    auto be = [&](int lane, int t) {
+        const uint8_t* p = block[lane] + 4 * t;
+        return static_cast<int>((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]);
+    };
+
+    __m256i w[64];
+    for (int t = 0; t < 16; t++) {
+        w[t] = _mm256_set_epi32(be(7, t), be(6, t), be(5, t), be(4, t), be(3, t), be(2, t), be(1, t), be(0, t));
+    }
+    for (int t = 16; t < 64; t++) {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(w[t - 15], 7), rotr(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(w[t - 2], 17), rotr(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; t++) {
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                                         _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(K[t])), w[t])));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(temp1, _mm256_add_epi32(S0, maj));
+    }
+    __m256i out[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; i++) {
+        st[i] = _mm256_blendv_epi8(st[i], _mm256_add_epi32(st[i], out[i]), active);
+    }
+}
+#undef rotr
+
+// Hashes up to eight messages in parallel, lane i <- inputs[i].
+__attribute__((target("avx2")))
+void batchAvx2(const Sha256Input* inputs, size_t count, Sha256Digest* out) {
+    static const uint8_t zero_block[64] = {0};
+    size_t full_blocks[8], total_blocks[8];
+    uint8_t tail[8][128];
+    size_t max_blocks = 0;
+    for (size_t lane = 0; lane < 8; lane++) {
+        if (lane >= count) {
+            full_blocks[lane] = total_blocks[lane] = 0;
+            continue;
+        }
+        size_t size = inputs[lane].size;
+        full_blocks[lane] = size / 64;
+        size_t rest = size % 64;
+        size_t tail_blocks = rest < 56 ? 1 : 2;
+        std::memset(tail[lane], 0, sizeof(tail[lane]));
+        if (rest) std::memcpy(tail[lane], inputs[lane].data + full_blocks[lane] * 64, rest);
+        tail[lane][rest] = 0x80;
+        uint64_t bits = static_cast<uint64_t>(size) * 8;
+        for (int i = 0; i < 8; i++) {
+            tail[lane][tail_blocks * 64 - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+        total_blocks[lane] = full_blocks[lane] + tail_blocks;
+        max_blocks = std::max(max_blocks, total_blocks[lane]);
+    }
+
+    __m256i st[8];
+    for (int i = 0; i < 8; i++) st[i] = _mm256_set1_epi32(static_cast<int>(H0[i]));
+    for (size_t blk = 0; blk < max_blocks; blk++) {
+        const uint8_t* ptrs[8];
+        int mask[8];
+        for (size_t lane = 0; lane < 8; lane++) {
+            bool active = blk < total_blocks[lane];
+            mask[lane] = active ? -1 : 0;
+            if (!active) {
+                ptrs[lane] = zero_block;
+            } else if (blk < full_blocks[lane]) {
+                ptrs[lane] = inputs[lane].data + blk * 64;
+            } else {
+                ptrs[lane] = tail[lane] + (blk - full_blocks[lane]) * 64;
+            }
+        }
+        __m256i active = _mm256_set_epi32(mask[7], mask[6], mask[5], mask[4], mask[3], mask[2], mask[1], mask[0]);
+        transformAvx2x8(st, ptrs, active);
+    }
+
+    alignas(32) uint32_t words[8][8];
+    for (int i = 0; i < 8; i++) _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), st[i]);
+    for (size_t lane = 0; lane < count && lane < 8; lane++) {
+        for (int i = 0; i < 8; i++) {
+            uint32_t v = words[i][lane];
+            out[lane][i * 4] = static_cast<uint8_t>(v >> 24);
+            out[lane][i * 4 + 1] = static_cast<uint8_t>(v >> 16);
+            out[lane][i * 4 + 2] = static_cast<uint8_t>(v >> 8);
+            out[lane][i * 4 + 3] = static_cast<uint8_t>(v);
+        }
+    }
+}
+#endif
+
+bool engineSupported(Sha256Engine engine) {
+    if (engine == Sha256Engine::Scalar) return true;
+#ifdef SHA256_X86_ACCEL
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    bool ssse3 = ecx & (1u << 9);
+    bool sse41 = ecx & (1u << 19);
+    bool osxsave = ecx & (1u << 27);
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    bool sha = ebx & (1u << 29);
+    bool avx2 = ebx & (1u << 5);
+    if (avx2 && osxsave) {
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        avx2 = (xcr0_lo & 6) == 6;   // the OS saves YMM state
+    } else {
+        avx2 = false;
+    }
+    if (engine == Sha256Engine::ShaNi) return sha && sse41 && ssse3;
+    if (engine == Sha256Engine::Avx2) return avx2;
+#endif
+    return false;
+}
+
+Sha256Engine detectEngine() {
+    if (engineSupported(Sha256Engine::ShaNi)) return Sha256Engine::ShaNi;
+    if (engineSupported(Sha256Engine::Avx2)) return Sha256Engine::Avx2;
+    return Sha256Engine::Scalar;
+}
+
+Sha256Engine& activeEngine() {
+    static Sha256Engine engine = detectEngine();
+    return engine;
+}
+
+// Single-stream compression. AVX2 only pays off across several streams, so
+// a lone hash uses scalar code on AVX2-only machines.
+TransformFn activeTransform() {
+#ifdef SHA256_X86_ACCEL
+    if (activeEngine() == Sha256Engine::ShaNi) return transformShaNi;
+#endif
+    return transformScalar;
+}
+
+} // namespace sha256_detail
+
+Sha256Engine sha256Engine() {
+    return sha256_detail::activeEngine();
+}
+
+const char* sha256EngineName(Sha256Engine engine) {
+    switch (engine) {
+        case Sha256Engine::ShaNi: return "sha-ni";
+        case Sha256Engine::Avx2: return "avx2";
+        case Sha256Engine::Scalar: break;
+    }
+    return "scalar";
+}
+
+bool setSha256Engine(Sha256Engine engine) {
+    if (!sha256_detail::engineSupported(engine)) return false;
+    sha256_detail::activeEngine() = engine;
+    return true;
+}
+
+std::string toHex(const uint8_t* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(length * 2, '0');
+    for (size_t i = 0; i < length; i++) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0x0f];
+    }
+    return hex;
+}
+
 // SHA-256 implementation
 class SHA256Hasher {
 public:
     SHA256Hasher();
     void update(const uint8_t* data, size_t length);
     void update(const std::string& data);
+    Sha256Digest digest();
     std::string final();
 
 private:
     uint32_t state[8];
     uint64_t count;
     uint8_t buffer[64];
-    void transform(const uint8_t* data);
+    sha256_detail::TransformFn transform;
 };
 
-SHA256Hasher::SHA256Hasher() {
-    state[0] = 0x6a09e667;
-    state[1] = 0xbb67ae85;
-    state[2] = 0x3c6ef372;
-    state[3] = 0xa54ff53a;
-    state[4] = 0x510e527f;
-    state[5] = 0x9b05688c;
-    state[6] = 0x1f83d9ab;
-    state[7] = 0x5be0cd19;
+SHA256Hasher::SHA256Hasher() : transform(sha256_detail::activeTransform()) {
+    std::copy(sha256_detail::H0, sha256_detail::H0 + 8, state);
     count = 0;
     std::fill(buffer, buffer + 64, 0);
 }
@@ -67,13 +371,16 @@ void SHA256Hasher::update(const uint8_t* data, size_t length) {
         return;
     }
 
-    std::copy(data, data + (64 - j), buffer + j);
-    transform(buffer);
-    i += 64 - j;
+    if (j > 0) {
+        std::copy(data, data + (64 - j), buffer + j);
+        transform(state, buffer, 1);
+        i += 64 - j;
+    }
 
-    while (i + 63 < length) {
-        transform(data + i);
-        i += 64;
+    size_t blocks = (length - i) / 64;
+    if (blocks > 0) {
+        transform(state, data + i, blocks);
+        i += blocks * 64;
     }
 
     std::copy(data + i, data + length, buffer);
@@ -83,76 +390,36 @@ void SHA256Hasher::update(const std::string& data) {
     update(reinterpret_cast<const uint8_t*>(data.c_str()), data.length());
 }
 
-std::string SHA256Hasher::final() {
+// Finishes the hash without touching the heap.
+Sha256Digest SHA256Hasher::digest() {
     uint8_t padding[64] = {0x80};
+    uint8_t length_bytes[8];
     uint64_t bits = count * 8;
     for (int i = 0; i < 8; ++i) {
-        padding[56 + i] = (bits >> (56 - 8 * i)) & 0xff;
+        length_bytes[i] = (bits >> (56 - 8 * i)) & 0xff;
     }
+    update(padding, count % 64 < 56 ? 56 - (count % 64) : 120 - (count % 64));
+    update(length_bytes, 8);
 
-    update(padding, count % 64 < 56 ? 64 - (count % 64) : 128 - (count % 64));
-
-    char hash[65];
+    Sha256Digest out;
     for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            snprintf(hash + (i * 8 + j * 2), 3, "%02x", (state[i] >> (24 - j * 8)) & 0xff);
-        }
+        out[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        out[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        out[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        out[i * 4 + 3] = static_cast<uint8_t>(state[i]);
     }
-    hash[64] = '\0';
-    return std::string(hash);
+    return out;
 }
 
-void SHA256Hasher::transform(const uint8_t* data) {
-    static const uint32_t K[64] = {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-    };
-
-    uint32_t w[64];
-    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
-    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
-
-    for (int i = 0; i < 16; ++i) {
-        w[i] = (data[i * 4] << 24) | (data[i * 4 + 1] << 16) | (data[i * 4 + 2] << 8) | data[i * 4 + 3];
-    }
-    for (int i = 16; i < 64; ++i) {
-        uint32_t s0 = (w[i - 15] >> 7 | w[i - 15] << 25) ^ (w[i - 15] >> 18 | w[i - 15] << 14) ^ (w[i - 15] >> 3);
-        uint32_t s1 = (w[i - 2] >> 17 | w[i - 2] << 15) ^ (w[i - 2] >> 19 | w[i - 2] << 13) ^ (w[i - 2] >> 10);
-        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
-    }
-
-    for (int i = 0; i < 64; ++i) {
-        uint32_t S1 = (e >> 6 | e << 26) ^ (e >> 11 | e << 21) ^ (e >> 25 | e << 7);
-        uint32_t ch = (e & f) ^ (~e & g);
-        uint32_t temp1 = h + S1 + ch + K[i] + w[i];
-        uint32_t S0 = (a >> 2 | a << 30) ^ (a >> 13 | a << 19) ^ (a >> 22 | a << 10);
-        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-        uint32_t temp2 = S0 + maj;
-
-        h = g;
-        g = f;
-        f = e;
-        e = d + temp1;
-        d = c;
-        c = b;
-        b = a;
-        a = temp1 + temp2;
-    }
+std::string SHA256Hasher::final() {
+    Sha256Digest out = digest();
+    return toHex(out.data(), out.size());
+}
 
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-    state[4] += e;
-    state[5] += f;
-    state[6] += g;
-    state[7] += h;
+Sha256Digest sha256Digest(const uint8_t* data, size_t length) {
+    SHA256Hasher sha;
+    sha.update(data, length);
+    return sha.digest();
 }
 
 std::string sha256(const std::string& input) {
@@ -161,32 +428,39 @@ std::string sha256(const std::string& input) {
     return sha.final();
 }
 
-// HMAC-SHA1 using OpenSSL
-std::vector<uint8_t> hmac_sha1(const std::vector<uint8_t>& key, const std::vector<uint8_t>& message) {
-    std::vector<uint8_t> hash(SHA_DIGEST_LENGTH);
-    unsigned int len;
-    
-    HMAC(EVP_sha1(), key.data(), key.size(), message.data(), message.size(), hash.data(), &len);
-    
-    std::cerr << "HMAC: Final hash: ";
-    for (uint8_t b : hash) {
-        std::cerr << std::hex << std::setw(2) << std::setfill('0') << (int)b << " ";
+// Hashes many independent messages: eight at a time on AVX2 (faster than
+// SHA-NI one by one for short rows), otherwise one after another on the
+// single-stream engine. Only a forced Scalar engine disables the AVX2 lanes.
+void sha256Batch(const Sha256Input* inputs, size_t count, Sha256Digest* out) {
+#ifdef SHA256_X86_ACCEL
+    static const bool avx2 = sha256_detail::engineSupported(Sha256Engine::Avx2);
+    if (avx2 && sha256Engine() != Sha256Engine::Scalar) {
+        for (size_t i = 0; i < count; i += 8) {
+            sha256_detail::batchAvx2(inputs + i, std::min<size_t>(8, count - i), out + i);
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        out[i] = sha256Digest(inputs[i].data, inputs[i].size);
     }
-    std::cerr << std::dec << std::endl;
-    
-    return hash;
 }
 
+// TOTP tracing is compiled in only with -DTOTP_DEBUG; the login path stays silent.
+#ifdef TOTP_DEBUG
+#define TOTP_TRACE(expr) (std::cerr << "TOTP: " << expr << std::endl)
+#else
+#define TOTP_TRACE(expr) ((void)0)
+#endif
+
 // Base32 encoding
+// Returns an empty string if the system CSPRNG fails.
 std::string generate_base32_secret() {
     static const char* base32_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 255);
-
     std::vector<uint8_t> raw_secret(10); // 10 bytes = 16 base32 chars
-    for (auto& byte : raw_secret) {
-        byte = dis(gen);
+    if (RAND_bytes(raw_secret.data(), static_cast<int>(raw_secret.size())) != 1) {
+        std::cerr << "RAND_bytes failed; cannot generate a secret" << std::endl;
+        return "";
     }
 
     std::string base32;
@@ -210,15 +484,16 @@ std::string generate_base32_secret() {
 std::vector<uint8_t> base32_decode(const std::string& base32) {
     static const char* base32_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
     std::vector<uint8_t> result;
+    result.reserve(base32.size() * 5 / 8);
     uint64_t buffer = 0;
     int bits = 0;
 
-    std::string cleaned_base32 = base32;
-    cleaned_base32.erase(std::remove(cleaned_base32.begin(), cleaned_base32.end(), '='), cleaned_base32.end());
-
-    for (char c : cleaned_base32) {
-        char upper_c = std::toupper(c);
-        const char* pos = std::strchr(base32_chars, upper_c);
+    for (char c : base32) {
+        if (c == '=') {
+            continue;
+        }
+        char upper_c = std::toupper(static_cast<unsigned char>(c));
+        const char* pos = upper_c ? std::strchr(base32_chars, upper_c) : nullptr;
         if (!pos) {
             std::cerr << "Invalid base32 character: " << c << std::endl;
             continue;
@@ -233,80 +508,130 @@ std::vector<uint8_t> base32_decode(const std::string& base32) {
         }
     }
 
-    std::cerr << "Base32 decoded: ";
-    for (uint8_t b : result) {
-        std::cerr << std::hex << std::setw(2) << std::setfill('0') << (int)b << " ";
-    }
-    std::cerr << std::dec << std::endl;
+    TOTP_TRACE("base32 decoded " << result.size() << " key bytes");
     return result;
 }
 
-// TOTP generation
-uint32_t generate_totp(const std::string& secret, int64_t time_step) {
-    std::vector<uint8_t> key = base32_decode(secret);
-    if (key.empty()) {
-        std::cerr << "TOTP: Empty key after base32 decode" << std::endl;
-        return 0;
+// RFC 6238 verifier for one secret. The key is decoded once and the HMAC
+// inner/outer pad states are hashed once; each window then only copies those
+// states and hashes 8 bytes, with no allocation.
+class TotpVerifier {
+public:
+    explicit TotpVerifier(const std::string& secret)
+        : inner(EVP_MD_CTX_new()), outer(EVP_MD_CTX_new()), work(EVP_MD_CTX_new()) {
+        std::vector<uint8_t> key = base32_decode(secret);
+        if (key.empty() || !inner || !outer || !work) {
+            return;
+        }
+        uint8_t block[SHA_CBLOCK] = {};
+        if (key.size() > SHA_CBLOCK) {
+            SHA1(key.data(), key.size(), block);
+        } else {
+            std::memcpy(block, key.data(), key.size());
+        }
+        uint8_t ipad[SHA_CBLOCK], opad[SHA_CBLOCK];
+        for (int i = 0; i < SHA_CBLOCK; i++) {
+            ipad[i] = block[i] ^ 0x36;
+            opad[i] = block[i] ^ 0x5c;
+        }
+        OPENSSL_cleanse(block, sizeof(block));
+        OPENSSL_cleanse(key.data(), key.size());
+        ready = EVP_DigestInit_ex(inner, EVP_sha1(), nullptr) && EVP_DigestUpdate(inner, ipad, sizeof(ipad)) &&
+                EVP_DigestInit_ex(outer, EVP_sha1(), nullptr) && EVP_DigestUpdate(outer, opad, sizeof(opad));
+        OPENSSL_cleanse(ipad, sizeof(ipad));
+        OPENSSL_cleanse(opad, sizeof(opad));
     }
 
-    // Encode time step as 8-byte big-endian
-    std::vector<uint8_t> message(8);
-    for (int i = 7; i >= 0; --i) {
-        message[i] = (time_step >> (8 * (7 - i))) & 0xFF;
+    ~TotpVerifier() {
+        EVP_MD_CTX_free(inner);
+        EVP_MD_CTX_free(outer);
+        EVP_MD_CTX_free(work);
     }
 
-    std::cerr << "TOTP: HMAC message (time step " << time_step << "): ";
-    for (uint8_t b : message) {
-        std::cerr << std::hex << std::setw(2) << std::setfill('0') << (int)b << " ";
+    TotpVerifier(const TotpVerifier&) = delete;
+    TotpVerifier& operator=(const TotpVerifier&) = delete;
+
+    bool valid() const { return ready; }
+
+    // Six-digit code for a 30-second time step; 0 if the secret was unusable.
+    uint32_t code(int64_t time_step) {
+        if (!ready) {
+            return 0;
+        }
+        uint8_t message[8];
+        for (int i = 7; i >= 0; --i) {
+            message[i] = static_cast<uint8_t>(time_step >> (8 * (7 - i)));
+        }
+        uint8_t inner_hash[SHA_DIGEST_LENGTH], hash[SHA_DIGEST_LENGTH];
+        unsigned int len = 0;
+        EVP_MD_CTX_copy_ex(work, inner);
+        EVP_DigestUpdate(work, message, sizeof(message));
+        EVP_DigestFinal_ex(work, inner_hash, &len);
+        EVP_MD_CTX_copy_ex(work, outer);
+        EVP_DigestUpdate(work, inner_hash, sizeof(inner_hash));
+        EVP_DigestFinal_ex(work, hash, &len);
+
+        // Dynamic offset and truncation per RFC 6238
+        int offset = hash[SHA_DIGEST_LENGTH - 1] & 0x0F;
+        uint32_t truncated = ((hash[offset] & 0x7F) << 24) |
+                             ((hash[offset + 1] & 0xFF) << 16) |
+                             ((hash[offset + 2] & 0xFF) << 8) |
+                             (hash[offset + 3] & 0xFF);
+        return truncated % 1000000;
     }
-    std::cerr << std::dec << std::endl;
 
-    std::vector<uint8_t> hash = hmac_sha1(key, message);
-    if (hash.size() < 20) {
-        std::cerr << "TOTP: Invalid HMAC-SHA1 output size: " << hash.size() << std::endl;
-        return 0;
+    // Checks `input` against steps time_step-window .. time_step+window. Every
+    // window is computed and compared without early exit, so timing does not
+    // depend on which window (if any) matched.
+    bool verify(const std::string& input, int64_t time_step, int window = 3) {
+        if (!ready || input.size() != 6) {
+            return false;
+        }
+        uint32_t input_code = 0;
+        for (char c : input) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            input_code = input_code * 10 + static_cast<uint32_t>(c - '0');
+        }
+        uint32_t matched = 0;
+        for (int i = -window; i <= window; ++i) {
+            uint32_t diff = code(time_step + i) ^ input_code;
+            matched |= ((diff | (0u - diff)) >> 31) ^ 1u;   // 1 iff diff == 0
+        }
+        TOTP_TRACE("step " << time_step << " +/-" << window << (matched ? ": match" : ": no match"));
+        return matched != 0;
     }
 
-    // Dynamic offset and truncation per RFC 6238
-    int offset = hash[hash.size() - 1] & 0x0F;
-    uint32_t truncated = ((hash[offset] & 0x7F) << 24) |
-                         ((hash[offset + 1] & 0xFF) << 16) |
-                         ((hash[offset + 2] & 0xFF) << 8) |
-                         (hash[offset + 3] & 0xFF);
-    uint32_t code = truncated % 1000000;
+private:
+    EVP_MD_CTX* inner;
+    EVP_MD_CTX* outer;
+    EVP_MD_CTX* work;
+    bool ready = false;
+};
 
-    std::cerr << "TOTP: Generated code " << code << " (offset " << offset << ", truncated " << truncated << ")" << std::endl;
-    return code;
+int64_t totp_time_step() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() / 30;
 }
 
-bool verify_totp(const std::string& secret, const std::string& code) {
-    if (secret.empty() || code.empty()) {
-        std::cerr << "TOTP verification failed: empty secret or code" << std::endl;
-        return false;
+// TOTP generation
+uint32_t generate_totp(const std::string& secret, int64_t time_step) {
+    TotpVerifier verifier(secret);
+    if (!verifier.valid()) {
+        std::cerr << "TOTP: Empty key after base32 decode" << std::endl;
+        return 0;
     }
+    return verifier.code(time_step);
+}
 
-    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
-    int64_t time_step = now / 30;
-    std::cerr << "TOTP: Current time " << now << " seconds, time step " << time_step << std::endl;
-
-    try {
-        uint32_t input_code = std::stoi(code);
-        std::cerr << "TOTP: Verifying input code " << input_code << std::endl;
-        for (int i = -3; i <= 3; ++i) {
-            uint32_t expected_code = generate_totp(secret, time_step + i);
-            std::cerr << "TOTP: Checking time step " << time_step + i << ", expected code: " << expected_code << std::endl;
-            if (input_code == expected_code) {
-                std::cerr << "TOTP verification successful" << std::endl;
-                return true;
-            }
-        }
-        std::cerr << "TOTP verification failed: no matching code" << std::endl;
-    } catch (...) {
-        std::cerr << "TOTP verification failed: invalid code format" << std::endl;
+bool verify_totp(const std::string& secret, const std::string& code) {
+    if (secret.empty() || code.empty()) {
+        TOTP_TRACE("empty secret or code");
         return false;
     }
-    return false;
+    TotpVerifier verifier(secret);
+    return verifier.verify(code, totp_time_step());
 }
 
 #endif
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SQLTRACE_H
+#define SQLTRACE_H
+
+#include <sqlite3.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+// Per-statement SQL latency tracing through sqlite3_trace_v2. Each thread
+// records into its own buckets with relaxed atomics, so the hot path takes
+// no lock; the mutexes are only held when a new statement is first seen and
+// when a snapshot is taken. Latency is measured from the STMT event to the
+// PROFILE event with steady_clock, because SQLite's own profile time only has
+// the VFS clock's millisecond resolution.
+
+// Latency histogram: four linear sub-buckets per power of two of nanoseconds.
+constexpr int kSqlTraceBuckets = 48 * 4;
+
+inline int sqlTraceBucket(uint64_t ns) {
+    if (ns < 4) return static_cast<int>(ns);
+    int log2 = 63 - __builtin_clzll(ns);
+    int sub = static_cast<int>((ns >> (log2 - 2)) & 3);
+    return std::min(log2 * 4 + sub, kSqlTraceBuckets - 1);
+}
+
+inline uint64_t sqlTraceBucketUpperNs(int bucket) {
+    if (bucket < 4) return bucket + 1;
+    int log2 = bucket / 4;
+    uint64_t base = 1ULL << log2;
+    return base + (base >> 2) * ((bucket % 4) + 1);
+}
+
+struct SqlStatementCounters {
+    std::string sql;
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> rows{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, kSqlTraceBuckets> histogram{};
+};
+
+struct SqlStatementReport {
+    std::string sql;
+    uint64_t calls = 0;
+    uint64_t rows = 0;
+    double total_ms = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+class SqlTrace {
+public:
+    static SqlTrace& instance() {
+        static SqlTrace trace;
+        return trace;
+    }
+
+    // Registers the shared trace callback on a connection. The frame profiler
+    // counts statements from the same callback, since a connection can only
+    // have one.
+    void install(sqlite3* db) {
+        sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW, &SqlTrace::callback, this);
+    }
+
+    // Optional hook run for every finished statement (the metrics histogram); must be cheap.
+    void setObserver(void (*fn)(uint64_t ns)) { observer.store(fn, std::memory_order_relaxed); }
+
+    std::vector<SqlStatementReport> snapshot();
+    void reset();
+    void dump(std::ostream& out);
+
+private:
+    struct Running {
+        sqlite3_stmt* stmt;
+        std::chrono::steady_clock::time_point started;
+        uint64_t rows;
+    };
+
+    struct ThreadBucket {
+        std::mutex mutex;   // guards `stats` against concurrent snapshots
+        std::vector<std::unique_ptr<SqlStatementCounters>> stats;
+        std::unordered_map<uint64_t, SqlStatementCounters*> by_raw_hash;      // owner thread only
+        std::unordered_map<std::string, SqlStatementCounters*> by_normalized; // owner thread only
+        std::vector<Running> running;                                         // owner thread only
+    };
+
+    SqlTrace() = default;
+
+    ThreadBucket& bucket() {
+        thread_local std::shared_ptr<ThreadBucket> local;
+        if (!local) {
+            local = std::make_shared<ThreadBucket>();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            buckets.push_back(local);
+        }
+        return *local;
+    }
+
+    SqlStatementCounters& counters(ThreadBucket& b, sqlite3_stmt* stmt) {
+        const char* raw = sqlite3_sql(stmt);
+        uint64_t hash = 1469598103934665603ULL;
+        for (const char* c = raw ? raw : ""; *c; c++) {
+            hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ULL;
+        }
+        auto it = b.by_raw_hash.find(hash);
+        if (it != b.by_raw_hash.end()) return *it->second;
+
+        std::string normalized = normalize(raw ? raw : "");
+        auto named = b.by_normalized.find(normalized);
+        SqlStatementCounters* entry;
+        if (named != b.by_normalized.end()) {
+            entry = named->second;
+        } else {
+            auto created = std::make_unique<SqlStatementCounters>();
+            created->sql = normalized;
+            entry = created.get();
+            b.by_normalized.emplace(normalized, entry);
+            std::lock_guard<std::mutex> lock(b.mutex);
+            b.stats.push_back(std::move(created));
+        }
+        b.by_raw_hash.emplace(hash, entry);
+        return *entry;
+    }
+
+    void start(sqlite3_stmt* stmt) {
+        ThreadBucket& b = bucket();
+        for (auto& running : b.running) {
+            if (running.stmt == stmt) {
+                running.started = std::chrono::steady_clock::now();
+                running.rows = 0;
+                return;
+            }
+        }
+        b.running.push_back({stmt, std::chrono::steady_clock::now(), 0});
+    }
+
+    void record(sqlite3_stmt* stmt, uint64_t sqlite_ns) {
+        ThreadBucket& b = bucket();
+        uint64_t rows = 0;
+        uint64_t ns = sqlite_ns;
+        for (size_t i = 0; i < b.running.size(); i++) {
+            if (b.running[i].stmt == stmt) {
+                rows = b.running[i].rows;
+                ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - b.running[i].started).count();
+                b.running[i] = b.running.back();
+                b.running.pop_back();
+                break;
+            }
+        }
+        SqlStatementCounters& c = counters(b, stmt);
+        c.calls.fetch_add(1, std::memory_order_relaxed);
+        c.rows.fetch_add(rows, std::memory_order_relaxed);
+        c.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        c.histogram[sqlTraceBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        if (ns > c.max_ns.load(std::memory_order_relaxed)) {
+            c.max_ns.store(ns, std::memory_order_relaxed);   // only the owner thread writes
+        }
+        if (auto fn = observer.load(std::memory_order_relaxed)) {
+            fn(ns);
+        }
+    }
+
+    void countRow(sqlite3_stmt* stmt) {
+        for (auto& running : bucket().running) {
+            if (running.stmt == stmt) {
+                running.rows++;
+                return;
+            }
+        }
+    }
+
+    static int callback(unsigned type, void* context, void* p, void* x) {
+        SqlTrace* trace = static_cast<SqlTrace*>(context);
+        if (type == SQLITE_TRACE_ROW) {
+            trace->countRow(static_cast<sqlite3_stmt*>(p));
+        } else if (type == SQLITE_TRACE_PROFILE) {
+            trace->record(static_cast<sqlite3_stmt*>(p), static_cast<uint64_t>(*static_cast<sqlite3_int64*>(x)));
+        } else if (type == SQLITE_TRACE_STMT) {
+            // Trigger programs report "-- ..." for the statement already running.
+            const char* text = static_cast<const char*>(x);
+            if (text && text[0] == '-' && text[1] == '-') return 0;
+            trace->start(static_cast<sqlite3_stmt*>(p));
+#ifdef CANTEEN_PROFILER
+            Profiler::instance().countStatement();
+#endif
+        }
+        return 0;
+    }
+
+    // Collapses whitespace and replaces literals with '?', so statements built
+    // by concatenation group with their bound-parameter equivalents.
+    static std::string normalize(const std::string& sql) {
+        std::string out;
+        out.reserve(sql.size());
+        for (size_t i = 0; i < sql.size(); i++) {
+            char c = sql[i];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                if (!out.empty() && out.back() != ' ') out += ' ';
+            } else if (c == '\'') {
+                size_t j = i + 1;
+                while (j < sql.size() && !(sql[j] == '\'' && (j + 1 >= sql.size() || sql[j + 1] != '\''))) {
+                    j += sql[j] == '\'' ? 2 : 1;
+                }
+                out += '?';
+                i = j;
+            } else if (std::isdigit(static_cast<unsigned char>(c)) &&
+                       (out.empty() || !(std::isalnum(static_cast<unsigned char>(out.back())) || out.back() == '_'))) {
+                while (i + 1 < sql.size() && (std::isalnum(static_cast<unsigned char>(sql[i + 1])) || sql[i + 1] == '.')) i++;
+                out += '?';
+            } else {
+                out += c;
+            }
+        }
+        while (!out.empty() && out.back() == ' ') out.pop_back();
+        return out;
+    }
+
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<ThreadBucket>> buckets;
+    std::atomic<void (*)(uint64_t)> observer{nullptr};
+};
+
+std::vector<SqlStatementReport> SqlTrace::snapshot() {
+    struct Merged {
+        uint64_t calls = 0, rows = 0, total_ns = 0, max_ns = 0;
+        std::array<uint64_t, kSqlTraceBuckets> histogram{};
+    };
+    std::unordered_map<std::string, Merged> merged;
+    {
+        std::lock_guard<std::mutex> registry_lock(registry_mutex);
+        for (auto& b : buckets) {
+            std::lock_guard<std::mutex> lock(b->mutex);
+            for (auto& c : b->stats) {
+                Merged& m = merged[c->sql];
+                m.calls += c->calls.load(std::memory_order_relaxed);
+                m.rows += c->rows.load(std::memory_order_relaxed);
+                m.total_ns += c->total_ns.load(std::memory_order_relaxed);
+                m.max_ns = std::max(m.max_ns, c->max_ns.load(std::memory_order_relaxed));
+                for (int i = 0; i < kSqlTraceBuckets; i++) {
+                    m.histogram[i] += c->histogram[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    std::vector<SqlStatementReport> reports;
+    for (const auto& entry : merged) {
+        const Merged& m = entry.second;
+        if (m.calls == 0) continue;
+        SqlStatementReport report;
+        report.sql = entry.first;
+        report.calls = m.calls;
+        report.rows = m.rows;
+        report.total_ms = m.total_ns / 1e6;
+        report.max_us = m.max_ns / 1e3;
+        auto quantile = [&](double q) {
+            uint64_t target = static_cast<uint64_t>(q * (m.calls - 1)) + 1;
+            uint64_t seen = 0;
+            for (int i = 0; i < kSqlTraceBuckets; i++) {
+                seen += m.histogram[i];
+                if (seen >= target) return std::min(sqlTraceBucketUpperNs(i), m.max_ns) / 1e3;
+            }
+            return m.max_ns / 1e3;
+        };
+        report.p50_us = quantile(0.50);
+        report.p99_us = quantile(0.99);
+        reports.push_back(report);
+    }
+    std::sort(reports.begin(), reports.end(),
+              [](const SqlStatementReport& a, const SqlStatementReport& b) { return a.total_ms > b.total_ms; });
+    return reports;
+}
+
+void SqlTrace::reset() {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    for (auto& b : buckets) {
+        std::lock_guard<std::mutex> lock(b->mutex);
+        for (auto& c : b->stats) {
+            c->calls.store(0, std::memory_order_relaxed);
+            c->rows.store(0, std::memory_order_relaxed);
+            c->total_ns.store(0, std::memory_order_relaxed);
+            c->max_ns.store(0, std::memory_order_relaxed);
+            for (auto& h : c->histogram) h.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void SqlTrace::dump(std::ostream& out) {
+    auto reports = snapshot();
+    if (reports.empty()) return;
+    out << "SQL statement latency (sorted by total time):" << std::endl;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%10s %10s %12s %10s %10s %10s  %s", "calls", "rows", "total_ms", "p50_us", "p99_us", "max_us", "statement");
+    out << line << std::endl;
+    for (const auto& r : reports) {
+        std::snprintf(line, sizeof(line), "%10llu %10llu %12.2f %10.1f %10.1f %10.1f  ",
+                      static_cast<unsigned long long>(r.calls), static_cast<unsigned long long>(r.rows),
+                      r.total_ms, r.p50_us, r.p99_us, r.max_us);
+        out << line << r.sql << std::endl;
+    }
+}
+
+#endif
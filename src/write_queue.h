@@ -0,0 +1,321 @@
+/*
+ * Copyright 2025 Runtime Assassins
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+#include <sqlite3.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <iostream>
+
+// run() returns false when `failed` says the command's result is a failure.
+template <typename R>
+struct WriteResult {
+    R value{};
+    template <typename F, typename Failed> bool run(F& fn, sqlite3* db, Failed& failed) {
+        value = fn(db);
+        return !failed(value);
+    }
+    void deliver(std::promise<R>& promise) { promise.set_value(std::move(value)); }
+};
+
+template <>
+struct WriteResult<void> {
+    template <typename F, typename Failed> bool run(F& fn, sqlite3* db, Failed&) {
+        fn(db);
+        return true;
+    }
+    void deliver(std::promise<void>& promise) { promise.set_value(); }
+};
+
+struct NeverFails {
+    template <typename T> bool operator()(const T&) const { return false; }
+};
+
+// Single-writer command queue. All mutations run on one dedicated thread and
+// connection; commands that arrive within max_delay of each other are grouped
+// into a single transaction (group commit), and callers get their results
+// through futures once that transaction has committed.
+//
+// A command is rolled back alone (its savepoint) when it throws, or when the
+// `failed` predicate given to submit() says its result is a failure, so a
+// command that returns false after partial writes does not commit them.
+class WriteQueue {
+public:
+    WriteQueue(const std::string& db_path, size_t max_batch = 128,
+               std::chrono::microseconds max_delay = std::chrono::milliseconds(2));
+    ~WriteQueue();
+
+    bool isOpen() const { return db != nullptr; }
+    bool ownsConnection(sqlite3* conn) const { return conn != nullptr && conn == db; }
+    size_t depth();
+
+    // Runs on the writer thread after every group commit, e.g. to wake the UI loop.
+    void setOnCommit(std::function<void()> fn);
+
+    // Groups this queue has committed, and commits by any other connection
+    // the writer has seen (checked as each group starts). Lets a reader tell
+    // its own process's writes from someone else's.
+    uint64_t commitCount() const { return commits.load(std::memory_order_acquire); }
+    uint64_t foreignCommitCount() const { return foreign_commits.load(std::memory_order_acquire); }
+
+    template <typename F, typename Failed = NeverFails>
+    auto submit(F fn, Failed failed = Failed()) -> std::future<decltype(fn(static_cast<sqlite3*>(nullptr)))>;
+
+    // For side effects outside the database (printing, in-memory caches)
+    // that must only happen if the data they describe is committed. Called
+    // from a queued command, fn runs after its group commits, before the
+    // caller's future resolves, and is dropped if the command or the group
+    // rolls back. Called anywhere else (inline writes, tools) there is no
+    // group to wait for, so fn runs now.
+    static void afterCommit(std::function<void()> fn);
+    // The undo for in-memory changes made ahead of the commit: fn runs only
+    // if the current queued command or its group rolls back.
+    static void onRollback(std::function<void()> fn);
+
+private:
+    struct Command {
+        std::function<bool(sqlite3*)> execute;   // false: roll the command back
+        std::function<void(std::exception_ptr)> complete;
+    };
+
+    struct Hooks {
+        std::vector<std::function<void()>> commit;
+        std::vector<std::function<void()>> rollback;
+    };
+
+    // The hooks of the command running on this thread, if any.
+    static Hooks*& currentHooks() {
+        static thread_local Hooks* hooks = nullptr;
+        return hooks;
+    }
+
+    static void runAll(std::vector<std::function<void()>>& fns) {
+        for (auto& fn : fns) fn();
+        fns.clear();
+    }
+
+    void run();
+    bool exec(const char* sql);
+    long long dataVersion();
+
+    sqlite3* db = nullptr;
+    size_t max_batch;
+    std::chrono::microseconds max_delay;
+    std::deque<Command> pending;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::function<void()> on_commit;
+    std::atomic<uint64_t> commits{0};
+    std::atomic<uint64_t> foreign_commits{0};
+    long long data_version = -1;
+    bool stopping = false;
+    std::thread worker;
+};
+
+WriteQueue::WriteQueue(const std::string& db_path, size_t max_batch, std::chrono::microseconds max_delay)
+    : max_batch(max_batch), max_delay(max_delay) {
+    if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "Cannot open writer connection: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        db = nullptr;
+        return;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    exec("PRAGMA journal_mode=WAL;");
+    exec("PRAGMA synchronous=NORMAL;");
+    worker = std::thread(&WriteQueue::run, this);
+}
+
+WriteQueue::~WriteQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (db) {
+        sqlite3_close(db);
+    }
+}
+
+size_t WriteQueue::depth() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
+
+void WriteQueue::setOnCommit(std::function<void()> fn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    on_commit = std::move(fn);
+}
+
+void WriteQueue::afterCommit(std::function<void()> fn) {
+    if (Hooks* hooks = currentHooks()) {
+        hooks->commit.push_back(std::move(fn));
+    } else {
+        fn();
+    }
+}
+
+void WriteQueue::onRollback(std::function<void()> fn) {
+    if (Hooks* hooks = currentHooks()) {
+        hooks->rollback.push_back(std::move(fn));
+    }
+}
+
+template <typename F, typename Failed>
+auto WriteQueue::submit(F fn, Failed failed) -> std::future<decltype(fn(static_cast<sqlite3*>(nullptr)))> {
+    using R = decltype(fn(static_cast<sqlite3*>(nullptr)));
+    auto promise = std::make_shared<std::promise<R>>();
+    auto result = std::make_shared<WriteResult<R>>();
+    auto task = std::make_shared<F>(std::move(fn));
+    std::future<R> future = promise->get_future();
+
+    Command command;
+    command.execute = [task, result, failed](sqlite3* conn) mutable { return result->run(*task, conn, failed); };
+    command.complete = [promise, result](std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            result->deliver(*promise);
+        }
+    };
+
+    if (!db) {
+        // No writer connection: fail fast rather than queueing forever.
+        command.complete(std::make_exception_ptr(std::runtime_error("Writer connection is not open")));
+        return future;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(command));
+    }
+    ready.notify_one();
+    return future;
+}
+
+bool WriteQueue::exec(const char* sql) {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Writer SQL error (" << sql << "): " << (errMsg ? errMsg : "unknown") << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+long long WriteQueue::dataVersion() {
+    sqlite3_stmt* stmt;
+    long long version = -1;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
+void WriteQueue::run() {
+    std::vector<Command> batch;
+    std::vector<std::exception_ptr> errors;
+    std::vector<Hooks> hooks;
+    std::vector<bool> kept;
+    std::function<void()> notify;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                return;
+            }
+            // Hold the batch open briefly so a burst shares one commit.
+            auto deadline = std::chrono::steady_clock::now() + max_delay;
+            ready.wait_until(lock, deadline, [this] { return stopping || pending.size() >= max_batch; });
+            while (!pending.empty() && batch.size() < max_batch) {
+                batch.push_back(std::move(pending.front()));
+                pending.pop_front();
+            }
+            notify = on_commit;
+        }
+
+        errors.assign(batch.size(), nullptr);
+        hooks.assign(batch.size(), Hooks());
+        kept.assign(batch.size(), false);
+        // The writer's own commits leave its data_version alone.
+        long long version = dataVersion();
+        if (data_version != -1 && version != data_version) {
+            foreign_commits.fetch_add(1, std::memory_order_acq_rel);
+        }
+        data_version = version;
+        bool began = exec("BEGIN IMMEDIATE;");
+        for (size_t i = 0; i < batch.size(); i++) {
+            // Each command gets a savepoint so a failing one does not undo its neighbours.
+            exec("SAVEPOINT write_command;");
+            currentHooks() = &hooks[i];
+            try {
+                kept[i] = batch[i].execute(db);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+            currentHooks() = nullptr;
+            if (!kept[i]) {
+                exec("ROLLBACK TO write_command;");
+                runAll(hooks[i].rollback);
+            }
+            exec("RELEASE write_command;");
+        }
+        bool committed = true;
+        if (began && !exec("COMMIT;")) {
+            exec("ROLLBACK;");
+            committed = false;
+            auto failure = std::make_exception_ptr(std::runtime_error("Group commit failed: " + std::string(sqlite3_errmsg(db))));
+            for (auto& error : errors) {
+                if (!error) error = failure;
+            }
+        } else {
+            commits.fetch_add(1, std::memory_order_acq_rel);
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (kept[i]) runAll(committed ? hooks[i].commit : hooks[i].rollback);
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            batch[i].complete(errors[i]);
+        }
+        batch.clear();
+        if (notify) {
+            notify();
+        }
+    }
+}
+
+#endif